@@ -43,12 +43,13 @@ def rag_chat(request: ChatRequest):
 
     # B. RAG LOGIC
     try:
-        cpp_response = requests.get(f"http://localhost:8080/search?q={request.question}&page=1&limit=5")
+        # Best passages (about 100 tokens each) rather than search snippets
+        cpp_response = requests.get("http://localhost:8080/passages", params={"q": request.question, "k": 5})
         cpp_response.raise_for_status()
-        search_data = cpp_response.json()
+        passage_data = cpp_response.json()
 
-        snippets = [res.get("snippet", "") for res in search_data.get("results", [])]
-        context = "\n---\n".join(snippets) if snippets else "No relevant context found."
+        passages = [p.get("text", "") for p in passage_data.get("passages", [])]
+        context = "\n---\n".join(passages) if passages else "No relevant context found."
 
         template = "Context: {context}\n\nQuestion: {question}\n\nAnswer:"
         prompt = PromptTemplate(template=template, input_variables=["context", "question"])
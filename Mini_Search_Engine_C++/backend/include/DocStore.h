@@ -0,0 +1,105 @@
+#ifndef DOC_STORE_H
+#define DOC_STORE_H
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// LZ77 block codec in the LZ4 sequence format: a token byte (literal count
+// in the high nibble, match length - 4 in the low one, 15 = more bytes
+// follow, each adding up to 255), the literals, a u16 little-endian match
+// offset and the extra match length bytes. The last sequence is literals
+// only. Decompression is bounds-checked and fails on corrupt input.
+string lzCompress(const char* data, size_t size);
+bool lzDecompress(const char* data, size_t size, char* out, size_t rawSize);
+
+
+struct DocStoreMemory {
+    size_t heapBytes = 0;      // open block and blocks compressed in memory
+    size_t mappedBytes = 0;    // blocks read from index segment mappings
+    size_t cacheBytes = 0;     // decompressed blocks in the LRU
+};
+
+// Document texts for snippets, kept compressed. Texts are appended to an
+// open block of at most kBlockSize bytes that is compressed once full, so
+// memory holds compressed blocks plus one open block. A text that does not
+// fit in one block continues through the blocks after it. Blocks loaded
+// from an index segment are used straight from its mapping. Reads
+// decompress only the blocks holding the requested bytes, through a small
+// LRU of decompressed blocks. Thread-safe.
+//
+// Section payload (little-endian):
+//   u64 first docID, u64 document count, u64 block count
+//   per block: u64 offset (from the start of the block data), u32
+//     compressed size, u32 raw size (at most kBlockSize)
+//   per document: u32 first block (0xFFFFFFFF: no text), u32 offset in
+//     it, u32 length (running on into the following blocks)
+//   block data
+class DocStore {
+public:
+    static constexpr size_t kBlockSize = 32 << 10;
+    static constexpr size_t kCachedBlocks = 8;
+
+    void clear();
+    void add(int docID, const string& text);
+
+    // Bytes [begin, end) of the document, clamped to its length
+    string slice(int docID, long long begin, long long end) const;
+    string text(int docID) const { return slice(docID, 0, LLONG_MAX); }
+
+    // Documents [firstDoc, endDoc) as a section payload; whole blocks in
+    // the range are copied as they are, the rest is recompressed
+    string serialize(int firstDoc, int endDoc) const;
+
+    // Uses a section payload in place; owner keeps the mapping alive
+    bool attach(const char* data, size_t size, shared_ptr<const char> owner, string& error);
+
+    size_t compressedBytes() const;
+    size_t rawBytes() const;
+    DocStoreMemory memory() const;
+
+    // Drop a mapped block's pages once it has been decompressed (bounded
+    // memory mode); the LRU then holds the only resident copy
+    void setReleaseMappedPages(bool release);
+
+private:
+    static constexpr uint32_t kNoBlock = 0xFFFFFFFF;
+
+    struct Block {
+        shared_ptr<const char> owner;
+        const char* data = nullptr;
+        uint32_t compressedSize = 0;
+        uint32_t rawSize = 0;
+        int minDoc = 0, maxDoc = -1;
+        bool mapped = false;          // data points into an index mapping
+    };
+    struct Location {
+        uint32_t block = kNoBlock;
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    mutable mutex lock;
+    vector<Block> blocks;
+    vector<Location> locations;       // by docID
+    string open;                      // becomes block blocks.size()
+    int openMinDoc = 0, openMaxDoc = -1;
+    bool releaseMapped = false;
+
+    mutable list<pair<uint32_t, shared_ptr<const string>>> cache;   // most recent first
+
+    void seal();
+    // Decompressed block, from the cache or decoded with the lock released
+    shared_ptr<const string> blockText(uint32_t block, unique_lock<mutex>& held) const;
+    // Bytes [begin, end) of the text at location, from the blocks it spans
+    string readText(Location location, size_t begin, size_t end, unique_lock<mutex>& held) const;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef EMBEDDING_MATRIX_H
+#define EMBEDDING_MATRIX_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+// Minimal allocator so std::vector storage starts on an Align-byte boundary
+template <typename T, size_t Align>
+struct AlignedAllocator {
+    using value_type = T;
+    template <typename U> struct rebind { using other = AlignedAllocator<U, Align>; };
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+    T* allocate(size_t n) {
+        void* p = ::operator new(n * sizeof(T), std::align_val_t(Align));
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(Align));
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U, Align>&) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U, Align>&) const { return false; }
+};
+
+
+// Document embeddings as one contiguous docID x dim matrix. Rows are stored
+// L2-normalized and padded to a multiple of 8 floats, so every row starts on
+// a 32-byte boundary and cosine similarity is a single dot product.
+//
+// The matrix either owns its storage or borrows it from a mapped index file
+// (zero-copy load); the first write to a borrowed matrix copies it.
+class EmbeddingMatrix {
+public:
+    static constexpr size_t kAlignment = 32;
+
+    void clear();
+
+    // Borrows rows * stride floats and rows presence flags. Both must stay
+    // valid (mapped) until clear() or the next write.
+    void attach(const float* data, const unsigned char* flags, int dim, size_t stride, size_t rows);
+    bool isBorrowed() const { return borrowed; }
+    void ensureOwned();     // copies a borrowed view onto the heap
+
+    // Normalizes and stores vec as docID's row. The first vector fixes the
+    // dimension; vectors of another size (or all zeros) are rejected.
+    bool set(int docID, const vector<float>& vec);
+
+    bool has(int docID) const;
+    const float* row(int docID) const;
+
+    int dimension() const { return dim; }
+    size_t stride() const { return rowStride; }
+    size_t rows() const { return rowCount; }
+    size_t count() const { return presentCount; }
+    size_t memoryBytes() const;    // heap bytes only; a borrowed view is 0
+
+    const float* data() const { return base; }
+    const unsigned char* presenceFlags() const { return flags; }
+
+    // Batch scoring against a normalized query of dimension() floats.
+    // scoreAll fills out[docID] for every row (missing rows score 0).
+    void scoreAll(const float* query, vector<float>& out) const;
+    void score(const float* query, const vector<int>& docIDs, vector<float>& out) const;
+
+    // Visits every stored row as (docID, row pointer)
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (size_t docID = 0; docID < rowCount; docID++) {
+            if (flags[docID]) fn((int)docID, row((int)docID));
+        }
+    }
+
+private:
+    int dim = 0;
+    size_t rowStride = 0;
+    size_t rowCount = 0;
+    size_t presentCount = 0;
+
+    // base / flags point at the owned vectors or at the borrowed view
+    const float* base = nullptr;
+    const unsigned char* flags = nullptr;
+    bool borrowed = false;
+
+    vector<float, AlignedAllocator<float, kAlignment>> values;
+    vector<unsigned char> present;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef HNSW_INDEX_H
+#define HNSW_INDEX_H
+
+#include <vector>
+#include <unordered_map>
+#include <random>
+#include <utility>
+#include "EmbeddingMatrix.h"
+
+using namespace std;
+
+// Hierarchical Navigable Small World graph over document embeddings.
+// The graph only stores links; vectors are read from the (normalized)
+// EmbeddingMatrix it is built on, so similarity is a plain dot product
+// (equal to cosine similarity) and higher is closer.
+class HNSWIndex {
+public:
+    explicit HNSWIndex(const EmbeddingMatrix* store, int M = 16, int efConstruction = 200, int efSearch = 64);
+
+    // Changing M / efConstruction only affects nodes inserted afterwards,
+    // call rebuild() to apply them to the whole graph.
+    void setParams(int M, int efConstruction, int efSearch);
+    int getM() const { return M; }
+    int getEfConstruction() const { return efConstruction; }
+    int getEfSearch() const { return efSearch; }
+
+    void clear();
+    void add(int docID);     // docID's row must already be in the store
+    void rebuild();
+
+    // Top-k (docID, similarity) pairs, best first. ef <= 0 uses efSearch.
+    vector<pair<int, float>> search(const vector<float>& query, int k, int ef = 0) const;
+
+    // Exact top-k by scanning every node (used as ground truth for recall).
+    vector<pair<int, float>> bruteForce(const vector<float>& query, int k) const;
+
+    size_t size() const { return nodeDocIDs.size(); }
+    int dimension() const { return store->dimension(); }
+
+private:
+    int M;
+    int maxM0;              // layer 0 keeps twice as many links
+    int efConstruction;
+    int efSearch;
+    double levelMult;
+
+    const EmbeddingMatrix* store;
+    vector<int> nodeDocIDs;
+    vector<int> nodeLevels;
+    vector<vector<vector<int>>> links;  // links[node][level] -> neighbours
+    unordered_map<int, int> docToNode;
+
+    int entryPoint = -1;
+    int maxLevel = -1;
+    mt19937 rng;
+
+    const float* vectorOf(int node) const { return store->row(nodeDocIDs[node]); }
+    float similarity(const float* a, const float* b) const;
+
+    int randomLevel();
+    int greedyClosest(const float* query, int start, int fromLevel, int toLevel) const;
+    vector<pair<float, int>> searchLayer(const float* query, int entry, int ef, int level) const;
+    vector<int> selectNeighbours(vector<pair<float, int>> candidates, int maxLinks) const;
+    void insertNode(int node);
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef IMPACT_INDEX_H
+#define IMPACT_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+struct ImpactSearchStats {
+    size_t postingsScored = 0;
+    size_t segmentsScored = 0;
+    size_t segmentsTotal = 0;
+    bool earlyTerminated = false;   // top-k provably fixed before the end
+    bool budgetExhausted = false;   // stopped by the time budget (anytime result)
+    double elapsedMs = 0.0;
+};
+
+// Impact-ordered copy of the inverted index for score-at-a-time top-k.
+// Every posting's BM25 contribution is quantized to an 8-bit impact, and each
+// term keeps its docIDs grouped by impact, highest first. A query scores
+// whole segments in decreasing impact order across all its terms and stops
+// as soon as the remaining impacts cannot change which documents are in the
+// top k, or when its time budget runs out.
+class ImpactIndex {
+public:
+    void clear();
+
+    // Two-phase build: raw BM25 contributions per term, then finalize()
+    // quantizes them all against the largest one
+    void addTerm(const string& term, const vector<pair<int, float>>& scores);
+    void finalize();
+
+    bool empty() const { return terms.empty(); }
+    size_t memoryBytes() const;
+
+    // Top-k (docID, approximate BM25) pairs, best first. budgetMs <= 0
+    // means no time limit.
+    vector<pair<int, float>> search(const vector<string>& queryTerms, int k, double budgetMs,
+                                    ImpactSearchStats* stats = nullptr) const;
+
+private:
+    struct Segment {
+        uint8_t impact;
+        vector<int> docIDs;
+    };
+
+    unordered_map<string, vector<Segment>> terms;            // segments by impact desc
+    unordered_map<string, vector<pair<int, float>>> pending; // raw scores until finalize()
+    float scale = 0.0f;     // BM25 per impact unit
+    int docSpan = 0;        // largest docID + 1
+};
+
+#endif
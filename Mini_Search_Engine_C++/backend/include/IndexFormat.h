@@ -0,0 +1,159 @@
+#ifndef INDEX_FORMAT_H
+#define INDEX_FORMAT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// On-disk index container. Everything is little-endian regardless of host.
+//
+//   header (64 bytes)
+//     0  "MSEINDEX"
+//     8  u32 version          12  u32 section count
+//    16  u64 directory offset 24  u32 directory CRC32C
+//    28  u32 header CRC32C (bytes 0..27), rest zero
+//   sections, each starting on a 64-byte file offset
+//   directory: per section 32 bytes
+//     tag[8] (zero padded), u64 offset, u64 size, u32 CRC32C, u32 reserved
+//
+// Section payloads are defined by their writer (see SearchEngine::saveIndex).
+// The version goes up whenever one of them changes layout; a reader only
+// accepts its own:
+//   1  container, single-file index
+//   2  MANIFEST / SEGMENT / WAL: manifest plus segment files
+//   3  DSTORE: compressed document store
+//   4  TRIE / SPELL as flat arrays used in place
+//   5  DICTRNG: term ranges for parallel posting loads
+//   6  DSTORE: texts split across blocks of at most DocStore::kBlockSize
+
+constexpr uint32_t kIndexFormatVersion = 6;
+constexpr size_t kIndexAlignment = 64;
+constexpr size_t kIndexHeaderSize = 64;
+
+// CRC32C (Castagnoli). Uses the SSE4.2 / ARMv8 CRC instructions when the
+// CPU has them. Chainable: crc32c(b, n2, crc32c(a, n1)) == crc32c(a ++ b).
+uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0);
+const char* activeCrcKernel();    // "sse4.2", "armv8-crc" or "table"
+
+constexpr bool kLittleEndianHost = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+struct IndexSection {
+    string tag;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t crc = 0;
+};
+
+// Streams sections to a file through a large buffer; the directory and
+// header are written by finish(), which also fsyncs. Write errors are
+// sticky and show up as finish() returning false.
+class IndexWriter {
+public:
+    ~IndexWriter();
+    bool open(const string& path);
+
+    // Bytes handed to the file so far, published for progress reporting
+    void reportProgress(atomic<uint64_t>* counter) { progress = counter; }
+
+    void beginSection(const string& tag);
+    void endSection();
+
+    void putU8(uint8_t v);
+    void putU16(uint16_t v);
+    void putU32(uint32_t v);
+    void putU64(uint64_t v);
+    void putF64(double v);
+    void putString(const string& s);       // u32 length + bytes
+    void putBytes(const void* data, size_t size);
+    void putF32Array(const float* data, size_t count);
+    void align();                          // zero pad to the next 64-byte file offset
+
+    bool finish();
+    const string& error() const { return failure; }
+
+private:
+    static constexpr size_t kBufferSize = 4 << 20;
+
+    int fd = -1;
+    vector<char> buffer;
+    uint64_t position = 0;
+    vector<IndexSection> sections;
+    bool inSection = false;
+    string failure;
+    atomic<uint64_t>* progress = nullptr;
+
+    void raw(const void* data, size_t size);
+    bool flush();
+    bool writeAll(const char* data, size_t size, uint64_t offset);
+};
+
+// Parses and checks the header and directory of a mapped file. Section
+// CRCs are verified by open() unless verifySections is false (the
+// inspector checks them one by one instead).
+class IndexFile {
+public:
+    bool open(const char* data, size_t size, string& error, bool verifySections = true);
+
+    uint32_t version() const { return formatVersion; }
+    const vector<IndexSection>& sections() const { return directory; }
+    const IndexSection* find(const string& tag) const;
+    bool verify(const IndexSection& section) const;
+
+    const char* base() const { return data; }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    uint32_t formatVersion = 0;
+    vector<IndexSection> directory;
+};
+
+// Bounds-checked little-endian cursor over one section. A read past the end
+// fails, leaves the output untouched and makes ok() false for good.
+class SectionReader {
+public:
+    SectionReader(const IndexFile& file, const IndexSection& section);
+    SectionReader(const IndexFile& file, const IndexSection& section, uint64_t at);
+    // Over bytes of a section checked earlier (alignment is relative to data)
+    SectionReader(const char* data, size_t size);
+
+    bool u8(uint8_t& v);
+    bool u16(uint16_t& v);
+    bool u32(uint32_t& v);
+    bool u64(uint64_t& v);
+    bool f64(double& v);
+    bool str(string& s);
+    bool bytes(const char*& p, size_t size);   // points into the mapping
+    bool align();                              // skip to the next 64-byte file offset
+
+    // Checks a count read from the file against the bytes left, given the
+    // smallest encoding of one element
+    bool fits(uint64_t count, size_t minBytesEach);
+
+    bool ok() const { return good; }
+    size_t remaining() const { return good ? end - cursor : 0; }
+    const char* position() const { return cursor; }
+
+private:
+    const char* fileBase;
+    const char* cursor;
+    const char* end;
+    bool good = true;
+
+    bool take(void* out, size_t size);
+};
+
+
+// Pages of a read-only file mapping. releaseMappedPages drops every page
+// overlapping [data, data + size) from the process (touching one again
+// reads it back from the file, so neighbouring data stays valid);
+// residentMappedBytes counts the bytes of the process's pages overlapping
+// the range that are in memory now.
+void releaseMappedPages(const void* data, size_t size);
+size_t residentMappedBytes(const void* data, size_t size);
+
+#endif
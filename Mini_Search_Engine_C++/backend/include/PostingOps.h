@@ -0,0 +1,62 @@
+#ifndef POSTING_OPS_H
+#define POSTING_OPS_H
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// Operations over ascending integer lists (docID lists, position lists)
+
+// Smallest index i >= from with list[i] >= target, or list.size() if none.
+// Exponential probe followed by binary search, so skipping far ahead costs
+// O(log distance) instead of a linear walk.
+size_t gallopTo(const vector<int>& list, size_t from, int target);
+
+// Two-list intersection kernels (ascending, duplicate-free inputs):
+//   merge      scalar two-pointer walk, O(a + b)
+//   galloping  each element of the short list gallops into the long one,
+//              O(small * log(large / small)); best for skewed lengths
+//   simd       block compare (Lemire et al.): every 4 (SSE) or 8 (AVX2)
+//              element block of one list is checked against a block of the
+//              other with shuffles, matches are packed with a lookup table
+// The SIMD width is picked once at runtime; without SSSE3/AVX2 (or on
+// arm64) intersectSIMD is the scalar merge.
+vector<int> intersectMerge(const vector<int>& a, const vector<int>& b);
+vector<int> intersectGalloping(const vector<int>& a, const vector<int>& b);
+vector<int> intersectSIMD(const vector<int>& a, const vector<int>& b);
+const char* activeIntersectKernel();     // "avx2", "sse", "scalar"
+
+// Picks galloping when one list is kGallopRatio times longer than the
+// other, the block kernel otherwise (crossover measured with bench_intersect)
+constexpr size_t kGallopRatio = 64;
+vector<int> intersectAdaptive(const vector<int>& a, const vector<int>& b);
+
+// Intersection of sorted lists. The lists are processed shortest first, so
+// the running result only shrinks and later steps lean towards galloping.
+vector<int> intersectSorted(vector<const vector<int>*> lists);
+
+// Union of sorted lists (k-way merge, duplicates removed)
+vector<int> unionSorted(const vector<const vector<int>*>& lists);
+
+// Elements of list that are not in remove. remove is only probed by
+// galloping, so a long exclusion list is skipped over rather than scanned.
+vector<int> subtractSorted(const vector<int>& list, const vector<int>& remove);
+
+// Bitmap variants over docIDs in [0, universe). Cheaper than merging once
+// the lists are dense (average gap of a few dozen docIDs or less).
+vector<int> intersectBitmap(const vector<const vector<int>*>& lists, int universe);
+vector<int> unionBitmap(const vector<const vector<int>*>& lists, int universe);
+bool preferBitmap(size_t listSize, int universe);
+
+// Positions p where words[i] occurs at p + i for every i, given each word's
+// ascending position list. Returns the number of matches; the first match
+// position is written to firstMatch (or -1).
+int matchPhrase(const vector<const vector<int>*>& positions, int& firstMatch);
+
+// Length of the shortest window (last - first + 1) that holds at least one
+// position from every list, found with a k-way merge. Returns 0 if any list
+// is empty.
+int minimalCoverSpan(const vector<const vector<int>*>& positions);
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef QUANTIZER_H
+#define QUANTIZER_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "EmbeddingMatrix.h"
+
+using namespace std;
+
+// Per-dimension 8-bit scalar quantization: x ~= lo[i] + step[i] * code.
+// 1 byte per dimension (4x smaller than float).
+class ScalarQuantizer {
+public:
+    void train(const vector<const float*>& samples, int dim);
+    void encode(const float* vec, uint8_t* code) const;
+
+    // Asymmetric scoring: the query stays in float, only docs are quantized.
+    // dot(q, decode(c)) = bias + sum(weights[i] * c[i])
+    struct QueryTable {
+        vector<float> weights;
+        float bias = 0.0f;
+    };
+    QueryTable prepare(const float* query) const;
+    float score(const QueryTable& table, const uint8_t* code) const;
+
+    size_t codeSize() const { return dim; }
+
+private:
+    int dim = 0;
+    vector<float> lo;
+    vector<float> step;
+};
+
+// Product quantization: the vector is split into `subspaces` chunks and each
+// chunk is replaced by the id of its nearest of 256 k-means centroids.
+// 1 byte per subspace (dim / subspaces * 4 times smaller than float).
+class ProductQuantizer {
+public:
+    void train(const vector<const float*>& samples, int dim, int subspaces, int iterations = 12);
+    void encode(const float* vec, uint8_t* code) const;
+
+    // Asymmetric scoring via a subspaces x 256 table of partial dot products
+    vector<float> prepare(const float* query) const;
+    float score(const vector<float>& table, const uint8_t* code) const;
+
+    size_t codeSize() const { return subspaces; }
+    size_t codebookBytes() const { return centroids.size() * sizeof(float); }
+
+private:
+    int dim = 0;
+    int subspaces = 0;
+    int centroidsPerSpace = 0;
+    vector<int> subStart;        // subspaces + 1 boundaries
+    vector<float> centroids;     // [space][centroid][subDim], packed by subStart
+
+    const float* centroid(int space, int c) const;
+};
+
+// Full-precision rows spilled to a flat file (docID * dim floats) so a
+// quantized store can rerank its final candidates exactly.
+class FullPrecisionFile {
+public:
+    ~FullPrecisionFile();
+    bool open(const string& path, int dim);
+    void close();
+    bool write(int docID, const float* row);
+    bool read(int docID, vector<float>& out) const;
+    bool isOpen() const { return fd >= 0; }
+
+private:
+    int fd = -1;
+    int dim = 0;
+    string path;
+};
+
+enum class EmbeddingStorage { Float, Int8, PQ };
+
+// Compact codes for every embedded document, scored with ADC
+class QuantizedEmbeddings {
+public:
+    // Trains the quantizer on every row of source and encodes them
+    void build(EmbeddingStorage mode, int subspaces, const EmbeddingMatrix& source);
+    void clear();
+
+    bool add(int docID, const float* unitVec);
+    bool has(int docID) const;
+
+    template <typename Fn>
+    void forEachDoc(Fn fn) const {
+        for (size_t docID = 0; docID < present.size(); docID++) {
+            if (present[docID]) fn((int)docID);
+        }
+    }
+
+    // Top-k (docID, approximate similarity) by scanning all codes
+    vector<pair<int, float>> search(const float* unitQuery, int k) const;
+
+    EmbeddingStorage storage() const { return mode; }
+    bool trained() const { return dim > 0; }
+    int dimension() const { return dim; }
+    size_t count() const { return presentCount; }
+    size_t bytesPerVector() const { return codeSize; }
+    size_t memoryBytes() const;
+
+private:
+    EmbeddingStorage mode = EmbeddingStorage::Int8;
+    int dim = 0;
+    size_t codeSize = 0;
+    ScalarQuantizer sq;
+    ProductQuantizer pq;
+    vector<uint8_t> codes;       // docID-major
+    vector<unsigned char> present;
+    size_t presentCount = 0;
+};
+
+#endif
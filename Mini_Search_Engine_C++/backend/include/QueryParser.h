@@ -0,0 +1,47 @@
+#ifndef QUERY_PARSER_H
+#define QUERY_PARSER_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum class QueryOp {
+    Term,        // one normalized word
+    Phrase,      // quoted words that must be adjacent, in order
+    DocFilter,   // doc:name, a case-insensitive filename substring
+    Wildcard,    // term pattern with '*' (any run) and '?' (one character)
+    And,
+    Or,
+    Not          // single child
+};
+
+struct QueryNode {
+    QueryOp op = QueryOp::And;
+    string text;                  // Term word / DocFilter or Wildcard pattern
+    vector<string> words;         // Phrase words / Wildcard expansions
+    bool truncated = false;       // Wildcard: expansion stopped at a limit
+    vector<QueryNode> children;   // And / Or operands, Not's operand
+
+    // And only: plain words that rank documents but are not required
+    vector<QueryNode> optional;
+
+    bool empty() const;
+};
+
+// Query syntax:
+//   word  "quoted phrase"  doc:name  prefix*  w?ld*card  ( ... )
+//   a AND b   a && b     a OR b   a || b     NOT a   -a
+// AND binds tighter than OR. Operands written side by side without an
+// operator keep the bag-of-words behaviour: plain words and wildcards match
+// if any of them occurs, while phrases, doc: filters, negations and operator
+// groups are all required (plain words then only contribute to the score).
+// Wildcards are expanded later against the term dictionary; the parser
+// leaves their words empty.
+// normalizeWord maps a raw token to an index term ("" drops it).
+QueryNode parseQuery(const string& query, string (*normalizeWord)(const string&));
+
+// Compact single-line rendering, e.g. (AND "machine learning" (NOT doc:draft))
+string describeQuery(const QueryNode& node);
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef RERANKER_H
+#define RERANKER_H
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+struct RerankStats {
+    bool applied = false;
+    string model;               // "linear" or "gbdt"
+    size_t candidates = 0;      // N actually reranked
+    size_t depthLimit = 0;      // N allowed by the latency budget
+    double featureMs = 0.0;
+    double modelMs = 0.0;
+    double elapsedMs = 0.0;
+};
+
+// Second-phase scoring model over named features, read from a text file.
+//
+//   linear                       gbdt
+//   bias 0.1                     features bm25 proximity semantic
+//   weight bm25 1.0              tree
+//   weight proximity 0.5         split 0 2.5 1 2      (feature threshold left right)
+//                                leaf -0.1            (nodes numbered in file order)
+//                                leaf 0.4
+//                                end
+//
+// A tree sends x to `left` when x[feature] < threshold. A GBDT scores the
+// sum of its trees' leaves (learning rate already folded in). '#' starts a
+// comment.
+class RerankModel {
+public:
+    // Replaces the current model; on failure keeps it and fills error
+    bool load(const string& path, string& error);
+    bool loadFromString(const string& text, string& error);
+
+    bool loaded() const { return kind != Kind::None; }
+    string kindName() const;
+
+    // Feature names in the order score() expects them
+    const vector<string>& features() const { return featureNames; }
+    double score(const float* x) const;
+
+private:
+    enum class Kind { None, Linear, GBDT };
+    struct Node {
+        int feature = -1;       // -1 = leaf
+        float threshold = 0.0f;
+        int left = -1, right = -1;
+        float value = 0.0f;
+    };
+
+    Kind kind = Kind::None;
+    vector<string> featureNames;
+    vector<float> weights;          // linear, per feature
+    float bias = 0.0f;
+    vector<vector<Node>> trees;     // gbdt
+};
+
+// Runs a model over the first-phase top N. Features are computed by
+// extractors registered per query; only the ones the model names run.
+class Reranker {
+public:
+    using Extractor = function<double(int docID)>;
+
+    // Names an extractor can be registered under (checked when loading)
+    static const vector<string>& knownFeatures();
+
+    void addFeature(const string& name, Extractor extractor);
+
+    // candidates are (docID, first-phase score), best first. Returns them
+    // rescored by the model, best first.
+    vector<pair<int, double>> rerank(const vector<pair<int, double>>& candidates, const RerankModel& model,
+                                     RerankStats* stats = nullptr) const;
+
+private:
+    vector<pair<string, Extractor>> extractors;
+};
+
+// Picks N from recent per-candidate reranking cost so that a request at the
+// p99 cost still finishes inside the budget
+class RerankBudget {
+public:
+    void record(size_t candidates, double elapsedMs);
+    size_t depthFor(double budgetMs, size_t minDepth, size_t maxDepth) const;
+
+private:
+    static constexpr size_t kSamples = 512;
+    deque<double> msPerCandidate;
+};
+
+#endif
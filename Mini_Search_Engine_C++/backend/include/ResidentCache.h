@@ -0,0 +1,154 @@
+#ifndef RESIDENT_CACHE_H
+#define RESIDENT_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+struct ResidentCacheStats {
+    size_t budget = 0;
+    size_t entries = 0;
+    size_t residentBytes = 0;
+    size_t pinnedEntries = 0;
+    size_t pinnedBytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+// Decoded values kept within a byte budget, least recently used evicted
+// first. Values are handed out as shared_ptr, so evicting one a reader still
+// holds only drops the cache's reference. Keys read kHotHits times are pinned
+// (never evicted) while pinned bytes stay within half the budget; pin() pins
+// a key ahead of time, whether or not it is resident yet. Thread-safe.
+template <typename V>
+class ResidentCache {
+public:
+    static constexpr uint32_t kHotHits = 8;
+
+    ResidentCache() = default;
+    explicit ResidentCache(size_t budget) { counters.budget = budget; }
+
+    void setBudget(size_t bytes) {
+        lock_guard<mutex> guard(lock);
+        counters.budget = bytes;
+        evictOverBudget();
+    }
+
+    shared_ptr<const V> get(const string& key) {
+        lock_guard<mutex> guard(lock);
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            counters.misses++;
+            return nullptr;
+        }
+        counters.hits++;
+        Entry& entry = it->second;
+        recency.splice(recency.begin(), recency, entry.recent);
+        if (!entry.pinned && ++entry.hits >= kHotHits && counters.pinnedBytes + entry.bytes <= counters.budget / 2)
+            pinEntry(entry);
+        return entry.value;
+    }
+
+    // A value larger than the whole budget is not kept
+    void put(const string& key, shared_ptr<const V> value, size_t bytes) {
+        lock_guard<mutex> guard(lock);
+        eraseEntry(key);
+        bool pin = pinned.count(key) > 0;
+        if (!pin && bytes > counters.budget) return;
+
+        recency.push_front(key);
+        Entry& entry = entries[key];
+        entry.value = move(value);
+        entry.bytes = bytes;
+        entry.recent = recency.begin();
+        counters.residentBytes += bytes;
+        if (pin) pinEntry(entry);
+        evictOverBudget();
+    }
+
+    void pin(const string& key) {
+        lock_guard<mutex> guard(lock);
+        pinned.insert(key);
+        auto it = entries.find(key);
+        if (it != entries.end() && !it->second.pinned) pinEntry(it->second);
+    }
+
+    void erase(const string& key) {
+        lock_guard<mutex> guard(lock);
+        eraseEntry(key);
+    }
+
+    // Drops every value and pin; the budget stays
+    void clear() {
+        lock_guard<mutex> guard(lock);
+        entries.clear();
+        recency.clear();
+        pinned.clear();
+        size_t budget = counters.budget;
+        counters = ResidentCacheStats();
+        counters.budget = budget;
+    }
+
+    ResidentCacheStats stats() {
+        lock_guard<mutex> guard(lock);
+        ResidentCacheStats s = counters;
+        s.entries = entries.size();
+        return s;
+    }
+
+private:
+    struct Entry {
+        shared_ptr<const V> value;
+        size_t bytes = 0;
+        uint32_t hits = 0;
+        bool pinned = false;
+        list<string>::iterator recent;
+    };
+
+    mutex lock;
+    unordered_map<string, Entry> entries;
+    list<string> recency;              // most recent first; pinned entries too
+    unordered_set<string> pinned;      // explicit pins, resident or not
+    ResidentCacheStats counters;
+
+    void pinEntry(Entry& entry) {
+        entry.pinned = true;
+        counters.pinnedEntries++;
+        counters.pinnedBytes += entry.bytes;
+    }
+
+    void eraseEntry(const string& key) {
+        auto it = entries.find(key);
+        if (it == entries.end()) return;
+        Entry& entry = it->second;
+        counters.residentBytes -= entry.bytes;
+        if (entry.pinned) {
+            counters.pinnedEntries--;
+            counters.pinnedBytes -= entry.bytes;
+        }
+        recency.erase(entry.recent);
+        entries.erase(it);
+    }
+
+    void evictOverBudget() {
+        auto it = recency.end();
+        while (counters.residentBytes > counters.budget && it != recency.begin()) {
+            --it;
+            auto entry = entries.find(*it);
+            if (entry->second.pinned) continue;
+            auto victim = it++;
+            eraseEntry(*victim);
+            counters.evictions++;
+        }
+    }
+};
+
+#endif
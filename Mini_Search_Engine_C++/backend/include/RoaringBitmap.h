@@ -0,0 +1,61 @@
+#ifndef ROARING_BITMAP_H
+#define ROARING_BITMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Compressed set of non-negative docIDs in the Roaring layout: the id space
+// is cut into 65536-wide chunks keyed by the high 16 bits, and each chunk
+// stores its low 16 bits either as a sorted uint16 array (up to 4096
+// values, 2 bytes each) or as a 65536-bit bitmap (8 KB). Dense chunks cost
+// one bit per document and intersect a machine word at a time.
+class RoaringBitmap {
+public:
+    static RoaringBitmap fromSorted(const vector<int>& docIDs);
+
+    void add(int docID);            // cheapest when ids arrive in ascending order
+    bool contains(int docID) const;
+    bool empty() const { return containers.empty(); }
+    size_t cardinality() const;
+    size_t memoryBytes() const;
+    vector<int> toVector() const;   // ascending
+
+    static RoaringBitmap intersect(const RoaringBitmap& a, const RoaringBitmap& b);
+    static RoaringBitmap unite(const RoaringBitmap& a, const RoaringBitmap& b);
+    static RoaringBitmap subtract(const RoaringBitmap& a, const RoaringBitmap& b);
+
+    // |a AND b| without building the result
+    static size_t intersectCount(const RoaringBitmap& a, const RoaringBitmap& b);
+
+private:
+    static constexpr size_t kArrayMax = 4096;
+    static constexpr size_t kBitmapWords = 1024;
+
+    struct Container {
+        uint16_t key = 0;
+        size_t count = 0;
+        vector<uint16_t> values;    // array container (sorted)
+        vector<uint64_t> bits;      // bitmap container, kBitmapWords when used
+
+        bool isBitmap() const { return !bits.empty(); }
+        bool contains(uint16_t low) const;
+        void add(uint16_t low);
+        void toBitmap();
+        void shrink();              // back to an array once sparse enough
+    };
+
+    vector<Container> containers;   // ascending key
+
+    Container* find(uint16_t key);
+    const Container* find(uint16_t key) const;
+
+    static Container andContainers(const Container& a, const Container& b);
+    static Container orContainers(const Container& a, const Container& b);
+    static Container andNotContainers(const Container& a, const Container& b);
+    static size_t andCount(const Container& a, const Container& b);
+};
+
+#endif
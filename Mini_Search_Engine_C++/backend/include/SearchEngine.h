@@ -6,15 +6,42 @@
 #include <unordered_map>
 #include <list>     
 #include <mutex>     
+#include <shared_mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
 #include "Trie.h"
+#include "SpellDictionary.h"
+#include "EmbeddingMatrix.h"
+#include "HNSWIndex.h"
+#include "Quantizer.h"
+#include "QueryParser.h"
+#include "RoaringBitmap.h"
+#include "ImpactIndex.h"
+#include "Reranker.h"
+#include "WriteAheadLog.h"
+#include "DocStore.h"
+#include "ResidentCache.h"
+#include "IndexFormat.h"
 
 using namespace std;
 
+// One term in one document. The body keeps positions; the title field (the
+// document's name) only needs a count, so it costs a byte here and the top
+// byte of the frequency word on disk.
 struct Posting {
-    int frequency = 0;
+    int frequency = 0;              // body occurrences
+    uint8_t titleFrequency = 0;     // title occurrences, saturating at 255
     vector<int> positions;
     vector<long long> offsets;
 };
+using PostingMap = unordered_map<int, Posting>;   // by docID
+
+// A document's text, handed to feed in pieces; false if it cannot be read
+using TextSource = function<bool(const function<void(const char*, size_t)>& feed)>;
 
 struct SearchResult {
     string document;
@@ -26,32 +53,203 @@ struct SearchResult {
     string suggestion;
 };
 
+// What one searchAPI call did, for its own response (concurrent searches
+// each get theirs). A cached result reports no work.
+struct SearchStats {
+    bool cached = false;
+    bool impactUsed = false;        // the impact-ordered lexical leg ran
+    ImpactSearchStats impact;
+    RerankStats rerank;             // applied: the second-phase model ran
+};
+
+// One window of a document's tokens, scored on its own (see passagesAPI)
+struct PassageResult {
+    string document;
+    int passage = 0;                  // window index within the document
+    int firstToken = 0;               // token positions [firstToken, endToken)
+    int endToken = 0;
+    long long begin = 0, end = 0;     // byte range of text in the document
+    double score = 0.0;
+    string text;
+};
+
+// How the lexical (BM25) and semantic (ANN) candidate lists are combined
+enum class FusionMode {
+    Linear,     // lexicalWeight * bm25 + semanticWeight * cosine (original formula)
+    RRF,        // reciprocal rank fusion: sum of weight / (rrfK + rank)
+    MinMax,     // each leg min-max scaled to [0,1], then weighted sum
+    ZScore      // each leg standardized, then weighted sum
+};
+
+struct SearchOptions {
+    FusionMode fusion = FusionMode::Linear;
+    double lexicalWeight = 1.0;
+    double semanticWeight = 10.0;
+    int rrfK = 60;
+    int candidatesPerLeg = 100;     // top-k retrieved by each leg
+
+    // Second-phase term proximity boost on the best BM25 candidates
+    double proximityWeight = 1.0;
+    int proximityDepth = 1000;
+
+    // Most dictionary terms a wildcard / prefix pattern may expand to
+    int maxExpansions = 64;
+
+    // Page-1 bag-of-words queries: lexical top-k from the impact-ordered
+    // index (score-at-a-time, stops early or at the time budget)
+    bool impactOrdered = false;
+    double impactBudgetMs = 5.0;
+
+    // Second phase with a loaded rerank model: at most rerankDepth of the
+    // first-phase results, fewer if recent p99 cost would exceed the budget
+    int rerankDepth = 100;
+    double rerankBudgetMs = 10.0;
+
+    // Default weights for a fusion mode
+    static SearchOptions forMode(FusionMode mode);
+};
+
+// One operand of an executed boolean query plan (see explainQuery)
+struct QueryPlanStep {
+    string node;           // describeQuery() of the operand
+    string strategy;       // postings, gallop, bitmap, merge, skip-filter, ...
+    size_t estimate = 0;   // planner's match estimate
+    size_t matches = 0;    // documents actually matched
+    vector<QueryPlanStep> children;
+};
+
+struct ANNBenchmarkResult {
+    int efSearch = 0;
+    double recallAtK = 0.0;
+    double annLatencyMs = 0.0;         // average per query
+    double bruteForceLatencyMs = 0.0;  // average per query
+};
+
+struct QuantizationBenchmarkResult {
+    string storage;               // "float", "int8", "pq", "+rerank" variants
+    size_t bytesPerVector = 0;
+    size_t totalBytes = 0;
+    double recallAtK = 0.0;
+    double latencyMs = 0.0;       // average per query
+};
+
+
+// Bytes one engine structure keeps in memory (see SearchEngine::memoryReport)
+struct MemoryUsage {
+    string structure;
+    size_t bytes = 0;
+};
+
+
+// Progress of a background index save (see SearchEngine::startSaveIndex)
+struct SaveJobStatus {
+    int id = 0;
+    string state;               // running, done, failed, unknown
+    uint64_t bytesWritten = 0;
+    uint64_t totalBytes = 0;    // estimate while running, exact once done
+    double elapsedMs = 0.0;
+    string error;
+};
+
 
 class SearchEngine {
 public:
+    ~SearchEngine();
+
     // Add document from file path
     void buildIndexSingleThread();
     void addDocument(const string& path);
     int getDocumentCount() const;
     int getVocabularySize() const;
     void scanCorpusFolders();
-    void indexSingleDocument(const string& path);
+    // Logs the upload to the write-ahead log (if open) before indexing it;
+    // false if the log could not make it durable
+    bool indexSingleDocument(const string& path);
 
     // NEW: Add document directly from content
     void addDocumentContent(const string& name, const string& content);
 
     void buildIndex();
+    // scanCorpusFolders and buildIndex as one change, so no save or upload
+    // sees the new document list against the old postings
+    void rebuildIndex();
     void loadSampleDataset();
     void clearIndex();
-    void saveIndex(const string& filepath);
+    void saveIndex(const string& filepath);     // synchronous, atomic replace
     bool loadIndex(const string& filepath);
 
+    // Background save from a snapshot taken now; poll with saveJobStatus.
+    // 0: refused, filepath holds an index that failed to load
+    int startSaveIndex(const string& filepath);
+    SaveJobStatus saveJobStatus(int id);
+
+    // Opens the write-ahead log and replays the uploads and clears the
+    // loaded index does not cover yet. Call after loadIndex.
+    bool openWriteAheadLog(const string& path);
+    WalStats writeAheadLogStats();
+    // Empties the index, the uploaded files and the saved index; logged
+    // first, so a crash halfway still ends with an empty corpus
+    void clearCorpus(const string& indexPath);
+
+    // Bounded-memory mode for the next loadIndex: postings stay in the
+    // segment mappings and only the terms queries touch are decoded, into a
+    // cache of at most bytes; their pages are released from the mapping
+    // again. 0 (the default) decodes every posting at load.
+    void setMemoryBudget(size_t bytes);
+    size_t getMemoryBudget() const;
+    // Keeps a term's decoded postings in the cache regardless of recency
+    void pinTerm(const string& term);
+    ResidentCacheStats postingCacheStats();
+    // Estimated heap bytes per structure, plus the resident pages of the
+    // loaded segment mappings
+    vector<MemoryUsage> memoryReport();
+
+    // How the next loadIndex reads its segments: threads parsing postings
+    // (0 = one per core) and whether to fault each mapping in up front
+    // (MAP_POPULATE) rather than page by page as it is read
+    void setLoadOptions(unsigned threads, bool populate);
 
-    vector<SearchResult> searchAPI(const string& query, int page = 1, int limit = 10);
+
+    vector<SearchResult> searchAPI(const string& query, int page = 1, int limit = 10,
+                                   const SearchOptions& options = SearchOptions(),
+                                   SearchStats* stats = nullptr);
     vector<string> autocompleteAPI(const string& prefix);
 
+    // Best k passages for a query, for retrieval-augmented generation:
+    // documents are split into windows of kPassageTokens tokens starting
+    // every kPassageStride tokens, and windows of the best-matching
+    // documents are scored with BM25 on their own. Overlapping windows of
+    // one document are not returned together.
+    static constexpr int kPassageTokens = 100;
+    static constexpr int kPassageStride = 50;
+    static constexpr int kPassageCandidateDocs = 100;
+    vector<PassageResult> passagesAPI(const string& query, int k = 5);
+
+    // Parsed query, planner estimates and the strategy used per operand, as JSON
+    string explainQuery(const string& query, const SearchOptions& options = SearchOptions());
+
+    // BM25 term-frequency saturation (k1) and length normalization (b);
+    // only the scoring tables are rebuilt, not the index
+    void setBM25Params(double k1, double b);
+    // BM25F field weights (title = the document's name)
+    void setFieldWeights(double body, double title);
+
+    // Second-phase model (see RerankModel for the file format). Without one
+    // the proximity boost is the only second phase.
+    bool loadRerankModel(const string& path, string& error);
+    void clearRerankModel();
+
     double getLastIndexingTime() const;
     int getLastThreadCount() const;
+
+    // Semantic (ANN) retrieval tuning
+    void setANNParams(int M, int efConstruction, int efSearch);
+    vector<ANNBenchmarkResult> benchmarkANN(int k, const vector<int>& efValues, int maxQueries = 200);
+
+    // Semantic memory: float + HNSW, or int8 / PQ codes scored with ADC and
+    // reranked from full-precision rows spilled to disk
+    void setEmbeddingStorage(EmbeddingStorage mode, int pqSubspaces = 0);
+    vector<QuantizationBenchmarkResult> benchmarkQuantization(int k, int maxQueries = 200);
     // Garbage Collection for orphan files
     void cleanupOrphanFiles();
 
@@ -62,11 +260,164 @@ private:
     int lastThreadCount = 0;
     double avgDocLength = 0.0;
 
-    unordered_map<string, unordered_map<int, Posting>> invertedIndex;
+    // A term's heap postings are shared with whoever reads them (a query,
+    // a save) and never changed while shared: a writer copies the list
+    // first (writablePostings). postingsMutex guards the map and every
+    // change to a list; readers hold it only to take their reference.
+    unordered_map<string, shared_ptr<PostingMap>> invertedIndex;
+    mutable shared_mutex postingsMutex;
+    PostingMap& writablePostings(const string& term);
+    // Terms of segments loaded in bounded-memory mode: where their postings
+    // sit in the mappings (one extent per segment holding the term). A term
+    // is either here or in invertedIndex; adding a document to a lazy term
+    // moves it into invertedIndex first.
+    struct PostingExtent {
+        shared_ptr<const char> mapping;
+        const char* data = nullptr;   // first posting, checked at load
+        size_t size = 0;
+        uint32_t count = 0;
+    };
+    unordered_map<string, vector<PostingExtent>> lazyTerms;
+    mutable mutex lazyMutex;          // lazyTerms, against concurrent searches
+    ResidentCache<PostingMap> postingCache;
+
+    // Byte offset of every kPassageStride-th token of a document, then its
+    // length: the interval map from passages to text. Derived from the
+    // text when first needed and cached, as docIDs only change on rebuild.
+    ResidentCache<vector<long long>> passageBoundsCache{8 << 20};
+    shared_ptr<const vector<long long>> passageBounds(int docID);
+    size_t memoryBudget = 0;
+    // Mappings of the segments loaded in bounded-memory mode, for reporting
+    struct MappedSegment {
+        weak_ptr<const char> mapping;
+        size_t size = 0;
+    };
+    vector<MappedSegment> mappedSegments;
+    // Postings of a term wherever they live; null if the term is unknown
+    shared_ptr<const PostingMap> postingsFor(const string& term);
+    static PostingMap decodeExtents(const vector<PostingExtent>& extents);
+    void materializeLazyTerm(const string& term);
+    void clearPostings();                 // heap and lazy
+    // Ascending docIDs per term, kept alongside invertedIndex for intersections
+    unordered_map<string, vector<int>> termDocIDs;
+    // Terms in at least 1/32 of the documents also keep a compressed bitmap,
+    // so boolean filters test membership instead of merging long lists
+    unordered_map<string, RoaringBitmap> denseTermBitmaps;
+    const RoaringBitmap* denseBitmap(const string& term) const;
     // NEW: Store the Semantic Vector for each document
-    unordered_map<int, vector<float>> documentEmbeddings;
+    EmbeddingMatrix documentEmbeddings;           // normalized, docID x dim
+    HNSWIndex annIndex{&documentEmbeddings};      // ANN graph over documentEmbeddings
+
+    EmbeddingStorage embeddingStorage = EmbeddingStorage::Float;
+    int pqSubspaces = 0;             // 0 = dim / 4 (16x smaller than float)
+    int quantizeAfter = 256;         // stay in float until there is enough to train on
+    int rerankFactor = 4;            // quantized leg reranks k' * factor candidates exactly
+    QuantizedEmbeddings quantizedEmbeddings;
+    FullPrecisionFile fullPrecisionVectors;
+    string fullPrecisionPath = "../database/embeddings.f32";
+    string embeddingModel = "nomic-embed-text";  // recorded in the index file
+
+    // A saved index is a manifest naming immutable segment files, each
+    // holding the documents [firstDoc, firstDoc + docCount). Documents only
+    // get appended between clears and rebuilds, so a save writes one new
+    // segment with the documents added since the last one; anything else
+    // bumps indexGeneration and makes the next save a full one.
+    struct SegmentRef {
+        string file;                  // relative to the manifest's directory
+        uint64_t firstDoc = 0;
+        uint64_t docCount = 0;
+    };
+    struct SavedIndex {
+        string path;                  // manifest
+        vector<SegmentRef> segments;
+        uint64_t nextSegmentID = 1;
+        uint64_t generation = 0;      // indexGeneration the segments match
+    };
+    SavedIndex savedIndex;
+    atomic<uint64_t> indexGeneration{0};
+    static constexpr size_t kMaxSegments = 8;   // one more and a save merges them all
+    // A save splits the dictionary into about kLoadRanges term ranges of at
+    // least kMinLoadRangeBytes postings each, the units of a parallel load
+    static constexpr uint64_t kLoadRanges = 64;
+    static constexpr uint64_t kMinLoadRangeBytes = 256 << 10;
+    unsigned loadThreads = 0;
+    bool populateMappings = false;
+
+    // What one save writes (a segment of new documents, then the manifest),
+    // copied so it can be written off-lock
+    struct IndexSnapshot {
+        uint64_t firstDoc = 0;        // documents below this are already saved
+        vector<string> documents;
+        unordered_map<int, int> documentLength;
+        // Shared with the engine: copy-on-write leaves these lists as they
+        // were when the snapshot was taken
+        unordered_map<string, shared_ptr<const PostingMap>> invertedIndex;
+        unordered_map<string, vector<PostingExtent>> lazyTerms;   // copied as stored, full saves only
+        string trie;                  // FlatTrie payload, full saves only
+        string spell;                 // SpellDictionary payload, full saves only
+        string embeddingModel;
+        int dim = 0;
+        size_t stride = 0;
+        vector<unsigned char> flags;
+        vector<float> matrix;         // rows x stride, zero rows where flags is 0
+        string docStore;              // DocStore::serialize of the new documents
+        uint64_t walLsn = 0;          // last write-ahead log record included
+        uint64_t estimatedBytes = 0;
+
+        SegmentRef segment;           // docCount 0: no new documents, manifest only
+        vector<SegmentRef> segments;  // the manifest after this save
+        vector<string> obsolete;      // segment files a full save replaces
+        uint64_t nextSegmentID = 1;
+        uint64_t generation = 0;
+    };
+    shared_ptr<IndexSnapshot> snapshotIndex(const string& filepath);
+    static bool writeSnapshot(const IndexSnapshot& snapshot, const string& filepath,
+                              atomic<uint64_t>* bytesWritten, string& error);
+    void commitSavedIndex(const IndexSnapshot& snapshot, const string& filepath);
+    // A segment file mapped and checked, not yet applied to the engine
+    struct OpenSegment {
+        shared_ptr<const char> mapping;
+        size_t size = 0;
+        IndexFile file;
+        double mapMs = 0, verifyMs = 0;
+    };
+    bool openSegment(const string& path, OpenSegment& opened, string& error);
+    bool loadSegment(const OpenSegment& opened, const SegmentRef& segment, bool zeroCopy, string& error);
+
+    struct SaveJob {
+        SaveJobStatus status;
+        atomic<uint64_t> bytesWritten{0};
+        chrono::steady_clock::time_point started;
+    };
+    mutex saveMutex;
+    map<int, shared_ptr<SaveJob>> saveJobs;
+    int nextSaveJobID = 1;
+    int runningSaveJob = 0;
+    thread saveThread;
+    // An index that exists but failed to load: saving over it, or cutting
+    // the log it depends on, would lose it for good. Cleared by a load
+    // that succeeds or by clearCorpus.
+    string unreadableIndexPath;
+    bool saveRefused(const string& filepath);
+
+    // Uploads and clears since the last save. writeMutex is held by every
+    // path that changes the index (builds, loads, clears, uploads), so a
+    // snapshot never sees one half-applied and its walLsn is exactly what it
+    // contains. Recursive because clears and loads nest inside other changes.
+    WriteAheadLog wal;
+    recursive_mutex writeMutex;
+    uint64_t indexWalLsn = 0;         // walLsn of the loaded index
+    void applyDocument(const string& path, const string& content, const vector<float>& embedding, bool readable);
+    void removeCorpusFiles();
+
+    // Mapping of the last loaded segment, kept alive while documentEmbeddings
+    // borrows its matrix from it (zero-copy load). The document store holds
+    // its own references to the mappings it reads from.
+    shared_ptr<const char> indexMapping;
+    void releaseIndexMapping();
     Trie trie;
-    unordered_map<int, string> documentContents; // New Addition to show snippets 
+    SpellDictionary spellDictionary;  // every term, for query spell correction
+    DocStore docStore; // Compressed document texts to show snippets
     bool usingSample = false;
     bool includeInitialCorpus = false; // new addition for check 
 
@@ -79,16 +430,103 @@ private:
 
     void invalidateCache();  // Helper to clear cache when corpus changes
 
+    // BM25F parameters; the scoring tables are rebuilt lazily after the
+    // corpus, k1 / b or the field weights change
+    double bm25K1 = 1.5;
+    double bm25B = 0.75;
+    double bodyWeight = 1.0;
+    double titleWeight = 2.0;
+
+    // Immutable once built: a query scores against the snapshot it took,
+    // so a rebuild never swaps the tables out from under it
+    struct ScoringTables {
+        double k1 = 1.5;
+        double b = 0.75;
+        double bodyWeight = 1.0;
+        vector<uint8_t> docNorms;              // quantized body length per docID
+        vector<uint8_t> titleNorms;            // quantized title length per docID
+        uint8_t averageDocNorm = 0;            // for docIDs added after the build
+        uint8_t averageTitleNorm = 0;
+        float bodyNormFactor[256] = {};        // weight / (1 - b + b * len / avglen)
+        float titleNormFactor[256] = {};       //   per norm byte, for each field
+        unordered_map<string, float> termIDF;
+
+        double term(int tf, int titleTf, float idf, int docID) const {
+            bool known = docID >= 0 && (size_t)docID < docNorms.size();
+            uint8_t docNorm = known ? docNorms[docID] : averageDocNorm;
+            uint8_t titleNorm = known ? titleNorms[docID] : averageTitleNorm;
+            double weighted = tf * bodyNormFactor[docNorm] + titleTf * titleNormFactor[titleNorm];
+            if (weighted <= 0) return 0.0;
+            return idf * weighted * (k1 + 1.0) / (weighted + k1);
+        }
+    };
+    shared_ptr<const ScoringTables> scoringTables;
+    bool scoringTablesStale = true;
+    mutex scoringMutex;
+    shared_ptr<const ScoringTables> currentScoringTables();
+    double bm25IDF(size_t df) const;
+    double termIDF(const ScoringTables& tables, const string& term, size_t df) const {
+        auto it = tables.termIDF.find(term);
+        return it != tables.termIDF.end() ? it->second : bm25IDF(df);
+    }
+
+    RerankModel rerankModel;
+    RerankBudget rerankBudget;
+    mutex rerankMutex;
+
+    // Impact-ordered secondary index, rebuilt lazily after the corpus
+    // changes. A rebuild swaps in a new index; searches keep the one they
+    // started with, so it is never changed under them.
+    shared_ptr<const ImpactIndex> impactIndex;
+    bool impactIndexStale = true;
+    mutex impactMutex;
+    shared_ptr<const ImpactIndex> currentImpactIndex();
+    shared_ptr<const ImpactIndex> buildImpactIndex();
+
     void indexDocument(int docID, const string& content);
+    bool indexDocumentStream(int docID, const TextSource& text);
+    void rebuildTermDocIDs();
+
+    // Files are read and indexed kIngestWindow bytes at a time, so their
+    // size never has to fit in memory. The document store keeps at most
+    // kMaxStoredText bytes of each; snippets past that read the file.
+    static constexpr size_t kIngestWindow = 1 << 20;
+    static constexpr size_t kMaxStoredText = 8 << 20;
+    static TextSource fileText(const string& path, string* stored);
+    static string storedText(const string& content);
+    string documentSlice(int docID, long long begin, long long end) const;
+
+    struct PhraseHit {
+        int count = 0;          // occurrences of the phrase in the document
+        long long offset = -1;  // byte offset of the first occurrence
+    };
+    unordered_map<int, PhraseHit> matchPhraseDocs(const vector<string>& words);
+
+    // Boolean query planning and evaluation over termDocIDs
+    struct QueryRun {
+        unordered_map<string, unordered_map<int, PhraseHit>> phraseHits;   // by describeQuery()
+    };
+    void expandWildcards(QueryNode& node, int maxExpansions);
+    size_t wildcardNodeBudget = 200000;      // trie nodes visited per pattern
+    double wildcardTimeBudgetMs = 20.0;      // trie walk time per pattern
+    size_t wildcardPostingBudget = 4000000;  // total docIDs across expansions
+    size_t estimateMatches(const QueryNode& node) const;
+    vector<int> evaluateQuery(const QueryNode& node, QueryRun& run, QueryPlanStep* step);
+    const vector<int>* evaluateOperand(const QueryNode& node, QueryRun& run, vector<int>& storage, QueryPlanStep* step);
+    vector<int> allDocIDs() const;
 
     vector<float> getOpenAIEmbedding(const string& text);
-    double cosineSimilarity(const vector<float>& A, const vector<float>& B);
+    void storeEmbedding(int docID, const vector<float>& vec);
+    void maybeQuantizeEmbeddings();
+    void restoreFloatEmbeddings();
+    vector<pair<int, float>> semanticNeighbours(const vector<float>& query, int k);
+    double semanticSimilarity(const vector<float>& unitQuery, int docID) const;
 
 
     // 🔥 NEW: Thread-safe local indexing helper
-    void indexDocumentLocal(
+    bool indexDocumentLocal(
         int docID,
-        const string& content,
+        const TextSource& text,
         unordered_map<string, unordered_map<int, Posting>>& localIndex,
         unordered_map<int, int>& localDocLength
     );       
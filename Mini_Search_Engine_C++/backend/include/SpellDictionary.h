@@ -0,0 +1,65 @@
+#ifndef SPELL_DICTIONARY_H
+#define SPELL_DICTIONARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+int editDistance(const string& a, const string& b);
+
+// Vocabulary for spell correction, bucketed by length: edit distance is at
+// least the length difference, so a lookup scans the buckets nearest the
+// word's length and stops once they cannot beat the best match. A dictionary
+// loaded from an index is used in place; terms added afterwards are kept
+// next to it.
+//
+// Section payload (little-endian), terms sorted by length, then bytes:
+//   u32 term count T, u32 longest length L
+//   u32 lengthStart[L + 2]   terms of length l are [lengthStart[l], lengthStart[l + 1])
+//   u32 offset[T + 1]        term i is bytes [offset[i], offset[i + 1])
+//   bytes
+class SpellDictionary {
+public:
+    // Movable only: the arrays may point into copied
+    SpellDictionary() = default;
+    SpellDictionary(SpellDictionary&&) = default;
+    SpellDictionary& operator=(SpellDictionary&&) = default;
+    SpellDictionary(const SpellDictionary&) = delete;
+    SpellDictionary& operator=(const SpellDictionary&) = delete;
+
+    void clear();
+    void add(const string& term);          // no-op if already present
+    bool contains(const string& term) const;
+    size_t size() const;
+
+    // Closest term by edit distance, ties going to the higher df; the word
+    // itself if the dictionary is empty
+    string correct(const string& word, const function<size_t(const string&)>& df) const;
+
+    string serialize() const;
+    // Checks the arrays once (no per-term work beyond that); owner keeps
+    // the mapping alive. Leaves the dictionary unchanged on failure.
+    bool attach(const char* data, size_t size, shared_ptr<const char> owner, string& error);
+
+private:
+    shared_ptr<const char> owner;
+    vector<uint32_t> copied;               // arrays decoded on a big-endian host
+    uint32_t termCount = 0;
+    uint32_t longest = 0;
+    const uint32_t* lengthStart = nullptr;
+    const uint32_t* offsets = nullptr;
+    const char* bytes = nullptr;
+
+    vector<vector<string>> added;          // by length
+    unordered_set<string> addedTerms;
+
+    string baseTerm(uint32_t i) const { return string(bytes + offsets[i], offsets[i + 1] - offsets[i]); }
+};
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef TRIE_H
 #define TRIE_H
 
+#include <cstdint>
+#include <memory>
 #include <unordered_map>
 #include <string>
 #include <vector>
@@ -15,15 +17,78 @@ public:
     TrieNode() : isEnd(false) {}
 };
 
+// Read-only trie in flat arrays, used in place from an index mapping.
+// Payload (little-endian), nodes in preorder, node 0 the root:
+//   u32 node count N, u32 edge count E
+//   u32 firstEdge[N + 1]   node i's edges are [firstEdge[i], firstEdge[i + 1])
+//   u32 child[E]           target node of each edge, greater than its parent
+//   u8  label[E]           edge characters, ascending within a node
+//   u8  isEnd[N]
+// attach() checks the structure (one pass over the arrays, no per-word
+// work), so walks never leave the arrays or loop.
+class FlatTrie {
+public:
+    static constexpr uint32_t kNone = 0xFFFFFFFF;
+
+    // Movable only: the arrays may point into copied
+    FlatTrie() = default;
+    FlatTrie(FlatTrie&&) = default;
+    FlatTrie& operator=(FlatTrie&&) = default;
+    FlatTrie(const FlatTrie&) = delete;
+    FlatTrie& operator=(const FlatTrie&) = delete;
+
+    // Sorted, duplicate-free words
+    static string build(const vector<string>& words);
+    bool attach(const char* data, size_t size, shared_ptr<const char> owner);
+
+    bool empty() const { return nodes == 0; }
+    uint32_t nodeCount() const { return nodes; }
+    uint32_t root() const { return nodes ? 0 : kNone; }
+    uint32_t find(const string& prefix) const;    // node reached, or kNone
+    bool contains(const string& word) const;
+
+    uint32_t edgeBegin(uint32_t node) const { return firstEdge[node]; }
+    uint32_t edgeEnd(uint32_t node) const { return firstEdge[node + 1]; }
+    uint32_t child(uint32_t edge) const { return children[edge]; }
+    char label(uint32_t edge) const { return labels[edge]; }
+    bool isEnd(uint32_t node) const { return ends[node] != 0; }
+
+private:
+    shared_ptr<const char> owner;
+    vector<uint32_t> copied;          // decoded arrays on a big-endian host
+    uint32_t nodes = 0;
+    const uint32_t* firstEdge = nullptr;
+    const uint32_t* children = nullptr;
+    const char* labels = nullptr;
+    const unsigned char* ends = nullptr;
+};
+
+// Words for autocomplete and wildcard expansion. A trie loaded from an index
+// stays in its flat form; words inserted afterwards go into a node trie on
+// top of it.
 class Trie {
 public:
     Trie();
     void insert(const string& word);
     vector<string> autocomplete(const string& prefix);
 
+    // Words matching a pattern where '*' is any run of characters and '?'
+    // exactly one. Gives up after visiting maxNodes trie nodes or after
+    // maxMillis; truncated reports whether the walk was cut short.
+    vector<string> match(const string& pattern, size_t maxNodes, double maxMillis, bool& truncated);
+
+    // Every word, flat and inserted, as a FlatTrie payload for the index
+    // file. attach() uses one in place (owner keeps the mapping alive) and
+    // drops the inserted words; it fails on malformed input and leaves the
+    // trie unchanged.
+    string serialize() const;
+    bool attach(const char* data, size_t size, shared_ptr<const char> owner);
+
 private:
+    FlatTrie base;
     TrieNode* root;
-    void dfs(TrieNode* node, string current, vector<string>& results);
+    void dfs(TrieNode* node, string current, vector<string>& results) const;
+    void flatDfs(uint32_t node, string& current, vector<string>& results) const;
 };
 
 #endif
@@ -0,0 +1,29 @@
+#ifndef VECTOR_KERNELS_H
+#define VECTOR_KERNELS_H
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// Float dot-product kernels. The widest implementation the CPU supports
+// (AVX2+FMA on x86-64, NEON on arm64, scalar otherwise) is picked once at
+// runtime, so the binary does not need to be built with -mavx2.
+
+float dotProduct(const float* a, const float* b, size_t dim);
+
+// Scores one query against `rows` consecutive matrix rows spaced `stride`
+// floats apart: out[r] = dot(query, matrix + r * stride).
+void dotProductBatch(const float* query, const float* matrix, size_t stride,
+                     size_t rows, size_t dim, float* out);
+
+// Portable reference implementation (also used as the benchmark baseline).
+float dotProductScalar(const float* a, const float* b, size_t dim);
+
+// Name of the kernel selected by the dispatcher ("avx2-fma", "neon", "scalar").
+const char* activeDotKernel();
+
+// Scales vec to unit length in place; returns false for a zero vector.
+bool normalizeVector(vector<float>& vec);
+
+#endif
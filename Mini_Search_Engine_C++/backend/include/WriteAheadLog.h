@@ -0,0 +1,91 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum class WalOp : uint8_t {
+    AddDocument = 1,    // path, content and embedding of one upload
+    ClearCorpus = 2     // every document (and the saved index) removed
+};
+
+struct WalRecord {
+    WalOp op = WalOp::AddDocument;
+    uint64_t lsn = 0;
+    string path;
+    string content;
+    vector<float> embedding;   // empty if the document was not embedded
+};
+
+struct WalStats {
+    uint64_t records = 0;      // appended since open
+    uint64_t syncs = 0;        // fsyncs issued for them (group commit)
+    uint64_t bytes = 0;        // current log size
+    uint64_t lastLsn = 0;
+    uint64_t durableLsn = 0;
+};
+
+// Append-only log of corpus changes, replayed on top of the last saved
+// index at startup. Each record is
+//   u32 payload length, u32 CRC32C of the payload, payload
+//   payload: u8 op, u64 lsn, then for AddDocument: u32 + path,
+//            u64 + content, u32 dim + dim f32 (little-endian)
+// A torn or corrupt tail (crash mid-append) is cut off when the log is opened.
+//
+// append() only writes; sync() makes a record durable. Concurrent callers
+// of sync() share fsyncs: one of them syncs everything written so far while
+// the others wait for it.
+class WriteAheadLog {
+public:
+    ~WriteAheadLog();
+
+    // LSNs continue after both the log's last record and minLsn (the LSN a
+    // loaded index already covers, in case the log was compacted since)
+    bool open(const string& path, uint64_t minLsn, string& error);
+    void close();
+    bool isOpen() const { return opened.load(); }
+
+    uint64_t append(WalRecord record);   // returns the LSN, 0 on failure
+    bool sync(uint64_t lsn);             // true once lsn is on disk
+
+    // Calls apply for every record with lsn > after, in order
+    bool replay(uint64_t after, const function<void(const WalRecord&)>& apply, string& error);
+
+    // Drops records with lsn <= lsn once a saved index covers them
+    bool truncateThrough(uint64_t lsn);
+
+    uint64_t lastLsn();
+    WalStats stats();
+
+private:
+    string path;
+    int fd = -1;
+    atomic<bool> opened{false};
+    uint64_t size = 0;
+    uint64_t nextLsn = 1;
+    uint64_t writtenLsn = 0;
+    uint64_t durableLsn = 0;
+    bool syncing = false;
+    WalStats counters;
+
+    mutex lock;
+    condition_variable synced;
+    mutex compactMutex;        // one truncateThrough at a time
+
+    static string encode(const WalRecord& record);
+    static bool decode(const char* data, size_t size, WalRecord& record);
+
+    // Reads whole records from fd; stops at the first torn or corrupt one
+    bool scan(const function<void(const WalRecord&, uint64_t end)>& visit);
+    uint64_t firstRecordAfter(uint64_t lsn, uint64_t end);
+};
+
+#endif
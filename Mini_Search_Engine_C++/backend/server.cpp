@@ -1,5 +1,8 @@
+#define CPPHTTPLIB_OPENSSL_SUPPORT // must match SearchEngine.cpp, both TUs share httplib.h
+
 #include "httplib.h"
 #include "SearchEngine.h"
+#include "json.hpp" // nlohmann/json
 #include <iostream>
 #include <fstream>
 #include <chrono>   
@@ -74,25 +77,47 @@ int main() {
     fs::create_directory("../runtime_corpus");
     fs::create_directory("../database");
 
+    // Bounded-memory mode: MSE_MEMORY_BUDGET_MB caps the decoded postings
+    // kept in memory; the rest stays in the index files (unset = load all)
+    if (const char* budget = getenv("MSE_MEMORY_BUDGET_MB")) {
+        size_t mb = strtoull(budget, nullptr, 10);
+        engine.setMemoryBudget(mb << 20);
+        if (mb > 0) cout << "Memory budget for postings: " << mb << " MB" << endl;
+    }
+
+    // MSE_LOAD_THREADS: threads decoding postings at load (unset = one per
+    // core); MSE_MAP_POPULATE=1 faults each index file in when it is mapped
+    const char* loadThreads = getenv("MSE_LOAD_THREADS");
+    const char* populate = getenv("MSE_MAP_POPULATE");
+    engine.setLoadOptions(loadThreads ? strtoul(loadThreads, nullptr, 10) : 0,
+                          populate && string(populate) == "1");
+
+    // MSE_MODELS_DIR: the only directory /reranker loads models from
+    const char* modelsEnv = getenv("MSE_MODELS_DIR");
+    fs::path modelsDir = modelsEnv ? modelsEnv : "../models";
+
     // STEP 2: Try to load the index from the database folder
     string indexPath = "../database/search_index.bin";
     
+    bool indexUnreadable = false;
     if (fs::exists(indexPath)) {
         cout << "Found existing index. Loading via mmap..." << endl;
-        engine.loadIndex(indexPath);
-        
-        // NEW: Delete any files that were uploaded but never saved!
-        engine.cleanupOrphanFiles(); 
-        
+        indexUnreadable = !engine.loadIndex(indexPath);
     } else {
         cout << "No existing index found. Starting fresh." << endl;
-        
-        // NEW: If there is no index at all, everything in runtime_corpus is an orphan. Wipe it!
-        for (const auto& entry : fs::directory_iterator("../runtime_corpus")) {
-            if (entry.is_regular_file()) {
-                fs::remove(entry.path());
-            }
-        }
+    }
+
+    // Uploads acknowledged since the last save are replayed from the log
+    engine.openWriteAheadLog("../database/uploads.wal");
+
+    // NEW: Delete any files that were uploaded but are neither saved nor logged
+    // (with no index at all, that is everything not replayed from the log).
+    // An index that is there but failed to load still owns its files.
+    if (indexUnreadable) {
+        cerr << "WARNING: " << indexPath << " exists but could not be loaded; keeping every file in "
+             << "runtime_corpus and refusing /saveIndex until it is fixed or cleared (/clearCorpus)." << endl;
+    } else {
+        engine.cleanupOrphanFiles();
     }
 
 
@@ -171,8 +196,11 @@ int main() {
             fileToIndex = txtPath;
         }
 
-        // Send the correct file to the engine
-        engine.indexSingleDocument(fileToIndex);
+        // Send the correct file to the engine; it is durable once logged
+        if (!engine.indexSingleDocument(fileToIndex)) {
+            res.set_content("File indexed, but it could not be logged: save the index to keep it", "text/plain");
+            return;
+        }
 
         res.set_content("File uploaded and indexed successfully!", "text/plain");
     });
@@ -211,10 +239,48 @@ int main() {
         int page = req.has_param("page") ? stoi(req.get_param_value("page")) : 1;
         int limit = req.has_param("limit") ? stoi(req.get_param_value("limit")) : 10;
 
+        // Hybrid fusion: ?fusion=linear|rrf|minmax|zscore plus optional weights
+        FusionMode mode = FusionMode::Linear;
+        if (req.has_param("fusion")) {
+            string fusion = req.get_param_value("fusion");
+            if (fusion == "rrf") mode = FusionMode::RRF;
+            else if (fusion == "minmax") mode = FusionMode::MinMax;
+            else if (fusion == "zscore") mode = FusionMode::ZScore;
+        }
+
+        SearchOptions options = SearchOptions::forMode(mode);
+        if (req.has_param("lexical_weight"))
+            options.lexicalWeight = stod(req.get_param_value("lexical_weight"));
+        if (req.has_param("semantic_weight"))
+            options.semanticWeight = stod(req.get_param_value("semantic_weight"));
+        if (req.has_param("rrf_k"))
+            options.rrfK = stoi(req.get_param_value("rrf_k"));
+        if (req.has_param("candidates"))
+            options.candidatesPerLeg = stoi(req.get_param_value("candidates"));
+        if (req.has_param("proximity_weight"))
+            options.proximityWeight = stod(req.get_param_value("proximity_weight"));
+        if (req.has_param("max_expansions"))
+            options.maxExpansions = stoi(req.get_param_value("max_expansions"));
+        if (req.has_param("impact"))
+            options.impactOrdered = req.get_param_value("impact") == "1";
+        if (req.has_param("budget_ms"))
+            options.impactBudgetMs = stod(req.get_param_value("budget_ms"));
+        if (req.has_param("rerank_depth"))
+            options.rerankDepth = stoi(req.get_param_value("rerank_depth"));
+        if (req.has_param("rerank_budget_ms"))
+            options.rerankBudgetMs = stod(req.get_param_value("rerank_budget_ms"));
+        // RRF adds rank + 1 to k, so k must keep every denominator positive
+        if (options.rrfK < 1 || options.candidatesPerLeg < 0 || options.rerankDepth < 0) {
+            res.status = 400;
+            res.set_content("rrf_k must be >= 1, candidates and rerank_depth >= 0", "text/plain");
+            return;
+        }
+
         // Start timer
         auto start = std::chrono::high_resolution_clock::now();
 
-        auto results = engine.searchAPI(q, page, limit);
+        SearchStats stats;
+        auto results = engine.searchAPI(q, page, limit, options, &stats);
 
         // End timer
         auto end = std::chrono::high_resolution_clock::now();
@@ -228,12 +294,73 @@ int main() {
         // Inject latency into JSON
         string finalJson = "{";
         finalJson += "\"latency_ms\":" + to_string(latency) + ",";
+
+        // ?explain=1 adds the parsed query and its executed plan
+        if (req.has_param("explain") && req.get_param_value("explain") == "1")
+            finalJson += "\"explain\":" + engine.explainQuery(q, options) + ",";
+
+        if (stats.cached) finalJson += "\"cached\":true,";
+        if (stats.impactUsed) {
+            const ImpactSearchStats& impact = stats.impact;
+            finalJson += "\"impact\":{\"postings_scored\":" + to_string(impact.postingsScored) +
+                ",\"segments_scored\":" + to_string(impact.segmentsScored) +
+                ",\"segments_total\":" + to_string(impact.segmentsTotal) +
+                ",\"early_terminated\":" + (impact.earlyTerminated ? "true" : "false") +
+                ",\"budget_exhausted\":" + (impact.budgetExhausted ? "true" : "false") +
+                ",\"elapsed_ms\":" + to_string(impact.elapsedMs) + "},";
+        }
+
+        const RerankStats& rerank = stats.rerank;
+        if (rerank.applied) {
+            finalJson += "\"rerank\":{\"model\":\"" + escapeJson(rerank.model) + "\"" +
+                ",\"candidates\":" + to_string(rerank.candidates) +
+                ",\"depth_limit\":" + to_string(rerank.depthLimit) +
+                ",\"feature_ms\":" + to_string(rerank.featureMs) +
+                ",\"model_ms\":" + to_string(rerank.modelMs) +
+                ",\"elapsed_ms\":" + to_string(rerank.elapsedMs) + "},";
+        }
+
         finalJson += resultsJson.substr(1); // remove first '{'
 
         res.set_header("Access-Control-Allow-Origin", "*");
         res.set_content(finalJson, "application/json");
     });
 
+
+    // -------- Passages Endpoint --------
+    // Best k passages (windows of a document's tokens) with their text, as
+    // context for the chat middleware: ?q=...&k=5
+    server.Get("/passages", [&](const httplib::Request& req, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        if (!req.has_param("q")) {
+            res.status = 400;
+            res.set_content("Missing query", "text/plain");
+            return;
+        }
+        int k = req.has_param("k") ? stoi(req.get_param_value("k")) : 5;
+        k = max(1, min(k, 50));
+
+        auto start = std::chrono::high_resolution_clock::now();
+        vector<PassageResult> passages = engine.passagesAPI(req.get_param_value("q"), k);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        string json = "{\"latency_ms\":" + to_string(std::chrono::duration<double, std::milli>(end - start).count()) +
+                      ",\"passages\":[";
+        for (size_t i = 0; i < passages.size(); i++) {
+            const PassageResult& p = passages[i];
+            if (i > 0) json += ",";
+            json += "{\"document\":\"" + escapeJson(p.document) + "\"";
+            json += ",\"passage\":" + to_string(p.passage);
+            json += ",\"tokens\":[" + to_string(p.firstToken) + "," + to_string(p.endToken) + "]";
+            json += ",\"bytes\":[" + to_string(p.begin) + "," + to_string(p.end) + "]";
+            json += ",\"score\":" + to_string(p.score);
+            json += ",\"text\":\"" + escapeJson(p.text) + "\"}";
+        }
+        json += "]}";
+        res.set_content(json, "application/json");
+    });
+
     
     // -------- Autocomplete Endpoint --------
     server.Get("/autocomplete", [&](const httplib::Request& req,
@@ -279,23 +406,9 @@ int main() {
     // -------- Clear Corpus --------
     server.Post("/clearCorpus", [&](const httplib::Request& req, httplib::Response& res) {
 
-        namespace fs = std::filesystem;
-
-        // 1. Clear the live in-memory index
-        engine.clearIndex();
-
-        // 2. Delete all raw uploaded files (The Bookshelf)
-        for (const auto& entry : fs::directory_iterator("../runtime_corpus")) {
-            if (entry.is_regular_file()) {
-                fs::remove(entry.path());
-            }
-        }
-
-        // 3. NEW: Delete the binary index file on disk (The Card Catalog)
-        string indexPath = "../database/search_index.bin";
-        if (fs::exists(indexPath)) {
-            fs::remove(indexPath);
-        }
+        // Clears the live index, the uploaded files (The Bookshelf) and the
+        // binary index file on disk (The Card Catalog), logged first
+        engine.clearCorpus("../database/search_index.bin");
 
         res.set_header("Access-Control-Allow-Origin", "*");
         res.set_content("Corpus and Index cleared successfully", "text/plain");
@@ -308,8 +421,7 @@ int main() {
     server.Post("/rebuildIndex", [&](const httplib::Request& req,
                                     httplib::Response& res) {
 
-        engine.scanCorpusFolders();   // refresh document list based on mode
-        engine.buildIndex();          // rebuild index structures
+        engine.rebuildIndex();        // refresh document list, rebuild index structures
 
         string json = "{";
         json += "\"indexing_time_ms\":" +
@@ -394,14 +506,241 @@ int main() {
 
 
 
+    // -------- ANN Recall Benchmark --------
+    server.Get("/benchmarkANN", [&](const httplib::Request& req,
+                                httplib::Response& res) {
+
+        int k = req.has_param("k") ? stoi(req.get_param_value("k")) : 10;
+        vector<int> efValues = {16, 32, 64, 128, 256};
+
+        auto report = engine.benchmarkANN(k, efValues);
+
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        if (report.empty()) {
+            res.set_content("No document embeddings to benchmark", "text/plain");
+            return;
+        }
+
+        string json = "{ \"k\":" + to_string(k) + ", \"runs\": [";
+        for (size_t i = 0; i < report.size(); i++) {
+            const auto& r = report[i];
+            json += "{";
+            json += "\"ef_search\":" + to_string(r.efSearch) + ",";
+            json += "\"recall_at_k\":" + to_string(r.recallAtK) + ",";
+            json += "\"ann_latency_ms\":" + to_string(r.annLatencyMs) + ",";
+            json += "\"brute_force_latency_ms\":" + to_string(r.bruteForceLatencyMs);
+            json += "}";
+            if (i + 1 < report.size()) json += ",";
+        }
+        json += "] }";
+
+        res.set_content(json, "application/json");
+    });
+
+
+
+    // -------- Embedding Storage Mode --------
+    server.Post("/embeddingStorage", [&](const httplib::Request& req,
+                                     httplib::Response& res) {
+
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        string mode = req.has_param("mode") ? req.get_param_value("mode") : "float";
+        int subspaces = req.has_param("subspaces") ? stoi(req.get_param_value("subspaces")) : 0;
+
+        if (mode == "float") engine.setEmbeddingStorage(EmbeddingStorage::Float);
+        else if (mode == "int8") engine.setEmbeddingStorage(EmbeddingStorage::Int8);
+        else if (mode == "pq") engine.setEmbeddingStorage(EmbeddingStorage::PQ, subspaces);
+        else {
+            res.set_content("Unknown mode (use float, int8 or pq)", "text/plain");
+            return;
+        }
+
+        res.set_content("Embedding storage set to " + mode, "text/plain");
+    });
+
+
+    // -------- Rerank Model --------
+    // ?path=model.txt loads a linear / gbdt model from the models
+    // directory, ?clear=1 removes it
+    server.Post("/reranker", [&](const httplib::Request& req,
+                             httplib::Response& res) {
+
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        if (req.has_param("clear") && req.get_param_value("clear") == "1") {
+            engine.clearRerankModel();
+            res.set_content("Rerank model cleared", "text/plain");
+            return;
+        }
+        if (!req.has_param("path")) {
+            res.set_content("Missing path", "text/plain");
+            return;
+        }
+
+        // A relative path that stays inside the models directory
+        fs::path model = fs::path(req.get_param_value("path")).lexically_normal();
+        bool outside = model.empty() || model.is_absolute();
+        for (const fs::path& part : model) outside = outside || part == "..";
+        if (outside) {
+            res.status = 400;
+            res.set_content("path must name a file inside the models directory", "text/plain");
+            return;
+        }
+
+        string error;
+        if (!engine.loadRerankModel((modelsDir / model).string(), error)) {
+            res.set_content("Failed to load rerank model: " + error, "text/plain");
+            return;
+        }
+        res.set_content("Rerank model loaded", "text/plain");
+    });
+
+
+    // -------- BM25 Parameters --------
+    server.Post("/bm25Params", [&](const httplib::Request& req,
+                               httplib::Response& res) {
+
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        double k1 = req.has_param("k1") ? stod(req.get_param_value("k1")) : 1.5;
+        double b = req.has_param("b") ? stod(req.get_param_value("b")) : 0.75;
+        double body = req.has_param("body_weight") ? stod(req.get_param_value("body_weight")) : 1.0;
+        double title = req.has_param("title_weight") ? stod(req.get_param_value("title_weight")) : 2.0;
+        if (k1 < 0 || b < 0 || b > 1 || body < 0 || title < 0) {
+            res.set_content("k1 and field weights must be >= 0, b in [0, 1]", "text/plain");
+            return;
+        }
+
+        engine.setBM25Params(k1, b);
+        engine.setFieldWeights(body, title);
+        res.set_content("BM25F k1=" + to_string(k1) + " b=" + to_string(b) +
+                        " body_weight=" + to_string(body) + " title_weight=" + to_string(title), "text/plain");
+    });
+
+
+    // -------- Quantization Recall / Memory Benchmark --------
+    server.Get("/benchmarkQuantization", [&](const httplib::Request& req,
+                                         httplib::Response& res) {
+
+        int k = req.has_param("k") ? stoi(req.get_param_value("k")) : 10;
+
+        auto report = engine.benchmarkQuantization(k);
+
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        if (report.empty()) {
+            res.set_content("No document embeddings to benchmark", "text/plain");
+            return;
+        }
+
+        string json = "{ \"k\":" + to_string(k) + ", \"runs\": [";
+        for (size_t i = 0; i < report.size(); i++) {
+            const auto& r = report[i];
+            json += "{";
+            json += "\"storage\":\"" + r.storage + "\",";
+            json += "\"bytes_per_vector\":" + to_string(r.bytesPerVector) + ",";
+            json += "\"total_bytes\":" + to_string(r.totalBytes) + ",";
+            json += "\"recall_at_k\":" + to_string(r.recallAtK) + ",";
+            json += "\"latency_ms\":" + to_string(r.latencyMs);
+            json += "}";
+            if (i + 1 < report.size()) json += ",";
+        }
+        json += "] }";
+
+        res.set_content(json, "application/json");
+    });
+
+
+
     // -------- Save Index Endpoint --------
+    // Starts a background save and returns its job; poll /saveIndex/status?id=
     server.Post("/saveIndex", [&](const httplib::Request& req, httplib::Response& res) {
         // NEW: Save to the dedicated database folder
-        engine.saveIndex("../database/search_index.bin");
+        int job = engine.startSaveIndex("../database/search_index.bin");
         res.set_header("Access-Control-Allow-Origin", "*");
-        res.set_content("Index successfully saved to disk!", "text/plain");
+        if (!job) {
+            res.status = 409;
+            res.set_content("The saved index exists but could not be loaded; saving would overwrite it",
+                            "text/plain");
+            return;
+        }
+        res.set_content("{\"job_id\":" + to_string(job) + "}", "application/json");
     });
 
+    server.Get("/saveIndex/status", [&](const httplib::Request& req, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        int id = req.has_param("id") ? stoi(req.get_param_value("id")) : 0;
+        SaveJobStatus status = engine.saveJobStatus(id);
+        double progress = status.state == "done" ? 1.0
+            : status.totalBytes ? min(0.99, (double)status.bytesWritten / status.totalBytes) : 0.0;
+
+        nlohmann::json body = {
+            {"job_id", status.id},
+            {"state", status.state},
+            {"progress", progress},
+            {"bytes_written", status.bytesWritten},
+            {"total_bytes", status.totalBytes},
+            {"elapsed_ms", status.elapsedMs},
+        };
+        if (!status.error.empty()) body["error"] = status.error;
+        res.set_content(body.dump(), "application/json");
+    });
+
+    // Write-ahead log: records appended vs fsyncs shows how well group commit batches
+    server.Get("/wal/status", [&](const httplib::Request& req, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        WalStats stats = engine.writeAheadLogStats();
+        string json = "{";
+        json += "\"records\":" + to_string(stats.records) + ",";
+        json += "\"syncs\":" + to_string(stats.syncs) + ",";
+        json += "\"bytes\":" + to_string(stats.bytes) + ",";
+        json += "\"last_lsn\":" + to_string(stats.lastLsn) + ",";
+        json += "\"durable_lsn\":" + to_string(stats.durableLsn);
+        json += "}";
+        res.set_content(json, "application/json");
+    });
+
+
+    // Resident bytes per structure and the posting cache of bounded-memory mode
+    server.Get("/memory", [&](const httplib::Request& req, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        ResidentCacheStats cache = engine.postingCacheStats();
+        string json = "{\"budget\":" + to_string(engine.getMemoryBudget()) + ",\"structures\":{";
+        bool first = true;
+        for (const MemoryUsage& usage : engine.memoryReport()) {
+            if (!first) json += ",";
+            json += "\"" + usage.structure + "\":" + to_string(usage.bytes);
+            first = false;
+        }
+        json += "},\"posting_cache\":{";
+        json += "\"entries\":" + to_string(cache.entries) + ",";
+        json += "\"resident_bytes\":" + to_string(cache.residentBytes) + ",";
+        json += "\"pinned_entries\":" + to_string(cache.pinnedEntries) + ",";
+        json += "\"pinned_bytes\":" + to_string(cache.pinnedBytes) + ",";
+        json += "\"hits\":" + to_string(cache.hits) + ",";
+        json += "\"misses\":" + to_string(cache.misses) + ",";
+        json += "\"evictions\":" + to_string(cache.evictions);
+        json += "}}";
+        res.set_content(json, "application/json");
+    });
+
+    // Keeps a term's postings resident in bounded-memory mode
+    server.Post("/memory/pin", [&](const httplib::Request& req, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        if (!req.has_param("term")) {
+            res.status = 400;
+            res.set_content("Missing term", "text/plain");
+            return;
+        }
+        engine.pinTerm(req.get_param_value("term"));
+        res.set_content("Pinned", "text/plain");
+    });
 
     cout << "Dynamic Search Engine running at http://localhost:8080\n";
     server.listen("localhost", 8080);
@@ -0,0 +1,453 @@
+#include "DocStore.h"
+#include "IndexFormat.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+using namespace std;
+
+static constexpr size_t kMinMatch = 4;
+static constexpr size_t kMaxOffset = 65535;
+static constexpr int kHashBits = 14;
+
+
+// ---------------- LZ CODEC ----------------
+namespace {
+
+uint32_t read32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+void putLength(string& out, size_t n) {
+    while (n >= 255) {
+        out.push_back((char)255);
+        n -= 255;
+    }
+    out.push_back((char)n);
+}
+
+void emitSequence(string& out, const char* literals, size_t literalCount, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - kMinMatch : 0;
+    out.push_back((char)((min(literalCount, (size_t)15) << 4) | min(matchCode, (size_t)15)));
+    if (literalCount >= 15) putLength(out, literalCount - 15);
+    out.append(literals, literalCount);
+    if (!matchLength) return;
+
+    out.push_back((char)(offset & 0xFF));
+    out.push_back((char)(offset >> 8));
+    if (matchCode >= 15) putLength(out, matchCode - 15);
+}
+
+bool getLength(const unsigned char*& in, const unsigned char* end, size_t& n) {
+    unsigned char b;
+    do {
+        if (in == end) return false;
+        b = *in++;
+        n += b;
+    } while (b == 255);
+    return true;
+}
+
+}
+
+string lzCompress(const char* data, size_t size) {
+    string out;
+    out.reserve(size / 2 + 16);
+
+    // Greedy parse: the last position seen for each 4-byte hash is the
+    // only match candidate
+    vector<uint32_t> table(1 << kHashBits, UINT32_MAX);
+    size_t anchor = 0, i = 0;
+
+    while (i + kMinMatch <= size) {
+        uint32_t sequence = read32(data + i);
+        uint32_t h = (sequence * 2654435761u) >> (32 - kHashBits);
+        uint32_t candidate = table[h];
+        table[h] = i;
+
+        if (candidate == UINT32_MAX || i - candidate > kMaxOffset || read32(data + candidate) != sequence) {
+            i++;
+            continue;
+        }
+
+        size_t length = kMinMatch;
+        while (i + length < size && data[candidate + length] == data[i + length]) length++;
+
+        emitSequence(out, data + anchor, i - anchor, i - candidate, length);
+        i += length;
+        anchor = i;
+    }
+
+    emitSequence(out, data + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+bool lzDecompress(const char* data, size_t size, char* out, size_t rawSize) {
+    const unsigned char* in = (const unsigned char*)data;
+    const unsigned char* end = in + size;
+    size_t produced = 0;
+
+    while (in < end) {
+        unsigned char token = *in++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !getLength(in, end, literals)) return false;
+        if (literals > (size_t)(end - in) || literals > rawSize - produced) return false;
+        memcpy(out + produced, in, literals);
+        in += literals;
+        produced += literals;
+
+        if (in == end) break;   // last sequence: literals only
+
+        if (end - in < 2) return false;
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15 && !getLength(in, end, length)) return false;
+        length += kMinMatch;
+
+        if (offset == 0 || offset > produced || length > rawSize - produced) return false;
+        // Byte by byte: the match may overlap what it is copying
+        const char* from = out + produced - offset;
+        for (size_t k = 0; k < length; k++) out[produced + k] = from[k];
+        produced += length;
+    }
+    return produced == rawSize;
+}
+
+
+// ---------------- STORE ----------------
+void DocStore::clear() {
+    lock_guard<mutex> guard(lock);
+    blocks.clear();
+    locations.clear();
+    open.clear();
+    openMinDoc = 0;
+    openMaxDoc = -1;
+    cache.clear();
+}
+
+void DocStore::add(int docID, const string& text) {
+    lock_guard<mutex> guard(lock);
+    if (docID < 0) return;
+
+    // A text that fits in a block is kept in one; a larger one starts in
+    // the open block and fills as many blocks after it as it needs
+    if (!open.empty() && text.size() <= kBlockSize && open.size() + text.size() > kBlockSize) seal();
+
+    if ((size_t)docID >= locations.size()) locations.resize(docID + 1);
+    locations[docID] = {(uint32_t)blocks.size(), (uint32_t)open.size(), (uint32_t)text.size()};
+
+    size_t at = 0;
+    do {
+        size_t n = min(text.size() - at, kBlockSize - open.size());
+        open.append(text, at, n);
+        at += n;
+
+        if (openMaxDoc < openMinDoc) openMinDoc = openMaxDoc = docID;
+        openMinDoc = min(openMinDoc, docID);
+        openMaxDoc = max(openMaxDoc, docID);
+
+        if (open.size() >= kBlockSize) seal();
+    } while (at < text.size());
+}
+
+void DocStore::seal() {
+    if (open.empty()) return;
+
+    auto compressed = make_shared<string>(lzCompress(open.data(), open.size()));
+    Block block;
+    block.owner = shared_ptr<const char>(compressed, compressed->data());
+    block.data = compressed->data();
+    block.compressedSize = compressed->size();
+    block.rawSize = open.size();
+    block.minDoc = openMinDoc;
+    block.maxDoc = openMaxDoc;
+    blocks.push_back(block);
+
+    open.clear();
+    open.shrink_to_fit();
+    openMinDoc = 0;
+    openMaxDoc = -1;
+}
+
+shared_ptr<const string> DocStore::blockText(uint32_t index, unique_lock<mutex>& held) const {
+    for (auto it = cache.begin(); it != cache.end(); ++it) {
+        if (it->first != index) continue;
+        cache.splice(cache.begin(), cache, it);
+        return it->second;
+    }
+
+    Block block = blocks[index];   // the owner keeps the bytes alive meanwhile
+    bool release = block.mapped && releaseMapped;
+    held.unlock();
+    auto text = make_shared<string>(block.rawSize, '\0');
+    bool ok = lzDecompress(block.data, block.compressedSize, &(*text)[0], block.rawSize);
+    if (release) releaseMappedPages(block.data, block.compressedSize);
+    held.lock();
+    if (!ok) return nullptr;
+
+    // The store may have been cleared while decoding
+    if (index >= blocks.size() || blocks[index].data != block.data) return text;
+    cache.emplace_front(index, text);
+    if (cache.size() > kCachedBlocks) cache.pop_back();
+    return text;
+}
+
+// A block's number is fixed when its text is added, so a location still
+// resolves if the open block was sealed while the lock was released
+string DocStore::readText(Location location, size_t begin, size_t end, unique_lock<mutex>& held) const {
+    string out;
+    out.reserve(end - begin);
+
+    uint32_t index = location.block;
+    size_t offset = location.offset;   // of text byte `position` in block `index`
+    size_t position = 0;
+    while (position < end) {
+        if (index > blocks.size()) return "";   // cleared meanwhile
+        size_t rawSize = index == blocks.size() ? open.size() : blocks[index].rawSize;
+        if (offset >= rawSize) return "";
+        size_t n = min(rawSize - offset, end - position);
+
+        // Blocks wholly before begin are skipped, not decompressed
+        if (position + n > begin) {
+            size_t from = max(begin, position);
+            size_t at = offset + (from - position), count = position + n - from;
+            if (index == blocks.size()) {
+                out.append(open, at, count);
+            } else {
+                shared_ptr<const string> text = blockText(index, held);
+                if (!text || at + count > text->size()) return "";
+                out.append(*text, at, count);
+            }
+        }
+        position += n;
+        offset = 0;
+        index++;
+    }
+    return out;
+}
+
+string DocStore::slice(int docID, long long begin, long long end) const {
+    unique_lock<mutex> guard(lock);
+    if (docID < 0 || (size_t)docID >= locations.size()) return "";
+    Location location = locations[docID];
+    if (location.block == kNoBlock) return "";
+
+    begin = max(0LL, min(begin, (long long)location.length));
+    end = max(begin, min(end, (long long)location.length));
+    return readText(location, begin, end, guard);
+}
+
+string DocStore::serialize(int firstDoc, int endDoc) const {
+    unique_lock<mutex> guard(lock);
+    endDoc = max(firstDoc, min(endDoc, (int)locations.size()));
+
+    struct OutBlock {
+        shared_ptr<const char> owner;
+        const char* data;
+        uint32_t compressedSize, rawSize;
+    };
+    vector<OutBlock> outBlocks;
+    vector<Location> outLocations(max(0, endDoc - firstDoc));
+    unordered_map<uint32_t, uint32_t> reused;   // source block -> output block
+
+    // Loose texts (from the open block or blocks straddling the range) are
+    // packed into fresh blocks
+    string pending;
+    auto flushPending = [&]() {
+        if (pending.empty()) return;
+        auto compressed = make_shared<string>(lzCompress(pending.data(), pending.size()));
+        outBlocks.push_back({shared_ptr<const char>(compressed, compressed->data()), compressed->data(),
+                             (uint32_t)compressed->size(), (uint32_t)pending.size()});
+        pending.clear();
+    };
+
+    // A text keeps its blocks only if every block it spans is in the range
+    // and they come out consecutive, as a location names only the first
+    vector<pair<int, Location>> loose;
+    vector<uint32_t> spanned;
+    for (int docID = firstDoc; docID < endDoc; docID++) {
+        Location location = locations[docID];
+        if (location.block == kNoBlock) continue;
+
+        spanned.clear();
+        bool whole = true;
+        size_t offset = location.offset, remaining = location.length;
+        for (uint32_t index = location.block; whole; index++) {
+            if (index >= blocks.size() || blocks[index].minDoc < firstDoc || blocks[index].maxDoc >= endDoc ||
+                offset > blocks[index].rawSize) {
+                whole = false;
+                break;
+            }
+            spanned.push_back(index);
+            remaining -= min<size_t>(remaining, blocks[index].rawSize - offset);
+            offset = 0;
+            if (remaining == 0) break;
+        }
+
+        for (size_t i = 0; whole && i < spanned.size(); i++) {
+            auto it = reused.find(spanned[i]);
+            if (it == reused.end()) {
+                const Block& block = blocks[spanned[i]];
+                it = reused.emplace(spanned[i], outBlocks.size()).first;
+                outBlocks.push_back({block.owner, block.data, block.compressedSize, block.rawSize});
+            }
+            whole = it->second == reused[spanned[0]] + i;
+        }
+        if (whole) {
+            outLocations[docID - firstDoc] = {reused[spanned[0]], location.offset, location.length};
+            continue;
+        }
+        loose.push_back({docID, location});
+    }
+
+    for (auto& [docID, location] : loose) {
+        string text = readText(location, 0, location.length, guard);
+
+        if (!pending.empty() && text.size() <= kBlockSize && pending.size() + text.size() > kBlockSize)
+            flushPending();
+        outLocations[docID - firstDoc] = {(uint32_t)outBlocks.size(), (uint32_t)pending.size(), (uint32_t)text.size()};
+        size_t at = 0;
+        do {
+            size_t n = min(text.size() - at, kBlockSize - pending.size());
+            pending.append(text, at, n);
+            at += n;
+            if (pending.size() >= kBlockSize) flushPending();
+        } while (at < text.size());
+    }
+    flushPending();
+
+    string out;
+    auto put = [&](uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; i++) out.push_back((char)(v >> (8 * i)));
+    };
+    put(firstDoc, 8);
+    put(outLocations.size(), 8);
+    put(outBlocks.size(), 8);
+    uint64_t offset = 0;
+    for (const OutBlock& block : outBlocks) {
+        put(offset, 8);
+        put(block.compressedSize, 4);
+        put(block.rawSize, 4);
+        offset += block.compressedSize;
+    }
+    for (const Location& location : outLocations) {
+        put(location.block, 4);
+        put(location.offset, 4);
+        put(location.length, 4);
+    }
+    for (const OutBlock& block : outBlocks) out.append(block.data, block.compressedSize);
+    return out;
+}
+
+bool DocStore::attach(const char* data, size_t size, shared_ptr<const char> owner, string& error) {
+    const unsigned char* p = (const unsigned char*)data;
+    size_t at = 0;
+    auto get = [&](uint64_t& v, int bytes) {
+        if (size - at < (size_t)bytes) return false;
+        v = 0;
+        for (int i = 0; i < bytes; i++) v |= (uint64_t)p[at + i] << (8 * i);
+        at += bytes;
+        return true;
+    };
+
+    uint64_t firstDoc, docCount, blockCount;
+    if (!get(firstDoc, 8) || !get(docCount, 8) || !get(blockCount, 8) ||
+        firstDoc > INT32_MAX || docCount > INT32_MAX - firstDoc ||
+        blockCount > (size - at) / 16 || docCount > (size - at - blockCount * 16) / 12) {
+        error = "document store header is malformed";
+        return false;
+    }
+
+    vector<Block> newBlocks(blockCount);
+    size_t dataStart = at + blockCount * 16 + docCount * 12;
+    for (uint64_t b = 0; b < blockCount; b++) {
+        uint64_t offset = 0, compressedSize = 0, rawSize = 0;
+        get(offset, 8);
+        get(compressedSize, 4);
+        get(rawSize, 4);
+        if (offset > size - dataStart || compressedSize > size - dataStart - offset || rawSize > kBlockSize) {
+            error = "document store block is out of range";
+            return false;
+        }
+        newBlocks[b].owner = owner;
+        newBlocks[b].data = data + dataStart + offset;
+        newBlocks[b].compressedSize = compressedSize;
+        newBlocks[b].rawSize = rawSize;
+        newBlocks[b].minDoc = INT32_MAX;
+        newBlocks[b].mapped = true;
+    }
+
+    vector<Location> newLocations(docCount);
+    for (uint64_t i = 0; i < docCount; i++) {
+        uint64_t block = 0, offset = 0, length = 0;
+        get(block, 4);
+        get(offset, 4);
+        get(length, 4);
+        if (block == kNoBlock) continue;
+        if (block >= blockCount || offset > newBlocks[block].rawSize) {
+            error = "document store entry is out of range";
+            return false;
+        }
+        newLocations[i] = {(uint32_t)block, (uint32_t)offset, (uint32_t)length};
+
+        // Every block the text runs through holds part of this document
+        int docID = firstDoc + i;
+        uint64_t remaining = length;
+        for (uint64_t b = block; ; b++) {
+            if (b >= blockCount) {
+                error = "document store entry is out of range";
+                return false;
+            }
+            newBlocks[b].minDoc = min(newBlocks[b].minDoc, docID);
+            newBlocks[b].maxDoc = max(newBlocks[b].maxDoc, docID);
+            remaining -= min<uint64_t>(remaining, newBlocks[b].rawSize - offset);
+            offset = 0;
+            if (remaining == 0) break;
+        }
+    }
+
+    lock_guard<mutex> guard(lock);
+    seal();   // block numbers below must not collide with the open block
+    uint32_t base = blocks.size();
+    blocks.insert(blocks.end(), newBlocks.begin(), newBlocks.end());
+    if (locations.size() < firstDoc + docCount) locations.resize(firstDoc + docCount);
+    for (uint64_t i = 0; i < docCount; i++) {
+        Location location = newLocations[i];
+        if (location.block != kNoBlock) location.block += base;
+        locations[firstDoc + i] = location;
+    }
+    return true;
+}
+
+size_t DocStore::compressedBytes() const {
+    lock_guard<mutex> guard(lock);
+    size_t total = open.size();
+    for (const Block& block : blocks) total += block.compressedSize;
+    return total;
+}
+
+size_t DocStore::rawBytes() const {
+    lock_guard<mutex> guard(lock);
+    size_t total = open.size();
+    for (const Block& block : blocks) total += block.rawSize;
+    return total;
+}
+
+DocStoreMemory DocStore::memory() const {
+    lock_guard<mutex> guard(lock);
+    DocStoreMemory m;
+    m.heapBytes = open.capacity() + locations.capacity() * sizeof(Location);
+    for (const Block& block : blocks)
+        (block.mapped ? m.mappedBytes : m.heapBytes) += block.compressedSize;
+    for (const auto& [index, text] : cache) m.cacheBytes += text->capacity();
+    return m;
+}
+
+void DocStore::setReleaseMappedPages(bool release) {
+    lock_guard<mutex> guard(lock);
+    releaseMapped = release;
+}
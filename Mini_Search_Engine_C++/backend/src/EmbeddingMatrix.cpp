@@ -0,0 +1,102 @@
+#include "EmbeddingMatrix.h"
+#include "VectorKernels.h"
+#include <algorithm>
+
+using namespace std;
+
+void EmbeddingMatrix::clear() {
+    dim = 0;
+    rowStride = 0;
+    rowCount = 0;
+    presentCount = 0;
+    base = nullptr;
+    flags = nullptr;
+    borrowed = false;
+    values.clear();
+    values.shrink_to_fit();
+    present.clear();
+    present.shrink_to_fit();
+}
+
+void EmbeddingMatrix::attach(const float* data, const unsigned char* presence, int newDim, size_t stride, size_t rows) {
+    clear();
+    dim = newDim;
+    rowStride = stride;
+    rowCount = rows;
+    base = data;
+    flags = presence;
+    borrowed = true;
+
+    for (size_t i = 0; i < rows; i++)
+        if (flags[i]) presentCount++;
+}
+
+void EmbeddingMatrix::ensureOwned() {
+    if (!borrowed) return;
+
+    values.assign(base, base + rowCount * rowStride);
+    present.assign(flags, flags + rowCount);
+    base = values.data();
+    flags = present.data();
+    borrowed = false;
+}
+
+bool EmbeddingMatrix::set(int docID, const vector<float>& vec) {
+    if (docID < 0 || vec.empty()) return false;
+
+    if (dim == 0) {
+        dim = vec.size();
+        rowStride = (dim + 7) / 8 * 8;
+    }
+    if ((int)vec.size() != dim) return false;
+
+    vector<float> unit = vec;
+    if (!normalizeVector(unit)) return false;
+
+    ensureOwned();
+
+    if ((size_t)docID >= rowCount) {
+        rowCount = docID + 1;
+        present.resize(rowCount, 0);
+        values.resize(rowCount * rowStride, 0.0f);
+    }
+
+    copy(unit.begin(), unit.end(), values.begin() + (size_t)docID * rowStride);
+    if (!present[docID]) {
+        present[docID] = 1;
+        presentCount++;
+    }
+
+    base = values.data();
+    flags = present.data();
+    return true;
+}
+
+bool EmbeddingMatrix::has(int docID) const {
+    return docID >= 0 && (size_t)docID < rowCount && flags[docID];
+}
+
+const float* EmbeddingMatrix::row(int docID) const {
+    if (!has(docID)) return nullptr;
+    return base + (size_t)docID * rowStride;
+}
+
+size_t EmbeddingMatrix::memoryBytes() const {
+    return values.capacity() * sizeof(float) + present.capacity();
+}
+
+void EmbeddingMatrix::scoreAll(const float* query, vector<float>& out) const {
+    out.assign(rowCount, 0.0f);
+    if (rowCount == 0) return;
+
+    // Missing rows are zero-filled, so one pass over the matrix is correct
+    dotProductBatch(query, base, rowStride, rowCount, dim, out.data());
+}
+
+void EmbeddingMatrix::score(const float* query, const vector<int>& docIDs, vector<float>& out) const {
+    out.assign(docIDs.size(), 0.0f);
+    for (size_t i = 0; i < docIDs.size(); i++) {
+        const float* r = row(docIDs[i]);
+        if (r) out[i] = dotProduct(query, r, dim);
+    }
+}
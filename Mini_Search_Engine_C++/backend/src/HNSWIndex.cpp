@@ -0,0 +1,254 @@
+#include "HNSWIndex.h"
+#include "VectorKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <unordered_set>
+
+using namespace std;
+
+HNSWIndex::HNSWIndex(const EmbeddingMatrix* store, int M, int efConstruction, int efSearch)
+    : store(store), rng(42) {
+    setParams(M, efConstruction, efSearch);
+}
+
+void HNSWIndex::setParams(int newM, int newEfConstruction, int newEfSearch) {
+    M = max(2, newM);
+    maxM0 = 2 * M;
+    efConstruction = max(M, newEfConstruction);
+    efSearch = max(1, newEfSearch);
+    levelMult = 1.0 / log((double)M);
+}
+
+void HNSWIndex::clear() {
+    nodeDocIDs.clear();
+    nodeLevels.clear();
+    links.clear();
+    docToNode.clear();
+    entryPoint = -1;
+    maxLevel = -1;
+}
+
+float HNSWIndex::similarity(const float* a, const float* b) const {
+    return dotProduct(a, b, store->dimension());
+}
+
+int HNSWIndex::randomLevel() {
+    uniform_real_distribution<double> dist(0.0, 1.0);
+    double r = max(dist(rng), 1e-12);
+    return (int)(-log(r) * levelMult);
+}
+
+
+// ---------------- INSERT ----------------
+void HNSWIndex::add(int docID) {
+    // Re-embedding an existing document only changes its row in the store;
+    // the links stay valid enough for navigation until the next rebuild().
+    if (!store->has(docID) || docToNode.count(docID)) return;
+
+    int node = nodeDocIDs.size();
+    nodeDocIDs.push_back(docID);
+    nodeLevels.push_back(randomLevel());
+    docToNode[docID] = node;
+
+    insertNode(node);
+}
+
+void HNSWIndex::rebuild() {
+    int nodes = nodeDocIDs.size();
+    entryPoint = -1;
+    maxLevel = -1;
+    for (int node = 0; node < nodes; node++) {
+        nodeLevels[node] = randomLevel();
+    }
+    links.clear();
+    for (int node = 0; node < nodes; node++) {
+        insertNode(node);
+    }
+}
+
+void HNSWIndex::insertNode(int node) {
+    int level = nodeLevels[node];
+    links.resize(nodeDocIDs.size());
+    links[node].assign(level + 1, {});
+
+    if (entryPoint < 0) {
+        entryPoint = node;
+        maxLevel = level;
+        return;
+    }
+
+    const float* vec = vectorOf(node);
+
+    // Greedy descent through the layers above the new node's level
+    int current = greedyClosest(vec, entryPoint, maxLevel, level + 1);
+
+    for (int l = min(level, maxLevel); l >= 0; l--) {
+        auto candidates = searchLayer(vec, current, efConstruction, l);
+        int maxLinks = (l == 0) ? maxM0 : M;
+        vector<int> neighbours = selectNeighbours(candidates, maxLinks);
+        links[node][l] = neighbours;
+
+        for (int nb : neighbours) {
+            auto& nbLinks = links[nb][l];
+            nbLinks.push_back(node);
+
+            if ((int)nbLinks.size() > maxLinks) {
+                vector<pair<float, int>> pool;
+                for (int other : nbLinks)
+                    pool.push_back({similarity(vectorOf(nb), vectorOf(other)), other});
+                nbLinks = selectNeighbours(pool, maxLinks);
+            }
+        }
+
+        if (!candidates.empty())
+            current = candidates.front().second;
+    }
+
+    if (level > maxLevel) {
+        maxLevel = level;
+        entryPoint = node;
+    }
+}
+
+
+// ---------------- GRAPH TRAVERSAL ----------------
+int HNSWIndex::greedyClosest(const float* query, int start, int fromLevel, int toLevel) const {
+    int current = start;
+    float best = similarity(query, vectorOf(current));
+
+    for (int l = fromLevel; l >= toLevel; l--) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int nb : links[current][l]) {
+                float s = similarity(query, vectorOf(nb));
+                if (s > best) {
+                    best = s;
+                    current = nb;
+                    changed = true;
+                }
+            }
+        }
+    }
+    return current;
+}
+
+// Returns up to ef (similarity, node) pairs sorted best first
+vector<pair<float, int>> HNSWIndex::searchLayer(const float* query, int entry, int ef, int level) const {
+    unordered_set<int> visited;
+    visited.insert(entry);
+
+    float s = similarity(query, vectorOf(entry));
+
+    // candidates: best first, results: worst first (so we can evict)
+    priority_queue<pair<float, int>> candidates;
+    priority_queue<pair<float, int>, vector<pair<float, int>>, greater<pair<float, int>>> results;
+    candidates.push({s, entry});
+    results.push({s, entry});
+
+    while (!candidates.empty()) {
+        auto [candSim, cand] = candidates.top();
+        if (candSim < results.top().first && (int)results.size() >= ef)
+            break;
+        candidates.pop();
+
+        if (level >= (int)links[cand].size()) continue;
+
+        for (int nb : links[cand][level]) {
+            if (!visited.insert(nb).second) continue;
+
+            float nbSim = similarity(query, vectorOf(nb));
+            if ((int)results.size() < ef || nbSim > results.top().first) {
+                candidates.push({nbSim, nb});
+                results.push({nbSim, nb});
+                if ((int)results.size() > ef)
+                    results.pop();
+            }
+        }
+    }
+
+    vector<pair<float, int>> out;
+    while (!results.empty()) {
+        out.push_back(results.top());
+        results.pop();
+    }
+    reverse(out.begin(), out.end());
+    return out;
+}
+
+// Neighbour selection heuristic (HNSW paper, Algorithm 4): keep a candidate
+// only if it is closer to the base than to any neighbour already kept, which
+// preserves links across clusters instead of crowding one direction.
+vector<int> HNSWIndex::selectNeighbours(
+    vector<pair<float, int>> candidates,
+    int maxLinks
+) const {
+    sort(candidates.begin(), candidates.end(), greater<pair<float, int>>());
+
+    vector<int> selected;
+    vector<int> skipped;
+    for (auto& [sim, cand] : candidates) {
+        if ((int)selected.size() >= maxLinks) break;
+
+        bool keep = true;
+        for (int chosen : selected) {
+            if (similarity(vectorOf(cand), vectorOf(chosen)) > sim) {
+                keep = false;
+                break;
+            }
+        }
+
+        if (keep) selected.push_back(cand);
+        else skipped.push_back(cand);
+    }
+
+    // Fill remaining slots with the closest discarded candidates
+    for (int cand : skipped) {
+        if ((int)selected.size() >= maxLinks) break;
+        selected.push_back(cand);
+    }
+
+    return selected;
+}
+
+
+// ---------------- QUERY ----------------
+vector<pair<int, float>> HNSWIndex::search(const vector<float>& query, int k, int ef) const {
+    if (entryPoint < 0 || (int)query.size() != dimension() || k <= 0) return {};
+
+    vector<float> unit = query;
+    if (!normalizeVector(unit)) return {};
+    int width = max(k, ef > 0 ? ef : efSearch);
+
+    int current = greedyClosest(unit.data(), entryPoint, maxLevel, 1);
+    auto found = searchLayer(unit.data(), current, width, 0);
+
+    vector<pair<int, float>> out;
+    for (int i = 0; i < (int)found.size() && i < k; i++)
+        out.push_back({nodeDocIDs[found[i].second], found[i].first});
+    return out;
+}
+
+vector<pair<int, float>> HNSWIndex::bruteForce(const vector<float>& query, int k) const {
+    if (entryPoint < 0 || (int)query.size() != dimension() || k <= 0) return {};
+
+    vector<float> unit = query;
+    if (!normalizeVector(unit)) return {};
+
+    vector<float> sims;
+    store->scoreAll(unit.data(), sims);
+
+    vector<pair<float, int>> scored;
+    scored.reserve(nodeDocIDs.size());
+    for (int docID : nodeDocIDs)
+        scored.push_back({sims[docID], docID});
+
+    int top = min(k, (int)scored.size());
+    partial_sort(scored.begin(), scored.begin() + top, scored.end(), greater<pair<float, int>>());
+
+    vector<pair<int, float>> out;
+    for (int i = 0; i < top; i++)
+        out.push_back({scored[i].second, scored[i].first});
+    return out;
+}
@@ -0,0 +1,164 @@
+#include "ImpactIndex.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <queue>
+
+using namespace std;
+
+void ImpactIndex::clear() {
+    terms.clear();
+    pending.clear();
+    scale = 0.0f;
+    docSpan = 0;
+}
+
+void ImpactIndex::addTerm(const string& term, const vector<pair<int, float>>& scores) {
+    if (!scores.empty()) pending[term] = scores;
+}
+
+void ImpactIndex::finalize() {
+    float maxScore = 0.0f;
+    for (auto& [term, scores] : pending)
+        for (auto& [docID, score] : scores) {
+            maxScore = max(maxScore, score);
+            docSpan = max(docSpan, docID + 1);
+        }
+    scale = maxScore > 0.0f ? maxScore / 255.0f : 1.0f;
+
+    for (auto& [term, scores] : pending) {
+        vector<pair<int, int>> quantized;   // (impact, docID)
+        quantized.reserve(scores.size());
+        for (auto& [docID, score] : scores) {
+            int impact = (int)lround(score / scale);
+            quantized.push_back({min(255, max(1, impact)), docID});
+        }
+        sort(quantized.begin(), quantized.end(), [](const pair<int, int>& a, const pair<int, int>& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+
+        vector<Segment>& segments = terms[term];
+        for (auto& [impact, docID] : quantized) {
+            if (segments.empty() || segments.back().impact != impact)
+                segments.push_back({(uint8_t)impact, {}});
+            segments.back().docIDs.push_back(docID);
+        }
+    }
+    pending.clear();
+}
+
+size_t ImpactIndex::memoryBytes() const {
+    size_t bytes = 0;
+    for (auto& [term, segments] : terms) {
+        bytes += term.capacity() + segments.capacity() * sizeof(Segment);
+        for (const Segment& segment : segments)
+            bytes += segment.docIDs.capacity() * sizeof(int);
+    }
+    return bytes;
+}
+
+vector<pair<int, float>> ImpactIndex::search(const vector<string>& queryTerms, int k, double budgetMs,
+                                             ImpactSearchStats* stats) const {
+    auto start = chrono::steady_clock::now();
+    ImpactSearchStats local;
+    ImpactSearchStats& st = stats ? *stats : local;
+    st = ImpactSearchStats();
+
+    vector<string> distinct = queryTerms;
+    sort(distinct.begin(), distinct.end());
+    distinct.erase(unique(distinct.begin(), distinct.end()), distinct.end());
+
+    vector<const vector<Segment>*> lists;
+    for (const string& term : distinct) {
+        auto it = terms.find(term);
+        if (it == terms.end()) continue;
+        lists.push_back(&it->second);
+        st.segmentsTotal += it->second.size();
+    }
+    if (lists.empty() || k <= 0) return {};
+
+    // Accumulators are reused across queries on the same thread; only the
+    // touched entries are reset afterwards
+    thread_local vector<uint32_t> acc;
+    thread_local vector<int> touched;
+    thread_local vector<uint32_t> scratch;
+    if ((int)acc.size() < docSpan) acc.assign(docSpan, 0);
+    touched.clear();
+
+    // Next segment of every term, highest impact first
+    priority_queue<pair<int, size_t>> heap;
+    vector<size_t> cursor(lists.size(), 0);
+    uint32_t remaining = 0;     // most any document can still gain
+    for (size_t t = 0; t < lists.size(); t++) {
+        heap.push({(*lists[t])[0].impact, t});
+        remaining += (*lists[t])[0].impact;
+    }
+
+    size_t scoredSinceCheck = 0;
+    while (!heap.empty()) {
+        auto [impact, t] = heap.top();
+        heap.pop();
+
+        const Segment& segment = (*lists[t])[cursor[t]++];
+        for (int docID : segment.docIDs) {
+            if (acc[docID] == 0) touched.push_back(docID);
+            acc[docID] += impact;
+        }
+        st.postingsScored += segment.docIDs.size();
+        st.segmentsScored++;
+        scoredSinceCheck += segment.docIDs.size();
+
+        remaining -= impact;
+        if (cursor[t] < lists[t]->size()) {
+            int next = (*lists[t])[cursor[t]].impact;
+            remaining += next;
+            heap.push({next, t});
+        }
+        if (heap.empty()) break;
+
+        if (budgetMs > 0 &&
+            chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() > budgetMs) {
+            st.budgetExhausted = true;
+            break;
+        }
+
+        // Stop test at impact-level boundaries, no more often than the
+        // scoring itself costs: the top-k set is fixed once the best
+        // document outside it cannot catch up with the k-th even if it
+        // collected every remaining impact
+        if (heap.top().first == impact || (int)touched.size() <= k || scoredSinceCheck < touched.size())
+            continue;
+        scoredSinceCheck = 0;
+
+        scratch.clear();
+        for (int docID : touched) scratch.push_back(acc[docID]);
+        nth_element(scratch.begin(), scratch.begin() + (k - 1), scratch.end(), greater<uint32_t>());
+        uint32_t kth = scratch[k - 1];
+        uint32_t runnerUp = *max_element(scratch.begin() + k, scratch.end());
+
+        if (runnerUp + remaining <= kth) {
+            st.earlyTerminated = true;
+            break;
+        }
+    }
+
+    vector<pair<int, float>> ranked;
+    ranked.reserve(touched.size());
+    for (int docID : touched) {
+        ranked.push_back({docID, acc[docID] * scale});
+        acc[docID] = 0;
+    }
+
+    auto byScore = [](const pair<int, float>& a, const pair<int, float>& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    };
+    if ((int)ranked.size() > k) {
+        partial_sort(ranked.begin(), ranked.begin() + k, ranked.end(), byScore);
+        ranked.resize(k);
+    } else {
+        sort(ranked.begin(), ranked.end(), byScore);
+    }
+
+    st.elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return ranked;
+}
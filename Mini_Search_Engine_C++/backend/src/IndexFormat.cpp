@@ -0,0 +1,471 @@
+#include "IndexFormat.h"
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IF_HAVE_X86 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define IF_HAVE_ARM_CRC 1
+#endif
+
+using namespace std;
+
+static const char kMagic[8] = {'M', 'S', 'E', 'I', 'N', 'D', 'E', 'X'};
+static constexpr size_t kDirectoryEntrySize = 32;
+
+
+// ---------------- CRC32C ----------------
+namespace {
+
+struct CrcTable {
+    uint32_t entries[256];
+    CrcTable() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+            entries[i] = c;
+        }
+    }
+};
+
+uint32_t crc32cTable(const uint8_t* p, size_t n, uint32_t crc) {
+    static const CrcTable table;
+    while (n--) crc = table.entries[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef IF_HAVE_X86
+__attribute__((target("sse4.2")))
+uint32_t crc32cSSE42(const uint8_t* p, size_t n, uint32_t crc) {
+    while (n && ((uintptr_t)p & 7)) { crc = _mm_crc32_u8(crc, *p++); n--; }
+
+    uint64_t c = crc;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (uint32_t)c;
+
+    while (n--) crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#endif
+
+#ifdef IF_HAVE_ARM_CRC
+uint32_t crc32cARM(const uint8_t* p, size_t n, uint32_t crc) {
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        crc = __crc32cd(crc, v);
+    }
+    while (n--) crc = __crc32cb(crc, *p++);
+    return crc;
+}
+#endif
+
+struct CrcKernel {
+    uint32_t (*run)(const uint8_t*, size_t, uint32_t) = crc32cTable;
+    const char* name = "table";
+
+    CrcKernel() {
+#if defined(IF_HAVE_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2")) {
+            run = crc32cSSE42;
+            name = "sse4.2";
+        }
+#elif defined(IF_HAVE_ARM_CRC)
+        run = crc32cARM;
+        name = "armv8-crc";
+#endif
+    }
+};
+
+const CrcKernel& crcKernel() {
+    static const CrcKernel selected;
+    return selected;
+}
+
+// Little-endian encode / decode independent of the host byte order
+template <typename T>
+void storeLE(T v, uint8_t* out) {
+    for (size_t i = 0; i < sizeof(T); i++) out[i] = (uint8_t)((uint64_t)v >> (8 * i));
+}
+
+template <typename T>
+T loadLE(const uint8_t* in) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(T); i++) v |= (uint64_t)in[i] << (8 * i);
+    return (T)v;
+}
+
+}
+
+uint32_t crc32c(const void* data, size_t size, uint32_t crc) {
+    return ~crcKernel().run((const uint8_t*)data, size, ~crc);
+}
+
+const char* activeCrcKernel() {
+    return crcKernel().name;
+}
+
+
+// ---------------- WRITER ----------------
+IndexWriter::~IndexWriter() {
+    if (fd >= 0) ::close(fd);
+}
+
+bool IndexWriter::open(const string& path) {
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        failure = string("open: ") + strerror(errno);
+        return false;
+    }
+
+    buffer.clear();
+    buffer.reserve(kBufferSize);
+    position = 0;
+    sections.clear();
+    inSection = false;
+    failure.clear();
+
+    // Placeholder until finish() knows the directory
+    char header[kIndexHeaderSize] = {0};
+    raw(header, sizeof(header));
+    return true;
+}
+
+bool IndexWriter::writeAll(const char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = ::pwrite(fd, data, size, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            failure = string("write: ") + strerror(errno);
+            return false;
+        }
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool IndexWriter::flush() {
+    if (buffer.empty() || !failure.empty()) return failure.empty();
+
+    bool ok = writeAll(buffer.data(), buffer.size(), position - buffer.size());
+    if (ok && progress) progress->store(position, memory_order_relaxed);
+    buffer.clear();
+    return ok;
+}
+
+void IndexWriter::raw(const void* data, size_t size) {
+    if (inSection) sections.back().crc = crc32c(data, size, sections.back().crc);
+
+    const char* p = (const char*)data;
+    while (size > 0) {
+        size_t n = min(size, kBufferSize - buffer.size());
+        buffer.insert(buffer.end(), p, p + n);
+        position += n;
+        p += n;
+        size -= n;
+        if (buffer.size() == kBufferSize) flush();
+    }
+}
+
+void IndexWriter::beginSection(const string& tag) {
+    if (inSection) endSection();
+
+    // Sections start aligned so their payloads can be used in place
+    static const char zeros[kIndexAlignment] = {0};
+    raw(zeros, (kIndexAlignment - position % kIndexAlignment) % kIndexAlignment);
+
+    IndexSection section;
+    section.tag = tag.substr(0, 8);
+    section.offset = position;
+    sections.push_back(section);
+    inSection = true;
+}
+
+void IndexWriter::endSection() {
+    if (!inSection) return;
+    sections.back().size = position - sections.back().offset;
+    inSection = false;
+}
+
+void IndexWriter::putU8(uint8_t v) { raw(&v, 1); }
+
+void IndexWriter::putU16(uint16_t v) {
+    uint8_t b[2];
+    storeLE(v, b);
+    raw(b, sizeof(b));
+}
+
+void IndexWriter::putU32(uint32_t v) {
+    uint8_t b[4];
+    storeLE(v, b);
+    raw(b, sizeof(b));
+}
+
+void IndexWriter::putU64(uint64_t v) {
+    uint8_t b[8];
+    storeLE(v, b);
+    raw(b, sizeof(b));
+}
+
+void IndexWriter::putF64(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    putU64(bits);
+}
+
+void IndexWriter::putString(const string& s) {
+    putU32((uint32_t)s.size());
+    raw(s.data(), s.size());
+}
+
+void IndexWriter::putBytes(const void* data, size_t size) {
+    raw(data, size);
+}
+
+void IndexWriter::putF32Array(const float* data, size_t count) {
+    if (kLittleEndianHost) {
+        raw(data, count * sizeof(float));
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint32_t bits;
+        memcpy(&bits, &data[i], sizeof(bits));
+        putU32(bits);
+    }
+}
+
+void IndexWriter::align() {
+    static const char zeros[kIndexAlignment] = {0};
+    raw(zeros, (kIndexAlignment - position % kIndexAlignment) % kIndexAlignment);
+}
+
+bool IndexWriter::finish() {
+    endSection();
+    align();
+
+    uint64_t directoryOffset = position;
+    vector<uint8_t> directory(sections.size() * kDirectoryEntrySize, 0);
+    for (size_t i = 0; i < sections.size(); i++) {
+        uint8_t* entry = directory.data() + i * kDirectoryEntrySize;
+        memcpy(entry, sections[i].tag.data(), sections[i].tag.size());
+        storeLE<uint64_t>(sections[i].offset, entry + 8);
+        storeLE<uint64_t>(sections[i].size, entry + 16);
+        storeLE<uint32_t>(sections[i].crc, entry + 24);
+    }
+    raw(directory.data(), directory.size());
+
+    uint8_t header[kIndexHeaderSize] = {0};
+    memcpy(header, kMagic, sizeof(kMagic));
+    storeLE<uint32_t>(kIndexFormatVersion, header + 8);
+    storeLE<uint32_t>((uint32_t)sections.size(), header + 12);
+    storeLE<uint64_t>(directoryOffset, header + 16);
+    storeLE<uint32_t>(crc32c(directory.data(), directory.size()), header + 24);
+    storeLE<uint32_t>(crc32c(header, 28), header + 28);
+
+    bool ok = flush() && writeAll((const char*)header, sizeof(header), 0);
+    if (ok && ::fsync(fd) != 0) {
+        failure = string("fsync: ") + strerror(errno);
+        ok = false;
+    }
+    if (::close(fd) != 0 && ok) {
+        failure = string("close: ") + strerror(errno);
+        ok = false;
+    }
+    fd = -1;
+    return ok;
+}
+
+
+// ---------------- READER ----------------
+bool IndexFile::open(const char* fileData, size_t fileSize, string& error, bool verifySections) {
+    data = fileData;
+    size = fileSize;
+    directory.clear();
+
+    const uint8_t* header = (const uint8_t*)data;
+    if (size < kIndexHeaderSize || memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+        error = "not an index file (bad magic)";
+        return false;
+    }
+    if (crc32c(header, 28) != loadLE<uint32_t>(header + 28)) {
+        error = "header checksum mismatch";
+        return false;
+    }
+
+    formatVersion = loadLE<uint32_t>(header + 8);
+    if (formatVersion != kIndexFormatVersion) {
+        error = "unsupported format version " + to_string(formatVersion);
+        return false;
+    }
+
+    uint32_t count = loadLE<uint32_t>(header + 12);
+    uint64_t directoryOffset = loadLE<uint64_t>(header + 16);
+    uint64_t directoryBytes = (uint64_t)count * kDirectoryEntrySize;
+    if (directoryOffset > size || directoryBytes > size - directoryOffset) {
+        error = "section directory is truncated";
+        return false;
+    }
+
+    const uint8_t* entries = header + directoryOffset;
+    if (crc32c(entries, directoryBytes) != loadLE<uint32_t>(header + 24)) {
+        error = "section directory checksum mismatch";
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* entry = entries + i * kDirectoryEntrySize;
+        IndexSection section;
+        section.tag.assign((const char*)entry, strnlen((const char*)entry, 8));
+        section.offset = loadLE<uint64_t>(entry + 8);
+        section.size = loadLE<uint64_t>(entry + 16);
+        section.crc = loadLE<uint32_t>(entry + 24);
+
+        if (section.offset > size || section.size > size - section.offset) {
+            error = "section " + section.tag + " lies outside the file";
+            return false;
+        }
+        if (verifySections && !verify(section)) {
+            error = "section " + section.tag + " checksum mismatch";
+            return false;
+        }
+        directory.push_back(section);
+    }
+    return true;
+}
+
+const IndexSection* IndexFile::find(const string& tag) const {
+    for (const IndexSection& section : directory)
+        if (section.tag == tag) return &section;
+    return nullptr;
+}
+
+bool IndexFile::verify(const IndexSection& section) const {
+    return crc32c(data + section.offset, section.size) == section.crc;
+}
+
+SectionReader::SectionReader(const IndexFile& file, const IndexSection& section)
+    : SectionReader(file, section, 0) {}
+
+SectionReader::SectionReader(const IndexFile& file, const IndexSection& section, uint64_t at)
+    : fileBase(file.base()),
+      cursor(file.base() + section.offset + min(at, section.size)),
+      end(file.base() + section.offset + section.size),
+      good(at <= section.size) {}
+
+SectionReader::SectionReader(const char* data, size_t size)
+    : fileBase(data), cursor(data), end(data + size) {}
+
+bool SectionReader::take(void* out, size_t size) {
+    if (!good || size > (size_t)(end - cursor)) {
+        good = false;
+        return false;
+    }
+    memcpy(out, cursor, size);
+    cursor += size;
+    return true;
+}
+
+bool SectionReader::u8(uint8_t& v) { return take(&v, 1); }
+
+bool SectionReader::u16(uint16_t& v) {
+    uint8_t b[2];
+    if (!take(b, sizeof(b))) return false;
+    v = loadLE<uint16_t>(b);
+    return true;
+}
+
+bool SectionReader::u32(uint32_t& v) {
+    uint8_t b[4];
+    if (!take(b, sizeof(b))) return false;
+    v = loadLE<uint32_t>(b);
+    return true;
+}
+
+bool SectionReader::u64(uint64_t& v) {
+    uint8_t b[8];
+    if (!take(b, sizeof(b))) return false;
+    v = loadLE<uint64_t>(b);
+    return true;
+}
+
+bool SectionReader::f64(double& v) {
+    uint64_t bits;
+    if (!u64(bits)) return false;
+    memcpy(&v, &bits, sizeof(v));
+    return true;
+}
+
+bool SectionReader::str(string& s) {
+    uint32_t length;
+    const char* p;
+    if (!u32(length) || !bytes(p, length)) return false;
+    s.assign(p, length);
+    return true;
+}
+
+bool SectionReader::bytes(const char*& p, size_t size) {
+    if (!good || size > (size_t)(end - cursor)) {
+        good = false;
+        return false;
+    }
+    p = cursor;
+    cursor += size;
+    return true;
+}
+
+bool SectionReader::align() {
+    size_t offset = cursor - fileBase;
+    const char* p;
+    return bytes(p, (kIndexAlignment - offset % kIndexAlignment) % kIndexAlignment);
+}
+
+bool SectionReader::fits(uint64_t count, size_t minBytesEach) {
+    if (good && minBytesEach > 0 && count > remaining() / minBytesEach) good = false;
+    return good;
+}
+
+
+
+// ---------------- MAPPED PAGES ----------------
+void releaseMappedPages(const void* data, size_t size) {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)data / page * page;
+    uintptr_t end = ((uintptr_t)data + size + page - 1) / page * page;
+    if (size > 0) madvise((void*)begin, end - begin, MADV_DONTNEED);
+}
+
+// mincore would report the page cache, not this process: Rss from smaps
+// counts only the pages mapped in here
+size_t residentMappedBytes(const void* data, size_t size) {
+    uintptr_t begin = (uintptr_t)data, end = begin + size;
+    ifstream smaps("/proc/self/smaps");
+    string line;
+    size_t resident = 0;
+    bool inside = false;
+    while (getline(smaps, line)) {
+        uintptr_t from, to;
+        if (sscanf(line.c_str(), "%" SCNxPTR "-%" SCNxPTR " ", &from, &to) == 2) {
+            inside = from < end && to > begin;
+            continue;
+        }
+        size_t kb;
+        if (inside && sscanf(line.c_str(), "Rss: %zu kB", &kb) == 1) resident += kb << 10;
+    }
+    return resident;
+}
@@ -0,0 +1,376 @@
+#include "PostingOps.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PO_HAVE_X86 1
+#endif
+
+using namespace std;
+
+size_t gallopTo(const vector<int>& list, size_t from, int target) {
+    size_t n = list.size();
+    if (from >= n || list[from] >= target) return from;
+
+    // Find a window (lo, hi] that contains the target
+    size_t lo = from;
+    size_t step = 1;
+    size_t hi = from + step;
+    while (hi < n && list[hi] < target) {
+        lo = hi;
+        step <<= 1;
+        hi = from + step;
+    }
+    if (hi > n) hi = n;
+
+    return lower_bound(list.begin() + lo + 1, list.begin() + hi, target) - list.begin();
+}
+
+// ---------------- TWO-LIST KERNELS ----------------
+// Raw kernels write into out, which needs min(na, nb) + 8 slots (the block
+// kernels store a whole block before knowing how many lanes matched).
+static size_t mergeRaw(const int* a, size_t na, const int* b, size_t nb, int* out) {
+    size_t i = 0, j = 0, count = 0;
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) i++;
+        else if (a[i] > b[j]) j++;
+        else { out[count++] = a[i]; i++; j++; }
+    }
+    return count;
+}
+
+#ifdef PO_HAVE_X86
+// Lane-packing shuffles for each 4-bit match mask
+static const __m128i* sseShuffleTable() {
+    static __m128i table[16];
+    static bool built = [] {
+        for (int mask = 0; mask < 16; mask++) {
+            alignas(16) unsigned char bytes[16];
+            int k = 0;
+            for (int lane = 0; lane < 4; lane++) {
+                if (!(mask & (1 << lane))) continue;
+                for (int b = 0; b < 4; b++) bytes[k * 4 + b] = lane * 4 + b;
+                k++;
+            }
+            for (; k < 4; k++)
+                for (int b = 0; b < 4; b++) bytes[k * 4 + b] = 0x80;   // zero
+            memcpy(&table[mask], bytes, 16);
+        }
+        return true;
+    }();
+    (void)built;
+    return table;
+}
+
+__attribute__((target("ssse3")))
+static size_t intersectSSERaw(const int* a, size_t na, const int* b, size_t nb, int* out) {
+    const __m128i* shuffles = sseShuffleTable();
+    size_t i = 0, j = 0, count = 0;
+
+    while (i + 4 <= na && j + 4 <= nb) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+
+        // All 16 pairs via the three lane rotations of vb
+        __m128i eq = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+            _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+
+        _mm_storeu_si128((__m128i*)(out + count), _mm_shuffle_epi8(va, shuffles[mask]));
+        count += __builtin_popcount(mask);
+
+        int lastA = a[i + 3], lastB = b[j + 3];
+        if (lastA <= lastB) i += 4;
+        if (lastB <= lastA) j += 4;
+    }
+    return count + mergeRaw(a + i, na - i, b + j, nb - j, out + count);
+}
+
+// Lane-packing permutations for each 8-bit match mask
+static const int* avx2PermuteTable() {
+    static int table[256][8];
+    static bool built = [] {
+        for (int mask = 0; mask < 256; mask++) {
+            int k = 0;
+            for (int lane = 0; lane < 8; lane++)
+                if (mask & (1 << lane)) table[mask][k++] = lane;
+            for (; k < 8; k++) table[mask][k] = 0;
+        }
+        return true;
+    }();
+    (void)built;
+    return &table[0][0];
+}
+
+__attribute__((target("avx2")))
+static size_t intersectAVX2Raw(const int* a, size_t na, const int* b, size_t nb, int* out) {
+    const int* permutes = avx2PermuteTable();
+    size_t i = 0, j = 0, count = 0;
+
+    __m256i rotate[8];
+    for (int r = 0; r < 8; r++)
+        rotate[r] = _mm256_setr_epi32(r, (r + 1) & 7, (r + 2) & 7, (r + 3) & 7,
+                                      (r + 4) & 7, (r + 5) & 7, (r + 6) & 7, (r + 7) & 7);
+
+    while (i + 8 <= na && j + 8 <= nb) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + j));
+
+        __m256i eq = _mm256_cmpeq_epi32(va, vb);
+        for (int r = 1; r < 8; r++)
+            eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(va, _mm256_permutevar8x32_epi32(vb, rotate[r])));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+
+        __m256i perm = _mm256_loadu_si256((const __m256i*)(permutes + mask * 8));
+        _mm256_storeu_si256((__m256i*)(out + count), _mm256_permutevar8x32_epi32(va, perm));
+        count += __builtin_popcount(mask);
+
+        int lastA = a[i + 7], lastB = b[j + 7];
+        if (lastA <= lastB) i += 8;
+        if (lastB <= lastA) j += 8;
+    }
+    return count + mergeRaw(a + i, na - i, b + j, nb - j, out + count);
+}
+#endif
+
+namespace {
+
+struct IntersectKernels {
+    size_t (*block)(const int*, size_t, const int*, size_t, int*) = mergeRaw;
+    const char* name = "scalar";
+
+    IntersectKernels() {
+#ifdef PO_HAVE_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            block = intersectAVX2Raw;
+            name = "avx2";
+        } else if (__builtin_cpu_supports("ssse3")) {
+            block = intersectSSERaw;
+            name = "sse";
+        }
+#endif
+    }
+};
+
+const IntersectKernels& intersectKernels() {
+    static const IntersectKernels selected;
+    return selected;
+}
+
+}
+
+template <typename Kernel>
+static vector<int> runKernel(const vector<int>& a, const vector<int>& b, Kernel kernel) {
+    vector<int> out(min(a.size(), b.size()) + 8);
+    out.resize(kernel(a.data(), a.size(), b.data(), b.size(), out.data()));
+    return out;
+}
+
+vector<int> intersectMerge(const vector<int>& a, const vector<int>& b) {
+    return runKernel(a, b, mergeRaw);
+}
+
+vector<int> intersectGalloping(const vector<int>& a, const vector<int>& b) {
+    const vector<int>& small = a.size() <= b.size() ? a : b;
+    const vector<int>& large = a.size() <= b.size() ? b : a;
+
+    vector<int> out;
+    out.reserve(small.size());
+    size_t cursor = 0;
+    for (int docID : small) {
+        cursor = gallopTo(large, cursor, docID);
+        if (cursor == large.size()) break;
+        if (large[cursor] == docID) out.push_back(docID);
+    }
+    return out;
+}
+
+vector<int> intersectSIMD(const vector<int>& a, const vector<int>& b) {
+    return runKernel(a, b, intersectKernels().block);
+}
+
+const char* activeIntersectKernel() {
+    return intersectKernels().name;
+}
+
+vector<int> intersectAdaptive(const vector<int>& a, const vector<int>& b) {
+    size_t small = min(a.size(), b.size());
+    size_t large = max(a.size(), b.size());
+    if (small == 0) return {};
+
+    if (large / small >= kGallopRatio) return intersectGalloping(a, b);
+    return intersectSIMD(a, b);
+}
+
+vector<int> intersectSorted(vector<const vector<int>*> lists) {
+    if (lists.empty()) return {};
+
+    sort(lists.begin(), lists.end(), [](const vector<int>* a, const vector<int>* b) {
+        return a->size() < b->size();
+    });
+
+    vector<int> result = *lists[0];
+    for (size_t l = 1; l < lists.size() && !result.empty(); l++)
+        result = intersectAdaptive(result, *lists[l]);
+    return result;
+}
+
+vector<int> unionSorted(const vector<const vector<int>*>& lists) {
+    if (lists.empty()) return {};
+    if (lists.size() == 1) return *lists[0];
+
+    // Min-heap of (docID, list)
+    priority_queue<pair<int, size_t>, vector<pair<int, size_t>>, greater<pair<int, size_t>>> heap;
+    vector<size_t> cursor(lists.size(), 0);
+    size_t total = 0;
+
+    for (size_t l = 0; l < lists.size(); l++) {
+        total += lists[l]->size();
+        if (!lists[l]->empty()) heap.push({(*lists[l])[0], l});
+    }
+
+    vector<int> result;
+    result.reserve(total);
+    while (!heap.empty()) {
+        auto [docID, l] = heap.top();
+        heap.pop();
+        if (result.empty() || result.back() != docID) result.push_back(docID);
+
+        if (++cursor[l] < lists[l]->size())
+            heap.push({(*lists[l])[cursor[l]], l});
+    }
+    return result;
+}
+
+vector<int> subtractSorted(const vector<int>& list, const vector<int>& remove) {
+    vector<int> result;
+    result.reserve(list.size());
+    size_t cursor = 0;
+
+    for (int docID : list) {
+        cursor = gallopTo(remove, cursor, docID);
+        if (cursor == remove.size() || remove[cursor] != docID)
+            result.push_back(docID);
+    }
+    return result;
+}
+
+bool preferBitmap(size_t listSize, int universe) {
+    return universe > 0 && listSize * 32 >= (size_t)universe;
+}
+
+static vector<int> bitmapToList(const vector<uint64_t>& bits) {
+    vector<int> result;
+    for (size_t w = 0; w < bits.size(); w++) {
+        uint64_t word = bits[w];
+        while (word) {
+            result.push_back((int)(w * 64 + __builtin_ctzll(word)));
+            word &= word - 1;
+        }
+    }
+    return result;
+}
+
+static void setBits(vector<uint64_t>& bits, const vector<int>& list, int universe) {
+    for (int docID : list) {
+        if (docID >= 0 && docID < universe)
+            bits[docID >> 6] |= 1ULL << (docID & 63);
+    }
+}
+
+vector<int> intersectBitmap(const vector<const vector<int>*>& lists, int universe) {
+    if (lists.empty() || universe <= 0) return {};
+
+    size_t words = (universe + 63) / 64;
+    vector<uint64_t> acc(words, 0), bits(words);
+    setBits(acc, *lists[0], universe);
+
+    for (size_t l = 1; l < lists.size(); l++) {
+        fill(bits.begin(), bits.end(), 0);
+        setBits(bits, *lists[l], universe);
+        for (size_t w = 0; w < words; w++) acc[w] &= bits[w];
+    }
+    return bitmapToList(acc);
+}
+
+vector<int> unionBitmap(const vector<const vector<int>*>& lists, int universe) {
+    if (universe <= 0) return {};
+
+    vector<uint64_t> acc((universe + 63) / 64, 0);
+    for (const vector<int>* list : lists)
+        setBits(acc, *list, universe);
+    return bitmapToList(acc);
+}
+
+int matchPhrase(const vector<const vector<int>*>& positions, int& firstMatch) {
+    firstMatch = -1;
+    if (positions.empty()) return 0;
+
+    size_t words = positions.size();
+    vector<size_t> cursor(words, 0);
+    const vector<int>& head = *positions[0];
+    int count = 0;
+
+    while (cursor[0] < head.size()) {
+        int start = head[cursor[0]];
+        bool matched = true;
+
+        for (size_t i = 1; i < words; i++) {
+            const vector<int>& list = *positions[i];
+            cursor[i] = gallopTo(list, cursor[i], start + (int)i);
+            if (cursor[i] == list.size()) return count;
+
+            if (list[cursor[i]] != start + (int)i) {
+                // Jump the first word to the earliest start this word allows
+                cursor[0] = gallopTo(head, cursor[0], list[cursor[i]] - (int)i);
+                matched = false;
+                break;
+            }
+        }
+
+        if (matched) {
+            if (count == 0) firstMatch = start;
+            count++;
+            cursor[0]++;
+        }
+    }
+    return count;
+}
+
+int minimalCoverSpan(const vector<const vector<int>*>& positions) {
+    if (positions.empty()) return 0;
+
+    // Min-heap of (position, list); the window is [heap top, highest]
+    priority_queue<pair<int, size_t>, vector<pair<int, size_t>>, greater<pair<int, size_t>>> heap;
+    vector<size_t> cursor(positions.size(), 0);
+    int highest = INT_MIN;
+
+    for (size_t l = 0; l < positions.size(); l++) {
+        if (positions[l]->empty()) return 0;
+        heap.push({(*positions[l])[0], l});
+        highest = max(highest, (*positions[l])[0]);
+    }
+
+    int best = INT_MAX;
+    while (true) {
+        auto [lowest, l] = heap.top();
+        heap.pop();
+        best = min(best, highest - lowest + 1);
+        if (best == (int)positions.size()) break;    // cannot get shorter
+
+        // Advance the list holding the lowest position
+        if (++cursor[l] == positions[l]->size()) break;
+        int next = (*positions[l])[cursor[l]];
+        highest = max(highest, next);
+        heap.push({next, l});
+    }
+    return best;
+}
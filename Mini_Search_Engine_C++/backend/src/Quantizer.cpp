@@ -0,0 +1,317 @@
+#include "Quantizer.h"
+#include "VectorKernels.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <queue>
+#include <random>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+// ---------------- SCALAR (INT8) ----------------
+void ScalarQuantizer::train(const vector<const float*>& samples, int newDim) {
+    dim = newDim;
+    lo.assign(dim, FLT_MAX);
+    vector<float> hi(dim, -FLT_MAX);
+
+    for (const float* vec : samples) {
+        for (int i = 0; i < dim; i++) {
+            lo[i] = min(lo[i], vec[i]);
+            hi[i] = max(hi[i], vec[i]);
+        }
+    }
+
+    step.assign(dim, 0.0f);
+    for (int i = 0; i < dim; i++) {
+        if (lo[i] > hi[i]) lo[i] = hi[i] = 0.0f;   // no samples
+        step[i] = (hi[i] - lo[i]) / 255.0f;
+    }
+}
+
+void ScalarQuantizer::encode(const float* vec, uint8_t* code) const {
+    for (int i = 0; i < dim; i++) {
+        float q = step[i] > 0.0f ? (vec[i] - lo[i]) / step[i] : 0.0f;
+        code[i] = (uint8_t)min(255.0f, max(0.0f, roundf(q)));
+    }
+}
+
+ScalarQuantizer::QueryTable ScalarQuantizer::prepare(const float* query) const {
+    QueryTable table;
+    table.weights.resize(dim);
+    for (int i = 0; i < dim; i++) {
+        table.weights[i] = query[i] * step[i];
+        table.bias += query[i] * lo[i];
+    }
+    return table;
+}
+
+float ScalarQuantizer::score(const QueryTable& table, const uint8_t* code) const {
+    const float* w = table.weights.data();
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    int i = 0;
+    for (; i + 4 <= dim; i += 4) {
+        s0 += w[i] * code[i];
+        s1 += w[i + 1] * code[i + 1];
+        s2 += w[i + 2] * code[i + 2];
+        s3 += w[i + 3] * code[i + 3];
+    }
+    for (; i < dim; i++)
+        s0 += w[i] * code[i];
+    return table.bias + (s0 + s1) + (s2 + s3);
+}
+
+
+// ---------------- PRODUCT QUANTIZATION ----------------
+static float squaredDistance(const float* a, const float* b, int n) {
+    float d = 0.0f;
+    for (int i = 0; i < n; i++) {
+        float diff = a[i] - b[i];
+        d += diff * diff;
+    }
+    return d;
+}
+
+const float* ProductQuantizer::centroid(int space, int c) const {
+    int subDim = subStart[space + 1] - subStart[space];
+    return centroids.data() + (size_t)subStart[space] * centroidsPerSpace + (size_t)c * subDim;
+}
+
+void ProductQuantizer::train(const vector<const float*>& samples, int newDim, int newSubspaces, int iterations) {
+    dim = newDim;
+    subspaces = max(1, min(newSubspaces, dim));
+    centroidsPerSpace = max(1, min(256, (int)samples.size()));
+
+    // Split dim as evenly as possible when it is not a multiple of subspaces
+    subStart.assign(subspaces + 1, 0);
+    for (int s = 0; s <= subspaces; s++)
+        subStart[s] = (int)((long long)dim * s / subspaces);
+
+    centroids.assign((size_t)dim * centroidsPerSpace, 0.0f);
+    if (samples.empty()) return;
+
+    mt19937 rng(1234);
+    vector<int> order(samples.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+
+    vector<int> assignment(samples.size());
+
+    for (int space = 0; space < subspaces; space++) {
+        int offset = subStart[space];
+        int subDim = subStart[space + 1] - offset;
+        float* book = centroids.data() + (size_t)offset * centroidsPerSpace;
+
+        // Seed with distinct random samples
+        shuffle(order.begin(), order.end(), rng);
+        for (int c = 0; c < centroidsPerSpace; c++)
+            copy(samples[order[c]] + offset, samples[order[c]] + offset + subDim, book + (size_t)c * subDim);
+
+        for (int iter = 0; iter < iterations; iter++) {
+            for (size_t n = 0; n < samples.size(); n++) {
+                const float* sub = samples[n] + offset;
+                float best = FLT_MAX;
+                for (int c = 0; c < centroidsPerSpace; c++) {
+                    float d = squaredDistance(sub, book + (size_t)c * subDim, subDim);
+                    if (d < best) { best = d; assignment[n] = c; }
+                }
+            }
+
+            vector<double> sums((size_t)centroidsPerSpace * subDim, 0.0);
+            vector<int> counts(centroidsPerSpace, 0);
+            for (size_t n = 0; n < samples.size(); n++) {
+                const float* sub = samples[n] + offset;
+                double* acc = sums.data() + (size_t)assignment[n] * subDim;
+                for (int i = 0; i < subDim; i++) acc[i] += sub[i];
+                counts[assignment[n]]++;
+            }
+
+            for (int c = 0; c < centroidsPerSpace; c++) {
+                float* cen = book + (size_t)c * subDim;
+                if (counts[c] == 0) {
+                    // Re-seed empty clusters from a random sample
+                    const float* pick = samples[rng() % samples.size()] + offset;
+                    copy(pick, pick + subDim, cen);
+                    continue;
+                }
+                for (int i = 0; i < subDim; i++)
+                    cen[i] = (float)(sums[(size_t)c * subDim + i] / counts[c]);
+            }
+        }
+    }
+}
+
+void ProductQuantizer::encode(const float* vec, uint8_t* code) const {
+    for (int space = 0; space < subspaces; space++) {
+        int offset = subStart[space];
+        int subDim = subStart[space + 1] - offset;
+
+        float best = FLT_MAX;
+        int bestC = 0;
+        for (int c = 0; c < centroidsPerSpace; c++) {
+            float d = squaredDistance(vec + offset, centroid(space, c), subDim);
+            if (d < best) { best = d; bestC = c; }
+        }
+        code[space] = (uint8_t)bestC;
+    }
+}
+
+vector<float> ProductQuantizer::prepare(const float* query) const {
+    vector<float> table((size_t)subspaces * 256, 0.0f);
+    for (int space = 0; space < subspaces; space++) {
+        int offset = subStart[space];
+        int subDim = subStart[space + 1] - offset;
+        for (int c = 0; c < centroidsPerSpace; c++)
+            table[(size_t)space * 256 + c] = dotProductScalar(query + offset, centroid(space, c), subDim);
+    }
+    return table;
+}
+
+float ProductQuantizer::score(const vector<float>& table, const uint8_t* code) const {
+    const float* t = table.data();
+    float sum = 0.0f;
+    for (int space = 0; space < subspaces; space++, t += 256)
+        sum += t[code[space]];
+    return sum;
+}
+
+
+// ---------------- FULL PRECISION SPILL FILE ----------------
+FullPrecisionFile::~FullPrecisionFile() {
+    close();
+}
+
+bool FullPrecisionFile::open(const string& newPath, int newDim) {
+    close();
+    fd = ::open(newPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    path = newPath;
+    dim = newDim;
+    return true;
+}
+
+void FullPrecisionFile::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        unlink(path.c_str());
+    }
+    fd = -1;
+    dim = 0;
+}
+
+bool FullPrecisionFile::write(int docID, const float* row) {
+    if (fd < 0) return false;
+    size_t bytes = (size_t)dim * sizeof(float);
+    return pwrite(fd, row, bytes, (off_t)docID * bytes) == (ssize_t)bytes;
+}
+
+bool FullPrecisionFile::read(int docID, vector<float>& out) const {
+    if (fd < 0) return false;
+    out.resize(dim);
+    size_t bytes = (size_t)dim * sizeof(float);
+    return pread(fd, out.data(), bytes, (off_t)docID * bytes) == (ssize_t)bytes;
+}
+
+
+// ---------------- QUANTIZED STORE ----------------
+void QuantizedEmbeddings::build(EmbeddingStorage newMode, int subspaces, const EmbeddingMatrix& source) {
+    clear();
+    mode = newMode;
+    dim = source.dimension();
+    if (dim == 0 || mode == EmbeddingStorage::Float) {
+        dim = 0;
+        return;
+    }
+
+    // k-means cost grows with the sample, so PQ trains on fewer rows
+    size_t maxSamples = (mode == EmbeddingStorage::PQ) ? 4096 : 20000;
+    vector<const float*> samples;
+    source.forEach([&](int docID, const float* row) {
+        if (samples.size() < maxSamples) samples.push_back(row);
+    });
+
+    if (mode == EmbeddingStorage::Int8) {
+        sq.train(samples, dim);
+        codeSize = sq.codeSize();
+    } else {
+        if (subspaces <= 0) subspaces = max(1, dim / 4);
+        pq.train(samples, dim, subspaces);
+        codeSize = pq.codeSize();
+    }
+
+    source.forEach([&](int docID, const float* row) {
+        add(docID, row);
+    });
+}
+
+void QuantizedEmbeddings::clear() {
+    dim = 0;
+    codeSize = 0;
+    codes.clear();
+    codes.shrink_to_fit();
+    present.clear();
+    presentCount = 0;
+}
+
+bool QuantizedEmbeddings::add(int docID, const float* unitVec) {
+    if (!trained() || docID < 0) return false;
+
+    if ((size_t)docID >= present.size()) {
+        present.resize(docID + 1, 0);
+        codes.resize(present.size() * codeSize, 0);
+    }
+
+    uint8_t* code = codes.data() + (size_t)docID * codeSize;
+    if (mode == EmbeddingStorage::Int8) sq.encode(unitVec, code);
+    else pq.encode(unitVec, code);
+
+    if (!present[docID]) {
+        present[docID] = 1;
+        presentCount++;
+    }
+    return true;
+}
+
+bool QuantizedEmbeddings::has(int docID) const {
+    return docID >= 0 && (size_t)docID < present.size() && present[docID];
+}
+
+vector<pair<int, float>> QuantizedEmbeddings::search(const float* unitQuery, int k) const {
+    if (!trained() || k <= 0) return {};
+
+    // Min-heap of the best k (score, docID)
+    priority_queue<pair<float, int>, vector<pair<float, int>>, greater<pair<float, int>>> heap;
+
+    auto offer = [&](int docID, float s) {
+        if ((int)heap.size() < k) heap.push({s, docID});
+        else if (s > heap.top().first) { heap.pop(); heap.push({s, docID}); }
+    };
+
+    if (mode == EmbeddingStorage::Int8) {
+        auto table = sq.prepare(unitQuery);
+        for (size_t docID = 0; docID < present.size(); docID++) {
+            if (present[docID]) offer(docID, sq.score(table, codes.data() + docID * codeSize));
+        }
+    } else {
+        auto table = pq.prepare(unitQuery);
+        for (size_t docID = 0; docID < present.size(); docID++) {
+            if (present[docID]) offer(docID, pq.score(table, codes.data() + docID * codeSize));
+        }
+    }
+
+    vector<pair<int, float>> out;
+    while (!heap.empty()) {
+        out.push_back({heap.top().second, heap.top().first});
+        heap.pop();
+    }
+    reverse(out.begin(), out.end());
+    return out;
+}
+
+size_t QuantizedEmbeddings::memoryBytes() const {
+    size_t bytes = codes.capacity() + present.capacity();
+    if (mode == EmbeddingStorage::Int8) bytes += 2 * dim * sizeof(float);
+    else bytes += pq.codebookBytes();
+    return bytes;
+}
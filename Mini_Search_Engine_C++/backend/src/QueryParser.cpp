@@ -0,0 +1,311 @@
+#include "QueryParser.h"
+#include <cctype>
+
+using namespace std;
+
+bool QueryNode::empty() const {
+    switch (op) {
+        case QueryOp::Term:
+        case QueryOp::DocFilter:
+        case QueryOp::Wildcard:  return text.empty();
+        case QueryOp::Phrase:    return words.empty();
+        default:                 return children.empty() && optional.empty();
+    }
+}
+
+
+// ---------------- TOKENIZER ----------------
+namespace {
+
+enum class TokenType { Word, Phrase, Doc, And, Or, Not, Open, Close };
+
+struct Token {
+    TokenType type;
+    string text;
+};
+
+vector<Token> tokenize(const string& query) {
+    vector<Token> tokens;
+    size_t i = 0, n = query.size();
+
+    while (i < n) {
+        char c = query[i];
+        if (isspace(static_cast<unsigned char>(c))) { i++; continue; }
+
+        if (c == '(') { tokens.push_back({TokenType::Open, ""}); i++; continue; }
+        if (c == ')') { tokens.push_back({TokenType::Close, ""}); i++; continue; }
+
+        if (c == '"') {
+            size_t close = query.find('"', i + 1);
+            if (close == string::npos) { i++; continue; }   // stray quote
+            tokens.push_back({TokenType::Phrase, query.substr(i + 1, close - i - 1)});
+            i = close + 1;
+            continue;
+        }
+
+        size_t start = i;
+        while (i < n && !isspace(static_cast<unsigned char>(query[i])) &&
+               query[i] != '(' && query[i] != ')' && query[i] != '"')
+            i++;
+        string word = query.substr(start, i - start);
+
+        if (word == "AND" || word == "&&") tokens.push_back({TokenType::And, ""});
+        else if (word == "OR" || word == "||") tokens.push_back({TokenType::Or, ""});
+        else if (word == "NOT") tokens.push_back({TokenType::Not, ""});
+        else if (word.size() > 1 && word[0] == '-') {
+            tokens.push_back({TokenType::Not, ""});
+            i = start + 1;      // re-read the operand after the '-'
+        }
+        else {
+            string lower = word;
+            for (char& ch : lower) ch = tolower(static_cast<unsigned char>(ch));
+
+            if (lower.size() > 4 && lower.compare(0, 4, "doc:") == 0)
+                tokens.push_back({TokenType::Doc, lower.substr(4)});
+            else
+                tokens.push_back({TokenType::Word, word});
+        }
+    }
+    return tokens;
+}
+
+
+// ---------------- RECURSIVE DESCENT ----------------
+class Parser {
+public:
+    Parser(vector<Token> tokens, string (*normalizeWord)(const string&))
+        : tokens(move(tokens)), normalizeWord(normalizeWord) {}
+
+    QueryNode parse() {
+        QueryNode root = parseBag();
+        // Unbalanced ')' ends a bag early; keep reading what follows
+        while (pos < tokens.size()) {
+            pos++;
+            QueryNode rest = parseBag();
+            if (rest.empty()) continue;
+            QueryNode both;
+            both.op = QueryOp::And;
+            if (!root.empty()) both.children.push_back(move(root));
+            both.children.push_back(move(rest));
+            root = simplify(move(both));
+        }
+        return root;
+    }
+
+private:
+    vector<Token> tokens;
+    string (*normalizeWord)(const string&);
+    size_t pos = 0;
+
+    // Each group costs a few stack frames; a '(' deeper than this is
+    // ignored, so a query cannot recurse without bound
+    static constexpr int kMaxNesting = 64;
+    int nesting = 0;
+
+    // Lower-cased pattern keeping only characters an index term can hold;
+    // a pattern with no literal character at all ("*", "??") is dropped
+    static string wildcardPattern(const string& raw) {
+        string pattern;
+        bool literal = false;
+        for (char c : raw) {
+            if (c == '*' || c == '?') {
+                if (c == '*' && !pattern.empty() && pattern.back() == '*') continue;
+                pattern += c;
+            } else if (isalnum(static_cast<unsigned char>(c)) || string("+#.-_:").find(c) != string::npos) {
+                pattern += tolower(static_cast<unsigned char>(c));
+                literal = true;
+            }
+        }
+        return literal ? pattern : "";
+    }
+
+    bool at(TokenType type) const { return pos < tokens.size() && tokens[pos].type == type; }
+
+    static QueryNode simplify(QueryNode node) {
+        if (node.op != QueryOp::And && node.op != QueryOp::Or) return node;
+
+        // Flatten nested nodes of the same operator and drop empty operands
+        vector<QueryNode> flat;
+        for (QueryNode& child : node.children) {
+            if (child.empty()) continue;
+            if (child.op == node.op && child.optional.empty()) {
+                for (QueryNode& grand : child.children) flat.push_back(move(grand));
+            } else {
+                flat.push_back(move(child));
+            }
+        }
+        node.children = move(flat);
+
+        if (node.children.size() == 1 && node.optional.empty())
+            return move(node.children[0]);
+        return node;
+    }
+
+    // Operands side by side: plain words are alternatives, anything else is
+    // a required clause
+    QueryNode parseBag() {
+        vector<QueryNode> words, required;
+
+        while (pos < tokens.size() && !at(TokenType::Close)) {
+            if (at(TokenType::And) || at(TokenType::Or)) { pos++; continue; }   // dangling operator
+
+            size_t before = pos;
+            QueryNode operand = parseOr();
+            if (pos == before) { pos++; continue; }
+            if (operand.empty()) continue;
+
+            bool plainWord = operand.op == QueryOp::Term || operand.op == QueryOp::Wildcard;
+            if (plainWord && pos - before == 1) words.push_back(move(operand));
+            else required.push_back(move(operand));
+        }
+
+        QueryNode bag;
+        if (required.empty()) {
+            bag.op = QueryOp::Or;
+            bag.children = move(words);
+        } else {
+            bag.op = QueryOp::And;
+            bag.children = move(required);
+            bag.optional = move(words);
+        }
+        return simplify(move(bag));
+    }
+
+    QueryNode parseOr() {
+        QueryNode node;
+        node.op = QueryOp::Or;
+        node.children.push_back(parseAnd());
+
+        while (at(TokenType::Or)) {
+            pos++;
+            if (pos == tokens.size() || at(TokenType::Close)) break;
+            node.children.push_back(parseAnd());
+        }
+        return simplify(move(node));
+    }
+
+    QueryNode parseAnd() {
+        QueryNode node;
+        node.op = QueryOp::And;
+        node.children.push_back(parseUnary());
+
+        while (at(TokenType::And)) {
+            pos++;
+            if (pos == tokens.size() || at(TokenType::Close) || at(TokenType::Or)) break;
+            node.children.push_back(parseUnary());
+        }
+        return simplify(move(node));
+    }
+
+    QueryNode parseUnary() {
+        // NOT NOT a == a: only whether a run of NOTs is odd matters
+        bool negate = false;
+        while (at(TokenType::Not)) {
+            negate = !negate;
+            pos++;
+        }
+
+        QueryNode operand = parsePrimary();
+        if (!negate || operand.empty()) return operand;
+        if (operand.op == QueryOp::Not) return move(operand.children[0]);
+
+        QueryNode node;
+        node.op = QueryOp::Not;
+        node.children.push_back(move(operand));
+        return node;
+    }
+
+    QueryNode parsePrimary() {
+        QueryNode node;
+        node.op = QueryOp::Term;
+        if (pos >= tokens.size()) return node;
+
+        const Token& token = tokens[pos];
+        switch (token.type) {
+            case TokenType::Open: {
+                pos++;
+                if (nesting >= kMaxNesting) {
+                    // What follows is read as part of the enclosing group
+                    while (at(TokenType::Open)) pos++;
+                    return node;
+                }
+                nesting++;
+                node = parseBag();
+                nesting--;
+                if (at(TokenType::Close)) pos++;
+                return node;
+            }
+            case TokenType::Word:
+                pos++;
+                if (token.text.find_first_of("*?") != string::npos) {
+                    node.op = QueryOp::Wildcard;
+                    node.text = wildcardPattern(token.text);
+                    return node;
+                }
+                node.text = normalizeWord(token.text);
+                return node;
+            case TokenType::Doc:
+                pos++;
+                node.op = QueryOp::DocFilter;
+                node.text = token.text;
+                return node;
+            case TokenType::Phrase: {
+                pos++;
+                string word;
+                size_t i = 0;
+                const string& text = token.text;
+                while (i < text.size()) {
+                    while (i < text.size() && isspace(static_cast<unsigned char>(text[i]))) i++;
+                    size_t start = i;
+                    while (i < text.size() && !isspace(static_cast<unsigned char>(text[i]))) i++;
+                    word = normalizeWord(text.substr(start, i - start));
+                    if (!word.empty()) node.words.push_back(word);
+                }
+
+                // A one-word quote is an ordinary term
+                if (node.words.size() == 1) {
+                    node.text = node.words[0];
+                    node.words.clear();
+                } else if (!node.words.empty()) {
+                    node.op = QueryOp::Phrase;
+                }
+                return node;
+            }
+            default:
+                return node;    // operator in operand position; caller skips it
+        }
+    }
+};
+
+}
+
+QueryNode parseQuery(const string& query, string (*normalizeWord)(const string&)) {
+    return Parser(tokenize(query), normalizeWord).parse();
+}
+
+string describeQuery(const QueryNode& node) {
+    switch (node.op) {
+        case QueryOp::Term:
+            return node.text;
+        case QueryOp::DocFilter:
+            return "doc:" + node.text;
+        case QueryOp::Wildcard:
+            return node.text;
+        case QueryOp::Phrase: {
+            string out = "\"";
+            for (size_t i = 0; i < node.words.size(); i++)
+                out += (i ? " " : "") + node.words[i];
+            return out + "\"";
+        }
+        case QueryOp::Not:
+            return "(NOT " + describeQuery(node.children[0]) + ")";
+        default: {
+            string out = node.op == QueryOp::And ? "(AND" : "(OR";
+            for (const QueryNode& child : node.children)
+                out += " " + describeQuery(child);
+            for (const QueryNode& child : node.optional)
+                out += " ~" + describeQuery(child);
+            return out + ")";
+        }
+    }
+}
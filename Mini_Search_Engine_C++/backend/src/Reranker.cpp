@@ -0,0 +1,229 @@
+#include "Reranker.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+
+// ---------------- MODEL ----------------
+string RerankModel::kindName() const {
+    switch (kind) {
+        case Kind::Linear: return "linear";
+        case Kind::GBDT:   return "gbdt";
+        default:           return "none";
+    }
+}
+
+bool RerankModel::load(const string& path, string& error) {
+    ifstream in(path);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+    stringstream buffer;
+    buffer << in.rdbuf();
+    return loadFromString(buffer.str(), error);
+}
+
+bool RerankModel::loadFromString(const string& text, string& error) {
+    RerankModel model;
+    const vector<string>& known = Reranker::knownFeatures();
+
+    auto featureIndex = [&](const string& name) {
+        auto it = find(model.featureNames.begin(), model.featureNames.end(), name);
+        return it == model.featureNames.end() ? -1 : (int)(it - model.featureNames.begin());
+    };
+
+    stringstream lines(text);
+    string line;
+    int lineNo = 0;
+    bool inTree = false;
+
+    while (getline(lines, line)) {
+        lineNo++;
+        size_t hash = line.find('#');
+        if (hash != string::npos) line.resize(hash);
+
+        stringstream ss(line);
+        string keyword;
+        if (!(ss >> keyword)) continue;
+
+        auto fail = [&](const string& why) {
+            error = "line " + to_string(lineNo) + ": " + why;
+            return false;
+        };
+
+        if (model.kind == Kind::None) {
+            if (keyword == "linear") model.kind = Kind::Linear;
+            else if (keyword == "gbdt") model.kind = Kind::GBDT;
+            else return fail("model must start with 'linear' or 'gbdt'");
+            continue;
+        }
+
+        if (model.kind == Kind::Linear) {
+            if (keyword == "bias") {
+                if (!(ss >> model.bias)) return fail("bias needs a value");
+            } else if (keyword == "weight") {
+                string name;
+                float weight;
+                if (!(ss >> name >> weight)) return fail("weight needs a feature and a value");
+                if (find(known.begin(), known.end(), name) == known.end()) return fail("unknown feature " + name);
+                int index = featureIndex(name);
+                if (index >= 0) model.weights[index] = weight;
+                else {
+                    model.featureNames.push_back(name);
+                    model.weights.push_back(weight);
+                }
+            } else {
+                return fail("unexpected '" + keyword + "'");
+            }
+            continue;
+        }
+
+        // GBDT
+        if (keyword == "features") {
+            if (!model.trees.empty()) return fail("features must come before the trees");
+            string name;
+            while (ss >> name) {
+                if (find(known.begin(), known.end(), name) == known.end()) return fail("unknown feature " + name);
+                if (featureIndex(name) < 0) model.featureNames.push_back(name);
+            }
+        } else if (keyword == "tree") {
+            if (inTree) return fail("tree inside a tree");
+            model.trees.emplace_back();
+            inTree = true;
+        } else if (keyword == "split" || keyword == "leaf") {
+            if (!inTree) return fail(keyword + " outside a tree");
+            Node node;
+            if (keyword == "split") {
+                if (!(ss >> node.feature >> node.threshold >> node.left >> node.right))
+                    return fail("split needs feature threshold left right");
+                if (node.feature < 0 || node.feature >= (int)model.featureNames.size())
+                    return fail("split feature out of range");
+            } else if (!(ss >> node.value)) {
+                return fail("leaf needs a value");
+            }
+            model.trees.back().push_back(node);
+        } else if (keyword == "end") {
+            if (!inTree) return fail("'end' outside a tree");
+            inTree = false;
+
+            // Children must point forward so evaluation always terminates
+            const vector<Node>& tree = model.trees.back();
+            if (tree.empty()) return fail("empty tree");
+            for (size_t i = 0; i < tree.size(); i++) {
+                if (tree[i].feature < 0) continue;
+                for (int child : {tree[i].left, tree[i].right})
+                    if (child <= (int)i || child >= (int)tree.size()) return fail("bad child index in tree");
+            }
+        } else {
+            return fail("unexpected '" + keyword + "'");
+        }
+    }
+
+    if (model.kind == Kind::None) { error = "empty model"; return false; }
+    if (inTree) { error = "unterminated tree"; return false; }
+    if (model.featureNames.empty()) { error = "model uses no features"; return false; }
+
+    *this = move(model);
+    return true;
+}
+
+double RerankModel::score(const float* x) const {
+    if (kind == Kind::Linear) {
+        double sum = bias;
+        for (size_t i = 0; i < weights.size(); i++) sum += weights[i] * x[i];
+        return sum;
+    }
+
+    double sum = 0.0;
+    for (const vector<Node>& tree : trees) {
+        int at = 0;
+        while (tree[at].feature >= 0)
+            at = x[tree[at].feature] < tree[at].threshold ? tree[at].left : tree[at].right;
+        sum += tree[at].value;
+    }
+    return sum;
+}
+
+
+// ---------------- RERANKER ----------------
+const vector<string>& Reranker::knownFeatures() {
+    static const vector<string> names = {
+        "first_phase",  // score from the first phase (fused)
+        "bm25",         // BM25F without the proximity boost
+        "proximity",    // query terms / minimal covering span
+        "phrase",       // fraction of quoted phrases present
+        "title",        // fraction of query terms in the title
+        "semantic",     // cosine similarity to the query embedding
+        "freshness"     // exp(-age in days / 30)
+    };
+    return names;
+}
+
+void Reranker::addFeature(const string& name, Extractor extractor) {
+    extractors.push_back({name, move(extractor)});
+}
+
+vector<pair<int, double>> Reranker::rerank(const vector<pair<int, double>>& candidates,
+                                           const RerankModel& model, RerankStats* stats) const {
+    auto start = chrono::steady_clock::now();
+
+    // Column-major feature matrix: one extractor pass over all candidates
+    // at a time keeps each extractor's state hot
+    const vector<string>& names = model.features();
+    size_t n = candidates.size(), width = names.size();
+    vector<float> features(n * width, 0.0f);
+
+    for (size_t f = 0; f < width; f++) {
+        auto it = find_if(extractors.begin(), extractors.end(),
+                          [&](const pair<string, Extractor>& e) { return e.first == names[f]; });
+        if (it == extractors.end()) continue;   // not available for this query: 0
+        for (size_t i = 0; i < n; i++)
+            features[i * width + f] = it->second(candidates[i].first);
+    }
+    auto extracted = chrono::steady_clock::now();
+
+    vector<pair<int, double>> ranked(n);
+    for (size_t i = 0; i < n; i++)
+        ranked[i] = {candidates[i].first, model.score(features.data() + i * width)};
+
+    stable_sort(ranked.begin(), ranked.end(), [](const pair<int, double>& a, const pair<int, double>& b) {
+        return a.second > b.second;
+    });
+    auto end = chrono::steady_clock::now();
+
+    if (stats) {
+        stats->applied = true;
+        stats->model = model.kindName();
+        stats->candidates = n;
+        stats->featureMs = chrono::duration<double, milli>(extracted - start).count();
+        stats->modelMs = chrono::duration<double, milli>(end - extracted).count();
+        stats->elapsedMs = chrono::duration<double, milli>(end - start).count();
+    }
+    return ranked;
+}
+
+
+// ---------------- LATENCY BUDGET ----------------
+void RerankBudget::record(size_t candidates, double elapsedMs) {
+    if (candidates == 0) return;
+    msPerCandidate.push_back(elapsedMs / candidates);
+    if (msPerCandidate.size() > kSamples) msPerCandidate.pop_front();
+}
+
+size_t RerankBudget::depthFor(double budgetMs, size_t minDepth, size_t maxDepth) const {
+    if (maxDepth < minDepth) maxDepth = minDepth;
+    if (budgetMs <= 0 || msPerCandidate.empty()) return maxDepth;
+
+    vector<double> sorted(msPerCandidate.begin(), msPerCandidate.end());
+    size_t rank = min(sorted.size() - 1, (size_t)(sorted.size() * 0.99));
+    nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    double p99 = sorted[rank];
+
+    if (p99 <= 0) return maxDepth;
+    size_t affordable = (size_t)(budgetMs / p99);
+    return max(minDepth, min(maxDepth, affordable));
+}
@@ -0,0 +1,282 @@
+#include "RoaringBitmap.h"
+#include <algorithm>
+
+using namespace std;
+
+
+// ---------------- CONTAINERS ----------------
+bool RoaringBitmap::Container::contains(uint16_t low) const {
+    if (isBitmap()) return (bits[low >> 6] >> (low & 63)) & 1;
+    return binary_search(values.begin(), values.end(), low);
+}
+
+void RoaringBitmap::Container::add(uint16_t low) {
+    if (isBitmap()) {
+        uint64_t bit = 1ULL << (low & 63);
+        if (!(bits[low >> 6] & bit)) { bits[low >> 6] |= bit; count++; }
+        return;
+    }
+
+    if (values.empty() || values.back() < low) values.push_back(low);
+    else {
+        auto it = lower_bound(values.begin(), values.end(), low);
+        if (*it == low) return;
+        values.insert(it, low);
+    }
+    count++;
+    if (count > kArrayMax) toBitmap();
+}
+
+void RoaringBitmap::Container::toBitmap() {
+    bits.assign(kBitmapWords, 0);
+    for (uint16_t low : values) bits[low >> 6] |= 1ULL << (low & 63);
+    values.clear();
+    values.shrink_to_fit();
+}
+
+void RoaringBitmap::Container::shrink() {
+    if (!isBitmap() || count > kArrayMax) return;
+
+    values.reserve(count);
+    for (size_t w = 0; w < kBitmapWords; w++) {
+        uint64_t word = bits[w];
+        while (word) {
+            values.push_back((uint16_t)(w * 64 + __builtin_ctzll(word)));
+            word &= word - 1;
+        }
+    }
+    bits.clear();
+    bits.shrink_to_fit();
+}
+
+RoaringBitmap::Container RoaringBitmap::andContainers(const Container& a, const Container& b) {
+    Container out;
+    out.key = a.key;
+
+    if (a.isBitmap() && b.isBitmap()) {
+        out.bits.resize(kBitmapWords);
+        for (size_t w = 0; w < kBitmapWords; w++) {
+            out.bits[w] = a.bits[w] & b.bits[w];
+            out.count += __builtin_popcountll(out.bits[w]);
+        }
+        out.shrink();
+        return out;
+    }
+
+    if (a.isBitmap() || b.isBitmap()) {
+        const Container& array = a.isBitmap() ? b : a;
+        const Container& bitmap = a.isBitmap() ? a : b;
+        for (uint16_t low : array.values)
+            if (bitmap.contains(low)) out.values.push_back(low);
+    } else {
+        set_intersection(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(),
+                         back_inserter(out.values));
+    }
+    out.count = out.values.size();
+    return out;
+}
+
+RoaringBitmap::Container RoaringBitmap::orContainers(const Container& a, const Container& b) {
+    Container out;
+    out.key = a.key;
+
+    if (!a.isBitmap() && !b.isBitmap() && a.count + b.count <= kArrayMax) {
+        set_union(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(),
+                  back_inserter(out.values));
+        out.count = out.values.size();
+        return out;
+    }
+
+    out.bits.assign(kBitmapWords, 0);
+    for (const Container* side : {&a, &b}) {
+        if (side->isBitmap()) {
+            for (size_t w = 0; w < kBitmapWords; w++) out.bits[w] |= side->bits[w];
+        } else {
+            for (uint16_t low : side->values) out.bits[low >> 6] |= 1ULL << (low & 63);
+        }
+    }
+    for (uint64_t word : out.bits) out.count += __builtin_popcountll(word);
+    out.shrink();
+    return out;
+}
+
+RoaringBitmap::Container RoaringBitmap::andNotContainers(const Container& a, const Container& b) {
+    Container out;
+    out.key = a.key;
+
+    if (a.isBitmap()) {
+        out.bits = a.bits;
+        if (b.isBitmap()) {
+            for (size_t w = 0; w < kBitmapWords; w++) out.bits[w] &= ~b.bits[w];
+        } else {
+            for (uint16_t low : b.values) out.bits[low >> 6] &= ~(1ULL << (low & 63));
+        }
+        for (uint64_t word : out.bits) out.count += __builtin_popcountll(word);
+        out.shrink();
+        return out;
+    }
+
+    for (uint16_t low : a.values)
+        if (!b.contains(low)) out.values.push_back(low);
+    out.count = out.values.size();
+    return out;
+}
+
+size_t RoaringBitmap::andCount(const Container& a, const Container& b) {
+    if (a.isBitmap() && b.isBitmap()) {
+        size_t count = 0;
+        for (size_t w = 0; w < kBitmapWords; w++)
+            count += __builtin_popcountll(a.bits[w] & b.bits[w]);
+        return count;
+    }
+
+    const Container& probe = (a.count <= b.count) ? a : b;
+    const Container& other = (a.count <= b.count) ? b : a;
+    size_t count = 0;
+    if (probe.isBitmap()) return andContainers(a, b).count;
+    for (uint16_t low : probe.values)
+        if (other.contains(low)) count++;
+    return count;
+}
+
+
+// ---------------- BITMAP ----------------
+RoaringBitmap::Container* RoaringBitmap::find(uint16_t key) {
+    auto it = lower_bound(containers.begin(), containers.end(), key,
+                          [](const Container& c, uint16_t k) { return c.key < k; });
+    return (it != containers.end() && it->key == key) ? &*it : nullptr;
+}
+
+const RoaringBitmap::Container* RoaringBitmap::find(uint16_t key) const {
+    return const_cast<RoaringBitmap*>(this)->find(key);
+}
+
+RoaringBitmap RoaringBitmap::fromSorted(const vector<int>& docIDs) {
+    RoaringBitmap bitmap;
+    for (int docID : docIDs) bitmap.add(docID);
+    return bitmap;
+}
+
+void RoaringBitmap::add(int docID) {
+    if (docID < 0) return;
+    uint16_t key = (uint32_t)docID >> 16;
+    uint16_t low = (uint32_t)docID & 0xFFFF;
+
+    // Ascending inserts always land in the last container
+    if (containers.empty() || containers.back().key < key) {
+        containers.emplace_back();
+        containers.back().key = key;
+        containers.back().add(low);
+        return;
+    }
+
+    Container* c = find(key);
+    if (!c) {
+        auto it = lower_bound(containers.begin(), containers.end(), key,
+                              [](const Container& x, uint16_t k) { return x.key < k; });
+        it = containers.insert(it, Container());
+        it->key = key;
+        c = &*it;
+    }
+    c->add(low);
+}
+
+bool RoaringBitmap::contains(int docID) const {
+    if (docID < 0) return false;
+    const Container* c = find((uint32_t)docID >> 16);
+    return c && c->contains((uint32_t)docID & 0xFFFF);
+}
+
+size_t RoaringBitmap::cardinality() const {
+    size_t total = 0;
+    for (const Container& c : containers) total += c.count;
+    return total;
+}
+
+size_t RoaringBitmap::memoryBytes() const {
+    size_t bytes = containers.capacity() * sizeof(Container);
+    for (const Container& c : containers)
+        bytes += c.values.capacity() * sizeof(uint16_t) + c.bits.capacity() * sizeof(uint64_t);
+    return bytes;
+}
+
+vector<int> RoaringBitmap::toVector() const {
+    vector<int> out;
+    out.reserve(cardinality());
+
+    for (const Container& c : containers) {
+        int high = (int)c.key << 16;
+        if (!c.isBitmap()) {
+            for (uint16_t low : c.values) out.push_back(high | low);
+            continue;
+        }
+        for (size_t w = 0; w < kBitmapWords; w++) {
+            uint64_t word = c.bits[w];
+            while (word) {
+                out.push_back(high | (int)(w * 64 + __builtin_ctzll(word)));
+                word &= word - 1;
+            }
+        }
+    }
+    return out;
+}
+
+RoaringBitmap RoaringBitmap::intersect(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap out;
+    size_t i = 0, j = 0;
+    while (i < a.containers.size() && j < b.containers.size()) {
+        const Container& ca = a.containers[i];
+        const Container& cb = b.containers[j];
+        if (ca.key < cb.key) i++;
+        else if (ca.key > cb.key) j++;
+        else {
+            Container c = andContainers(ca, cb);
+            if (c.count) out.containers.push_back(move(c));
+            i++; j++;
+        }
+    }
+    return out;
+}
+
+RoaringBitmap RoaringBitmap::unite(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap out;
+    size_t i = 0, j = 0;
+    while (i < a.containers.size() || j < b.containers.size()) {
+        if (j == b.containers.size() || (i < a.containers.size() && a.containers[i].key < b.containers[j].key))
+            out.containers.push_back(a.containers[i++]);
+        else if (i == a.containers.size() || b.containers[j].key < a.containers[i].key)
+            out.containers.push_back(b.containers[j++]);
+        else
+            out.containers.push_back(orContainers(a.containers[i++], b.containers[j++]));
+    }
+    return out;
+}
+
+RoaringBitmap RoaringBitmap::subtract(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap out;
+    size_t j = 0;
+    for (const Container& ca : a.containers) {
+        while (j < b.containers.size() && b.containers[j].key < ca.key) j++;
+
+        if (j == b.containers.size() || b.containers[j].key != ca.key) {
+            out.containers.push_back(ca);
+            continue;
+        }
+        Container c = andNotContainers(ca, b.containers[j]);
+        if (c.count) out.containers.push_back(move(c));
+    }
+    return out;
+}
+
+size_t RoaringBitmap::intersectCount(const RoaringBitmap& a, const RoaringBitmap& b) {
+    size_t count = 0;
+    size_t i = 0, j = 0;
+    while (i < a.containers.size() && j < b.containers.size()) {
+        const Container& ca = a.containers[i];
+        const Container& cb = b.containers[j];
+        if (ca.key < cb.key) i++;
+        else if (ca.key > cb.key) j++;
+        else { count += andCount(ca, cb); i++; j++; }
+    }
+    return count;
+}
@@ -12,9 +12,13 @@
 #include <filesystem>
 #include <unordered_set>
 #include <chrono>
+#include <cstring>
 #define CPPHTTPLIB_OPENSSL_SUPPORT // UST be defined before httplib.h
 #include "httplib.h"
 #include "json.hpp" // nlohmann/json
+#include "VectorKernels.h"
+#include "PostingOps.h"
+#include "IndexFormat.h"
 #include <fcntl.h>      // For file control (open)
 #include <sys/mman.h>   // For memory mapping (mmap)
 #include <sys/stat.h>   // For file size (fstat)
@@ -29,38 +33,29 @@ using namespace std;
 
 
 
+SearchEngine::~SearchEngine() {
+    if (saveThread.joinable()) saveThread.join();
+    documentEmbeddings.clear();
+    releaseIndexMapping();
+}
+
 int SearchEngine::getDocumentCount() const {
     return documents.size();
 }
 
 int SearchEngine::getVocabularySize() const {
-    return invertedIndex.size();
+    return termDocIDs.size();
 }
 
 
 
-// ---------------- COSINE SIMILARITY ----------------
-double SearchEngine::cosineSimilarity(const vector<float>& A, const vector<float>& B) {
-    if (A.empty() || B.empty() || A.size() != B.size()) return 0.0;
-    
-    double dotProduct = 0.0, normA = 0.0, normB = 0.0;
-    for (size_t i = 0; i < A.size(); ++i) {
-        dotProduct += A[i] * B[i];
-        normA += A[i] * A[i];
-        normB += B[i] * B[i];
-    }
-    
-    if (normA == 0.0 || normB == 0.0) return 0.0;
-    return dotProduct / (sqrt(normA) * sqrt(normB));
-}
-
 // ---------------- OLLAMA LOCAL API CALL ----------------
 vector<float> SearchEngine::getOpenAIEmbedding(const string& text) {
     // Calling your LOCAL machine, not the internet!
     httplib::Client cli("http://localhost:11434"); 
 
     json req_body = {
-        {"model", "nomic-embed-text"},
+        {"model", embeddingModel},
         {"prompt", text}
     };
 
@@ -77,85 +72,21 @@ vector<float> SearchEngine::getOpenAIEmbedding(const string& text) {
 }
 
 
-// ---------------- EDIT DISTANCE (LEVENSHTEIN) ----------------
-int editDistance(const string& a, const string& b) {
-
-    int n = a.size();
-    int m = b.size();
-
-    vector<vector<int>> dp(n + 1, vector<int>(m + 1));
-
-    for (int i = 0; i <= n; i++)
-        dp[i][0] = i;
-
-    for (int j = 0; j <= m; j++)
-        dp[0][j] = j;
-
-    for (int i = 1; i <= n; i++) {
-        for (int j = 1; j <= m; j++) {
-
-            if (a[i - 1] == b[j - 1])
-                dp[i][j] = dp[i - 1][j - 1];
-            else {
-                dp[i][j] = 1 + min({
-                    dp[i - 1][j],     // delete
-                    dp[i][j - 1],     // insert
-                    dp[i - 1][j - 1]  // replace
-                });
-            }
-        }
+// ---------------- CACHE INVALIDATION ----------------
+void SearchEngine::invalidateCache() {
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        cacheMap.clear();
+        lruList.clear();
     }
 
-    return dp[n][m];
-}
-
-
-
-
-
-
-// ---------------- SPELL CORRECTION ----------------
-string correctWord(
-    const string& queryWord,
-    const unordered_map<string,
-    unordered_map<int, Posting>>& index
-){
-    string bestWord = queryWord;
-    int bestDist = INT_MAX;
-    int bestDF = -1;
-
-    for(const auto& [word, postingMap] : index){
-
-        int dist = editDistance(queryWord, word);
-
-        if(dist < bestDist){
-            bestDist = dist;
-            bestWord = word;
-            bestDF = postingMap.size();
-        }
-        else if(dist == bestDist){
-            int df = postingMap.size();
-
-            if(df > bestDF){
-                bestWord = word;
-                bestDF = df;
-            }
-        }
+    // Scoring tables and the impact index are rebuilt on their next use
+    {
+        lock_guard<mutex> lock(scoringMutex);
+        scoringTablesStale = true;
     }
-
-    return bestWord;
-}
-
-
-
-
-
-
-// ---------------- CACHE INVALIDATION ----------------
-void SearchEngine::invalidateCache() {
-    lock_guard<mutex> lock(cacheMutex);
-    cacheMap.clear();
-    lruList.clear();
+    lock_guard<mutex> lock(impactMutex);
+    impactIndexStale = true;
 }
 
 
@@ -217,72 +148,108 @@ static string normalize(const string& word) {
 
 
 
-// ---------------- SPLIT QUERY ----------------
-static vector<string> splitQuery(const string& query) {
-    vector<string> tokens;
-    string word;
-    stringstream ss(query);
+// ---------------- TITLE FIELD ----------------
+// A document's name without directory and extension, split on every
+// non-alphanumeric character ("ml_notes-v2.txt" -> ml, notes, v2)
+static vector<string> titleTerms(const string& name) {
+    size_t slash = name.find_last_of("/\\");
+    string base = slash == string::npos ? name : name.substr(slash + 1);
+    size_t dot = base.find_last_of('.');
+    if (dot != string::npos && dot > 0) base = base.substr(0, dot);
 
-    while (ss >> word) {
-        word = normalize(word);
-        if (!word.empty())
-            tokens.push_back(word);
+    vector<string> terms;
+    string word;
+    for (char c : base) {
+        if (isalnum(static_cast<unsigned char>(c))) word += tolower(static_cast<unsigned char>(c));
+        else if (!word.empty()) { terms.push_back(word); word.clear(); }
     }
-
-    return tokens;
+    if (!word.empty()) terms.push_back(word);
+    return terms;
 }
 
-// ---------------- PHRASE MATCH ----------------
-static int countPhraseOccurrences(
-    const vector<int>& pos1,
-    const vector<int>& pos2,
-    vector<int>& phrasePositions
-) {
-    int i = 0, j = 0, count = 0;
-
-    while (i < pos1.size() && j < pos2.size()) {
-
-        if (pos2[j] == pos1[i] + 1) {
-            count++;
-            phrasePositions.push_back(pos1[i]);
-            i++; j++;
-        }
-        else if (pos2[j] > pos1[i] + 1)
-            i++;
-        else
-            j++;
-    }
 
-    return count;
-}
 
 
 
-static int countProximityMatches(
-    const vector<int>& pos1,
-    const vector<int>& pos2,
-    int k,
-    vector<int>& proxPositions
+// ---------------- QUERY TERMS ----------------
+// Spell-corrects every word the query asks to find (negated words are left
+// alone: correcting an exclusion would silently exclude something else).
+// Ties between equally close terms go to the one in more documents.
+static void correctQueryTerms(
+    QueryNode& node,
+    bool negated,
+    const SpellDictionary& dictionary,
+    const unordered_map<string, vector<int>>& index,
+    string& suggestion
 ) {
+    auto df = [&](const string& word) -> size_t {
+        auto it = index.find(word);
+        return it == index.end() ? 0 : it->second.size();
+    };
+    auto correct = [&](string& term) {
+        if (index.find(term) != index.end()) return;
 
-    int i = 0, j = 0, count = 0;
+        string corrected = dictionary.correct(term, df);
+        if (corrected != term)
+            suggestion = corrected;
+        term = corrected;
+    };
 
-    while (i < pos1.size() && j < pos2.size()) {
+    if (negated && node.op != QueryOp::Not) return;
 
-        int gap = abs(pos2[j] - pos1[i]) - 1;
+    switch (node.op) {
+        case QueryOp::Term:   correct(node.text); break;
+        case QueryOp::Phrase: for (string& word : node.words) correct(word); break;
+        case QueryOp::Not:    correctQueryTerms(node.children[0], !negated, dictionary, index, suggestion); break;
+        default:
+            for (QueryNode& child : node.children) correctQueryTerms(child, negated, dictionary, index, suggestion);
+            for (QueryNode& child : node.optional) correctQueryTerms(child, negated, dictionary, index, suggestion);
+    }
+}
 
-        if (gap <= k && gap >= 0) {
-            count++;
-            proxPositions.push_back(pos1[i]);
-            i++; j++;
-        }
-        else if (pos1[i] < pos2[j])
-            i++;
-        else
-            j++;
+// Words and phrases that contribute to BM25 (everything not under a NOT).
+// Phrase words are scored as ordinary terms as well.
+static void collectScoringTerms(
+    const QueryNode& node,
+    bool negated,
+    vector<string>& terms,
+    vector<const QueryNode*>& phrases
+) {
+    switch (node.op) {
+        case QueryOp::Term:
+            if (!negated) terms.push_back(node.text);
+            break;
+        case QueryOp::Phrase:
+            if (!negated) {
+                terms.insert(terms.end(), node.words.begin(), node.words.end());
+                phrases.push_back(&node);
+            }
+            break;
+        case QueryOp::Wildcard:
+            // Expansions score like the words themselves
+            if (!negated) terms.insert(terms.end(), node.words.begin(), node.words.end());
+            break;
+        case QueryOp::DocFilter:
+            break;
+        case QueryOp::Not:
+            collectScoringTerms(node.children[0], !negated, terms, phrases);
+            break;
+        default:
+            for (const QueryNode& child : node.children) collectScoringTerms(child, negated, terms, phrases);
+            for (const QueryNode& child : node.optional) collectScoringTerms(child, negated, terms, phrases);
     }
+}
 
-    return count;
+// A word or OR of words: the original bag-of-words query
+static bool isPlainBag(const QueryNode& node) {
+    auto plainWord = [](const QueryNode& n) {
+        return n.op == QueryOp::Term || n.op == QueryOp::Wildcard;
+    };
+    if (plainWord(node)) return true;
+    if (node.op != QueryOp::Or) return false;
+    for (const QueryNode& child : node.children)
+        if (!plainWord(child)) return false;
+    return true;
 }
 
 
@@ -290,6 +257,7 @@ static int countProximityMatches(
 
 // ---------------- ADD DOCUMENT PATH ----------------
 void SearchEngine::addDocument(const string& path) {
+    lock_guard<recursive_mutex> writes(writeMutex);
     documents.push_back(path);
 }
 
@@ -315,6 +283,7 @@ void SearchEngine::addDocumentContent(const string& name, const string& content)
 */
 
 void SearchEngine::addDocumentContent(const string& name, const string& content) {
+    lock_guard<recursive_mutex> writes(writeMutex);
     invalidateCache();
 
     string finalName = name;
@@ -339,7 +308,7 @@ void SearchEngine::addDocumentContent(const string& name, const string& content)
     documents.push_back(finalName);
     int docID = documents.size() - 1;
 
-    documentContents[docID] = content;
+    docStore.add(docID, storedText(content));
 
     // 🔹 Track vocabulary size before indexing
     size_t oldVocabSize = invertedIndex.size();
@@ -359,6 +328,7 @@ void SearchEngine::addDocumentContent(const string& name, const string& content)
     if (invertedIndex.size() > oldVocabSize) {
         for (auto& [word, postingMap] : invertedIndex) {
             trie.insert(word);
+            spellDictionary.add(word);
         }
     }
 }
@@ -388,15 +358,21 @@ void SearchEngine::buildIndex() {
 void SearchEngine::buildIndex() {
     // just to check whether this function is called or not 
     // std::cout << "buildIndex() called\n";
+    lock_guard<recursive_mutex> writes(writeMutex);
     invalidateCache();
 
     auto start = std::chrono::high_resolution_clock::now(); // To track time
 
-    invertedIndex.clear();
+    clearPostings();
+    indexGeneration++;   // docIDs are reassigned: the next save is a full one
+    termDocIDs.clear();
+    denseTermBitmaps.clear();
     documentLength.clear();
-    documentContents.clear();
+    docStore.clear();
+    passageBoundsCache.clear();
     avgDocLength = 0.0;
     trie = Trie();
+    spellDictionary.clear();
 
 
     int totalDocs = documents.size();
@@ -414,7 +390,7 @@ void SearchEngine::buildIndex() {
     // Per-thread local structures
     vector<unordered_map<string, unordered_map<int, Posting>>> localIndexes(numThreads);
     vector<unordered_map<int, int>> localDocLengths(numThreads);
-    vector<unordered_map<int, string>> localContents(numThreads); // New
+    vector<vector<pair<int, string>>> localContents(numThreads); // New, ascending docIDs
 
     for (unsigned int t = 0; t < numThreads; t++) {
 
@@ -434,24 +410,18 @@ void SearchEngine::buildIndex() {
 
             for (int docID = start; docID < end; docID++) {
 
-                ifstream file(documents[docID]);
-                if (!file) continue;
-
-                stringstream buffer;
-                buffer << file.rdbuf();
-
-                string content = buffer.str();
+                // Streamed from the file; only the stored prefix is kept
+                string stored;
+                if (!indexDocumentLocal(
+                        docID,
+                        fileText(documents[docID], &stored),
+                        localIndexes[t],
+                        localDocLengths[t]))
+                    continue;
 
                 // Safe: each docID handled by exactly one thread
                 // documentContents[docID] = content;
-                localContents[t][docID] = content;
-
-                indexDocumentLocal(
-                    docID,
-                    content,
-                    localIndexes[t],
-                    localDocLengths[t]
-                );
+                localContents[t].emplace_back(docID, move(stored));
             }
         });
     }
@@ -461,16 +431,18 @@ void SearchEngine::buildIndex() {
         th.join();
 
     // ---------------- MERGE PHASE ----------------
+    unique_lock<shared_mutex> postingsLock(postingsMutex);
     for (unsigned int t = 0; t < threads.size(); t++) {
 
-        // 🔥 Merge document contents first
+        // 🔥 Merge document contents first (threads own ascending docID
+        // ranges, so the store's blocks stay in docID order)
         for (auto& [docID, content] : localContents[t]) {
-            documentContents[docID] = content;
+            docStore.add(docID, content);
         }
 
         for (auto& [word, postingMap] : localIndexes[t]) {
 
-            auto& globalPostingMap = invertedIndex[word];
+            PostingMap& globalPostingMap = writablePostings(word);
 
             for (auto& [docID, posting] : postingMap) {
                 globalPostingMap[docID] = posting;
@@ -481,6 +453,7 @@ void SearchEngine::buildIndex() {
             documentLength[docID] = length;
         }
     }
+    postingsLock.unlock();
 
     // Recompute average document length
     double totalLength = 0;
@@ -489,10 +462,15 @@ void SearchEngine::buildIndex() {
 
     avgDocLength = totalLength / documentLength.size();
 
+    rebuildTermDocIDs();
+
     // Rebuild Trie after merge
     trie = Trie();
-    for (auto& [word, _] : invertedIndex)
+    spellDictionary.clear();
+    for (auto& [word, _] : invertedIndex) {
         trie.insert(word);
+        spellDictionary.add(word);
+    }
     
     auto end = std::chrono::high_resolution_clock::now();
 
@@ -516,25 +494,148 @@ void SearchEngine::buildIndex() {
 
 
 
+// ---------------- STREAMING INGESTION ----------------
+// Splits text arriving in pieces of any size into words the way
+// `stream >> word` does (runs of non-whitespace); a word cut by the end of
+// one piece is completed by the next, so the words are the same however
+// the text is split. wordStart() is the byte offset, in the whole text,
+// of the word being handed to onWord.
+class WordStream {
+public:
+    template <typename OnWord>
+    void feed(const char* data, size_t size, OnWord&& onWord) {
+        size_t i = 0;
+        while (i < size) {
+            if (isspace((unsigned char)data[i])) {
+                if (!partial.empty()) {
+                    onWord(partial);
+                    partial.clear();
+                }
+                i++;
+                continue;
+            }
+            size_t start = i;
+            if (partial.empty()) partialStart = consumed + i;
+            while (i < size && !isspace((unsigned char)data[i])) i++;
+            partial.append(data + start, i - start);
+        }
+        consumed += size;
+    }
+
+    template <typename OnWord>
+    void finish(OnWord&& onWord) {
+        if (!partial.empty()) onWord(partial);
+        partial.clear();
+    }
+
+    long long wordStart() const { return partialStart; }
+    long long bytes() const { return consumed; }
+
+private:
+    string partial;
+    long long partialStart = 0;
+    long long consumed = 0;
+};
+
+// Reads the file a window at a time through one buffer; stored (if given)
+// receives its first kMaxStoredText bytes
+TextSource SearchEngine::fileText(const string& path, string* stored) {
+    return [path, stored](const function<void(const char*, size_t)>& feed) {
+        ifstream file(path, ios::binary);
+        if (!file) return false;
+
+        vector<char> window(kIngestWindow);
+        size_t total = 0;
+        while (file.read(window.data(), window.size()) || file.gcount() > 0) {
+            size_t got = file.gcount();
+            if (stored && stored->size() < kMaxStoredText)
+                stored->append(window.data(), min(got, kMaxStoredText - stored->size()));
+            feed(window.data(), got);
+            total += got;
+        }
+        if (total > kMaxStoredText)
+            cout << "Streamed " << path << " (" << (total >> 20) << " MB); the document store keeps its first "
+                 << (kMaxStoredText >> 20) << " MB" << endl;
+        return true;
+    };
+}
+
+string SearchEngine::storedText(const string& content) {
+    return content.size() > kMaxStoredText ? content.substr(0, kMaxStoredText) : content;
+}
+
+// Past the stored prefix of a large document the store has nothing, so
+// a slice reaching there is read from the document's file
+string SearchEngine::documentSlice(int docID, long long begin, long long end) const {
+    string text = docStore.slice(docID, begin, end);
+    begin = max(0LL, begin);
+    if (end <= (long long)kMaxStoredText || (long long)text.size() >= end - begin ||
+        docID < 0 || docID >= (int)documents.size())
+        return text;
+
+    ifstream file(documents[docID], ios::binary);
+    if (!file.seekg(begin)) return text;
+    text.resize(end - begin);
+    file.read(&text[0], text.size());
+    text.resize(file.gcount());
+    return text;
+}
+
+
 // ---------------- INDEX DOCUMENT ----------------
 void SearchEngine::indexDocument(int docID, const string& content) {
-    stringstream ss(content);
-    string word;
+    indexDocumentStream(docID, [&](const function<void(const char*, size_t)>& feed) {
+        feed(content.data(), content.size());
+        return true;
+    });
+}
+
+// Positions and offsets carry across the pieces of text, so a document
+// indexed a window at a time ends up exactly as if indexed whole
+bool SearchEngine::indexDocumentStream(int docID, const TextSource& text) {
     int position = 0;
     long long offset = 0;
+    unique_lock<shared_mutex> postingsLock(postingsMutex);
+
+    // First posting of a term in this document: add the docID to its lists
+    auto posting = [&](const string& term) -> Posting& {
+        if (!lazyTerms.empty()) materializeLazyTerm(term);
+        Posting& p = writablePostings(term)[docID];
+        if (p.frequency == 0 && p.titleFrequency == 0) {
+            vector<int>& ids = termDocIDs[term];
+            if (ids.empty() || ids.back() < docID) ids.push_back(docID);
+            else ids.insert(lower_bound(ids.begin(), ids.end(), docID), docID);
+
+            auto dense = denseTermBitmaps.find(term);
+            if (dense != denseTermBitmaps.end()) dense->second.add(docID);
+            else if (preferBitmap(ids.size(), documents.size()))
+                denseTermBitmaps[term] = RoaringBitmap::fromSorted(ids);
+            trie.insert(term);
+            spellDictionary.add(term);
+        }
+        return p;
+    };
 
-    while (ss >> word) {
+    auto addWord = [&](const string& word) {
         string clean = normalize(word);
-        if (clean.empty()) continue;
+        if (clean.empty()) return;
 
-        auto& posting = invertedIndex[clean][docID];
-        posting.frequency++;
-        posting.positions.push_back(position);
-        posting.offsets.push_back(offset);
-        trie.insert(clean);
+        Posting& body = posting(clean);
+        body.frequency++;
+        body.positions.push_back(position);
+        body.offsets.push_back(offset);
 
         offset += word.length() + 1;
         position++;
+    };
+
+    WordStream words;
+    if (!text([&](const char* data, size_t size) { words.feed(data, size, addWord); })) return false;
+    words.finish(addWord);
+
+    for (const string& term : titleTerms(documents[docID])) {
+        Posting& title = posting(term);
+        if (title.titleFrequency < 255) title.titleFrequency++;
     }
 
     documentLength[docID] = position;
@@ -545,6 +646,7 @@ void SearchEngine::indexDocument(int docID, const string& content) {
         total += p.second;
     
     avgDocLength = total / documentLength.size();
+    return true;
 }
 
 
@@ -552,262 +654,1321 @@ void SearchEngine::indexDocument(int docID, const string& content) {
 
 
 
-// Local Indexing Function for Multithreading 
+// ---------------- PHRASE MATCHING ----------------
+// Intersect the words' docID lists (shortest first), then verify positions
+// only inside the surviving documents.
+unordered_map<int, SearchEngine::PhraseHit> SearchEngine::matchPhraseDocs(const vector<string>& words) {
+    unordered_map<int, PhraseHit> hits;
 
-void SearchEngine::indexDocumentLocal(
-    int docID,
-    const string& content,
-    unordered_map<string, unordered_map<int, Posting>>& localIndex,
-    unordered_map<int, int>& localDocLength
-) {
-    stringstream ss(content);
-    string word;
-    int position = 0;
-    long long offset = 0;
+    vector<const vector<int>*> lists;
+    for (const string& word : words) {
+        auto it = termDocIDs.find(word);
+        if (it == termDocIDs.end()) return hits;
+        lists.push_back(&it->second);
+    }
 
-    while (ss >> word) {
+    vector<shared_ptr<const PostingMap>> postings;
+    for (const string& word : words) {
+        postings.push_back(postingsFor(word));
+        if (!postings.back()) return hits;
+    }
 
-        string clean = normalize(word);
-        if (clean.empty()) continue;
+    vector<const vector<int>*> positions(words.size());
+    for (int docID : intersectSorted(lists)) {
+        bool present = true;
+        for (size_t i = 0; i < words.size() && present; i++) {
+            auto it = postings[i]->find(docID);
+            present = it != postings[i]->end();
+            if (present) positions[i] = &it->second.positions;
+        }
+        if (!present) continue;
 
-        auto& posting = localIndex[clean][docID];
-        posting.frequency++;
-        posting.positions.push_back(position);
-        posting.offsets.push_back(offset);
+        int firstMatch;
+        int count = matchPhrase(positions, firstMatch);
+        if (count == 0) continue;
 
-        offset += word.length() + 1;
-        position++;
-    }
+        const Posting& head = postings[0]->at(docID);
+        size_t idx = lower_bound(head.positions.begin(), head.positions.end(), firstMatch) - head.positions.begin();
 
-    localDocLength[docID] = position;
+        PhraseHit& hit = hits[docID];
+        hit.count = count;
+        hit.offset = idx < head.offsets.size() ? head.offsets[idx] : 0;
+    }
+    return hits;
 }
 
 
 
 
+// ---------------- WILDCARD EXPANSION ----------------
+// Fills each Wildcard node with at most maxExpansions dictionary terms,
+// highest DF first. The trie walk is bounded by node count and time, and the
+// chosen terms by their total postings, so "a*" cannot blow up a request.
+void SearchEngine::expandWildcards(QueryNode& node, int maxExpansions) {
+    for (QueryNode& child : node.children) expandWildcards(child, maxExpansions);
+    for (QueryNode& child : node.optional) expandWildcards(child, maxExpansions);
+    if (node.op != QueryOp::Wildcard) return;
 
+    bool truncated = false;
+    vector<pair<size_t, string>> ranked;
+    for (string& word : trie.match(node.text, wildcardNodeBudget, wildcardTimeBudgetMs, truncated)) {
+        auto it = termDocIDs.find(word);
+        if (it != termDocIDs.end()) ranked.push_back({it->second.size(), move(word)});
+    }
 
+    size_t keep = min(ranked.size(), (size_t)max(0, maxExpansions));
+    if (keep < ranked.size()) truncated = true;
+    partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end(),
+                 [](const pair<size_t, string>& a, const pair<size_t, string>& b) {
+                     return a.first > b.first;
+                 });
+
+    node.words.clear();
+    size_t postings = 0;
+    for (size_t i = 0; i < keep; i++) {
+        if (!node.words.empty() && postings + ranked[i].first > wildcardPostingBudget) {
+            truncated = true;
+            break;
+        }
+        postings += ranked[i].first;
+        node.words.push_back(ranked[i].second);
+    }
+    node.truncated = truncated;
+}
 
-double computeBM25(
-    int tf,
-    int df,
-    int docLen,
-    int N,
-    double avgdl
-){
-    double k1 = 1.5;
-    double b  = 0.75;
-
-    double idf = log(1 + ((N - df + 0.5) / (df + 0.5)));
-    
 
-    double norm = (double)docLen / (double)avgdl;
 
 
-    double num = tf * (k1 + 1.0);
-    double den = tf + k1 *
-        (1.0 - b + b * norm);
+// ---------------- BOOLEAN QUERY PLAN ----------------
+vector<int> SearchEngine::allDocIDs() const {
+    vector<int> ids(documents.size());
+    for (size_t i = 0; i < ids.size(); i++) ids[i] = i;
+    return ids;
+}
 
-    return idf * (num / den);
+const RoaringBitmap* SearchEngine::denseBitmap(const string& term) const {
+    auto it = denseTermBitmaps.find(term);
+    return it == denseTermBitmaps.end() ? nullptr : &it->second;
 }
 
+// Upper bound on the documents a node can match, from posting lengths (and
+// exact bitmap counts when two dense terms meet in an AND)
+size_t SearchEngine::estimateMatches(const QueryNode& node) const {
+    size_t N = documents.size();
 
+    auto df = [&](const string& word) -> size_t {
+        auto it = termDocIDs.find(word);
+        return it == termDocIDs.end() ? 0 : it->second.size();
+    };
 
+    switch (node.op) {
+        case QueryOp::Term:
+            return df(node.text);
+        case QueryOp::Phrase: {
+            size_t best = N;
+            for (const string& word : node.words) best = min(best, df(word));
+            return best;
+        }
+        case QueryOp::DocFilter:
+            return N;
+        case QueryOp::Wildcard: {
+            size_t total = 0;
+            for (const string& word : node.words) total += df(word);
+            return min(N, total);
+        }
+        case QueryOp::Not:
+            return N - min(N, estimateMatches(node.children[0]));
+        case QueryOp::And: {
+            size_t best = N;
+            vector<const RoaringBitmap*> dense;
+            for (const QueryNode& child : node.children) {
+                if (child.op == QueryOp::Not) continue;
+                best = min(best, estimateMatches(child));
+                if (child.op == QueryOp::Term && denseBitmap(child.text))
+                    dense.push_back(denseBitmap(child.text));
+            }
+            if (dense.size() >= 2)
+                best = min(best, RoaringBitmap::intersectCount(*dense[0], *dense[1]));
+            return best;
+        }
+        case QueryOp::Or: {
+            size_t total = 0;
+            for (const QueryNode& child : node.children) total += estimateMatches(child);
+            return min(N, total);
+        }
+    }
+    return N;
+}
 
+// Terms are answered straight from termDocIDs; anything else is evaluated
+// into storage
+const vector<int>* SearchEngine::evaluateOperand(const QueryNode& node, QueryRun& run, vector<int>& storage, QueryPlanStep* step) {
+    if (node.op != QueryOp::Term) {
+        storage = evaluateQuery(node, run, step);
+        return &storage;
+    }
 
+    static const vector<int> none;
+    auto it = termDocIDs.find(node.text);
+    const vector<int>* list = (it == termDocIDs.end()) ? &none : &it->second;
 
-// ======================= SEARCH API =======================
-vector<SearchResult> SearchEngine::searchAPI(const string& query, int page, int limit) {
+    if (step) {
+        step->node = node.text;
+        step->strategy = "postings";
+        step->estimate = step->matches = list->size();
+    }
+    return list;
+}
 
-    // Cache key must combine query, page, and limit
-    string cacheKey = query + "_p" + to_string(page) + "_l" + to_string(limit);
+// Sorted docIDs matching node
+vector<int> SearchEngine::evaluateQuery(const QueryNode& node, QueryRun& run, QueryPlanStep* step) {
+    int N = documents.size();
+    vector<int> result;
+    string strategy;
+
+    // Child plan steps are filled one at a time, so the pointer stays valid
+    auto childStep = [&]() -> QueryPlanStep* {
+        if (!step) return nullptr;
+        step->children.emplace_back();
+        return &step->children.back();
+    };
 
-    
-    {
-        lock_guard<mutex> lock(cacheMutex); 
-        if (cacheMap.find(cacheKey) != cacheMap.end()) {
-            lruList.erase(cacheMap[cacheKey].second);
-            lruList.push_front(cacheKey);
-            cacheMap[cacheKey].second = lruList.begin();
-            return cacheMap[cacheKey].first; 
+    switch (node.op) {
+        case QueryOp::Term: {
+            vector<int> storage;
+            result = *evaluateOperand(node, run, storage, nullptr);
+            strategy = "postings";
+            break;
         }
-    }
 
-    vector<SearchResult> results;
-    vector<string> terms = splitQuery(query);
+        case QueryOp::Phrase: {
+            auto& hits = run.phraseHits[describeQuery(node)];
+            hits = matchPhraseDocs(node.words);
+            for (auto& [docID, _] : hits) result.push_back(docID);
+            sort(result.begin(), result.end());
+            strategy = "gallop+positions";
+            break;
+        }
 
+        case QueryOp::DocFilter: {
+            for (int docID = 0; docID < N; docID++) {
+                string name = fs::path(documents[docID]).filename().string();
+                for (char& c : name) c = tolower(static_cast<unsigned char>(c));
+                if (name.find(node.text) != string::npos) result.push_back(docID);
+            }
+            strategy = "scan";
+            break;
+        }
 
-    string suggestedWord = "";
+        case QueryOp::Wildcard: {
+            // Union straight over the expansions' docID lists; no per-term
+            // copies or posting maps are built
+            vector<const vector<int>*> lists;
+            size_t total = 0;
+            for (const string& word : node.words) {
+                auto it = termDocIDs.find(word);
+                if (it == termDocIDs.end()) continue;
+                lists.push_back(&it->second);
+                total += it->second.size();
+
+                if (QueryPlanStep* wordStep = childStep()) {
+                    wordStep->node = word;
+                    wordStep->strategy = "postings";
+                    wordStep->estimate = wordStep->matches = it->second.size();
+                }
+            }
 
-    for (string& term : terms) {
-        if (invertedIndex.find(term) == invertedIndex.end()) {
+            if (preferBitmap(total, N) && lists.size() > 2) {
+                result = unionBitmap(lists, N);
+                strategy = "expand+bitmap";
+            } else {
+                result = unionSorted(lists);
+                strategy = "expand+merge";
+            }
+            if (node.truncated) strategy += " (truncated)";
+            break;
+        }
 
-            string corrected = correctWord(term, invertedIndex);
+        case QueryOp::Not: {
+            // Only reached for a NOT that is not inside an AND
+            vector<int> storage;
+            const vector<int>* inner = evaluateOperand(node.children[0], run, storage, childStep());
+            result = subtractSorted(allDocIDs(), *inner);
+            strategy = "complement";
+            break;
+        }
 
-            if(corrected != term)
-                suggestedWord = corrected;
+        case QueryOp::And: {
+            vector<const QueryNode*> positives, negatives;
+            for (const QueryNode& child : node.children) {
+                if (child.op == QueryOp::Not) negatives.push_back(&child.children[0]);
+                else positives.push_back(&child);
+            }
 
-            term = corrected;
-        }
-    }
+            // Cheapest operands first: an empty one ends the conjunction
+            // before the expensive ones (phrases, filters) are evaluated
+            sort(positives.begin(), positives.end(), [&](const QueryNode* a, const QueryNode* b) {
+                return estimateMatches(*a) < estimateMatches(*b);
+            });
+
+            vector<vector<int>> storage(positives.size() + negatives.size());
+            vector<const vector<int>*> lists;
+            bool emptyOperand = false;
+
+            // Dense terms are not merged as lists: their bitmaps are
+            // intersected directly or used as membership filters
+            vector<const RoaringBitmap*> denseFilters;
+
+            for (size_t i = 0; i < positives.size() && !emptyOperand; i++) {
+                const RoaringBitmap* dense = positives[i]->op == QueryOp::Term ? denseBitmap(positives[i]->text) : nullptr;
+                if (dense) {
+                    denseFilters.push_back(dense);
+                    if (QueryPlanStep* denseStep = childStep()) {
+                        denseStep->node = positives[i]->text;
+                        denseStep->strategy = "roaring";
+                        denseStep->estimate = denseStep->matches = dense->cardinality();
+                    }
+                    emptyOperand = dense->empty();
+                    continue;
+                }
+
+                lists.push_back(evaluateOperand(*positives[i], run, storage[i], childStep()));
+                emptyOperand = lists.back()->empty();
+            }
 
+            vector<bool> negationApplied(negatives.size(), false);
+
+            if (emptyOperand) {
+                strategy = "short-circuit";
+            } else if (lists.empty() && !denseFilters.empty()) {
+                // Only dense terms: AND / AND NOT stay compressed until the end
+                RoaringBitmap acc = *denseFilters[0];
+                for (size_t i = 1; i < denseFilters.size(); i++)
+                    acc = RoaringBitmap::intersect(acc, *denseFilters[i]);
+
+                for (size_t i = 0; i < negatives.size(); i++) {
+                    const RoaringBitmap* dense = negatives[i]->op == QueryOp::Term ? denseBitmap(negatives[i]->text) : nullptr;
+                    if (!dense) continue;
+                    acc = RoaringBitmap::subtract(acc, *dense);
+                    negationApplied[i] = true;
+                    if (QueryPlanStep* denseStep = childStep()) {
+                        denseStep->node = "(NOT " + negatives[i]->text + ")";
+                        denseStep->strategy = "roaring-andnot";
+                        denseStep->estimate = dense->cardinality();
+                    }
+                }
+
+                result = acc.toVector();
+                strategy = "roaring";
+            } else if (lists.empty()) {
+                result = allDocIDs();
+                strategy = "all";
+            } else {
+                if (lists.size() == 1) {
+                    result = *lists[0];
+                    strategy = "single";
+                } else {
+                    size_t shortest = lists[0]->size();
+                    for (const vector<int>* list : lists) shortest = min(shortest, list->size());
+
+                    if (preferBitmap(shortest, N)) {
+                        result = intersectBitmap(lists, N);
+                        strategy = "bitmap";
+                    } else {
+                        result = intersectSorted(lists);
+                        strategy = string("adaptive/") + activeIntersectKernel();
+                    }
+                }
+
+                if (!denseFilters.empty()) {
+                    size_t kept = 0;
+                    for (int docID : result) {
+                        bool inAll = true;
+                        for (const RoaringBitmap* dense : denseFilters)
+                            if (!dense->contains(docID)) { inAll = false; break; }
+                        if (inAll) result[kept++] = docID;
+                    }
+                    result.resize(kept);
+                    strategy += "+roaring-filter";
+                }
+            }
 
+            // NOT is pushed down as a skip filter over the surviving docIDs
+            // instead of being materialized as a complement
+            for (size_t i = 0; i < negatives.size() && !result.empty(); i++) {
+                if (negationApplied[i]) continue;
+
+                QueryPlanStep* filterStep = childStep();
+                QueryPlanStep* operandStep = nullptr;
+                if (filterStep) {
+                    filterStep->node = "(NOT " + describeQuery(*negatives[i]) + ")";
+                    filterStep->strategy = "skip-filter";
+                    filterStep->children.emplace_back();
+                    operandStep = &filterStep->children.back();
+                }
+
+                size_t before = result.size();
+                const RoaringBitmap* dense = negatives[i]->op == QueryOp::Term ? denseBitmap(negatives[i]->text) : nullptr;
+
+                if (dense) {
+                    // Membership test instead of galloping through a long list
+                    result.erase(remove_if(result.begin(), result.end(),
+                                           [&](int docID) { return dense->contains(docID); }),
+                                 result.end());
+                    if (operandStep) {
+                        operandStep->node = negatives[i]->text;
+                        operandStep->strategy = "roaring";
+                        operandStep->estimate = operandStep->matches = dense->cardinality();
+                    }
+                } else {
+                    const vector<int>* excluded = evaluateOperand(*negatives[i], run, storage[positives.size() + i], operandStep);
+                    result = subtractSorted(result, *excluded);
+                }
+
+                if (filterStep) {
+                    filterStep->estimate = operandStep->estimate;
+                    filterStep->matches = before - result.size();   // documents removed
+                }
+            }
 
-    if (terms.empty()) return results;
+            // Optional words only rank documents
+            for (const QueryNode& child : node.optional) {
+                QueryPlanStep* optionalStep = childStep();
+                if (!optionalStep) break;
+                optionalStep->node = "~" + describeQuery(child);
+                optionalStep->strategy = "score-only";
+                optionalStep->estimate = estimateMatches(child);
+            }
+            break;
+        }
 
-    unordered_map<int, int> docPresence;
+        case QueryOp::Or: {
+            bool allDense = true;
+            for (const QueryNode& child : node.children)
+                allDense = allDense && child.op == QueryOp::Term && denseBitmap(child.text);
+
+            if (allDense) {
+                RoaringBitmap acc;
+                for (const QueryNode& child : node.children) {
+                    const RoaringBitmap* dense = denseBitmap(child.text);
+                    acc = RoaringBitmap::unite(acc, *dense);
+                    if (QueryPlanStep* denseStep = childStep()) {
+                        denseStep->node = child.text;
+                        denseStep->strategy = "roaring";
+                        denseStep->estimate = denseStep->matches = dense->cardinality();
+                    }
+                }
+                result = acc.toVector();
+                strategy = "roaring";
+                break;
+            }
 
-    for (const string& term : terms) {
+            vector<vector<int>> storage(node.children.size());
+            vector<const vector<int>*> lists;
+            size_t total = 0;
 
-        if (invertedIndex.find(term) == invertedIndex.end())
-            return {};
+            for (size_t i = 0; i < node.children.size(); i++) {
+                lists.push_back(evaluateOperand(node.children[i], run, storage[i], childStep()));
+                total += lists.back()->size();
+            }
 
-        for (auto& [docID, posting] : invertedIndex[term]) {
-            docPresence[docID]++;
+            if (preferBitmap(total, N) && lists.size() > 2) {
+                result = unionBitmap(lists, N);
+                strategy = "bitmap";
+            } else {
+                result = unionSorted(lists);
+                strategy = "merge";
+            }
+            break;
         }
     }
 
-    vector<int> candidateDocs;
+    if (step) {
+        step->node = describeQuery(node);
+        step->strategy = strategy;
+        step->estimate = estimateMatches(node);
+        step->matches = result.size();
+    }
+    return result;
+}
+
+static json planToJson(const QueryPlanStep& step) {
+    json out = {
+        {"node", step.node},
+        {"strategy", step.strategy},
+        {"estimate", step.estimate},
+        {"matches", step.matches}
+    };
+    if (!step.children.empty()) {
+        out["children"] = json::array();
+        for (const QueryPlanStep& child : step.children)
+            out["children"].push_back(planToJson(child));
+    }
+    return out;
+}
 
-    // 🔥 NEW: Fetch the vector for the user's search query
-    vector<float> queryVector = getOpenAIEmbedding(query);
+string SearchEngine::explainQuery(const string& query, const SearchOptions& options) {
+    string suggestion;
+    QueryNode parsed = parseQuery(query, normalize);
+    correctQueryTerms(parsed, false, spellDictionary, termDocIDs, suggestion);
+    expandWildcards(parsed, options.maxExpansions);
 
-    // 🔥 NEW: Instead of candidateDocs, we score ALL documents in the corpus
-    // so we can find semantic matches even if there are 0 exact word matches!
-    vector<int> allDocs;
-    for (int i = 0; i < documents.size(); i++) {
-        allDocs.push_back(i);
+    json out = {{"query", describeQuery(parsed)}, {"suggestion", suggestion}};
+    if (parsed.empty()) {
+        out["plan"] = nullptr;
+        return out.dump();
     }
 
-    auto cmp = [](const SearchResult& a, const SearchResult& b) {
-        return a.score > b.score; 
-    };
-    priority_queue<SearchResult, vector<SearchResult>, decltype(cmp)> minHeap(cmp);
-    int maxHeapSize = page * limit;
+    QueryRun run;
+    QueryPlanStep root;
+    vector<int> storage;
+    evaluateOperand(parsed, run, storage, &root);
+    out["plan"] = planToJson(root);
+    return out.dump();
+}
 
-    // -------- RESULT GENERATION --------
-    for (int docID : allDocs) {
 
-        SearchResult res;
-        res.document = documents[docID];
-        res.suggestion = suggestedWord;
-        string& content = documentContents[docID];
 
-        // 1. Calculate BM25 (Lexical Score) exactly as before
-        double bm25Score = 0.0;
-        int N = documents.size();
 
-        for(const string& term : terms) {
-            if(invertedIndex[term].find(docID) != invertedIndex[term].end()) {
-                auto& posting = invertedIndex[term].at(docID);
-                bm25Score += computeBM25(posting.frequency, invertedIndex[term].size(), documentLength[docID], N, avgDocLength);
-            }
+// ---------------- SORTED DOCID LISTS ----------------
+// A bounded-memory load fills termDocIDs itself while scanning the posting
+// headers, since lazy terms have no postings in memory to derive them from
+void SearchEngine::rebuildTermDocIDs() {
+    denseTermBitmaps.clear();
+    if (lazyTerms.empty()) {
+        termDocIDs.clear();
+        termDocIDs.reserve(invertedIndex.size());
+        for (auto& [word, postingMap] : invertedIndex) {
+            vector<int>& ids = termDocIDs[word];
+            ids.reserve(postingMap->size());
+            for (auto& [docID, _] : *postingMap)
+                ids.push_back(docID);
         }
+    }
 
-        // [Keep your existing Phrase & Proximity boosts here if desired, 
-        // just ensure you check if terms exist in the doc first]
+    for (auto& [word, ids] : termDocIDs) {
+        sort(ids.begin(), ids.end());
+        if (preferBitmap(ids.size(), documents.size()))
+            denseTermBitmaps[word] = RoaringBitmap::fromSorted(ids);
+    }
+}
 
-        // 2. NEW: Calculate Semantic Score (Vector Math)
-        double semanticScore = 0.0;
-        if (!queryVector.empty() && documentEmbeddings.find(docID) != documentEmbeddings.end()) {
-            semanticScore = cosineSimilarity(queryVector, documentEmbeddings[docID]);
-        }
 
-        // 3. NEW: HYBRID COMBINATION
-        // BM25 usually ranges from 0 to 20+, Cosine Similarity is 0 to 1.
-        // We multiply the semantic score by 10 to give it weight alongside BM25.
-        res.score = bm25Score + (semanticScore * 10.0);
 
-        // Skip if score is 0 (no keyword match AND no semantic match)
-        if (res.score <= 0.0) continue;
 
-        // 4.  NEW: Safe Snippet Generation (Accounts for pure semantic matches)
-        if (!terms.empty() && invertedIndex.find(terms[0]) != invertedIndex.end() && invertedIndex[terms[0]].find(docID) != invertedIndex[terms[0]].end()) 
-        {
-            auto& posting = invertedIndex[terms[0]][docID];
-            res.frequency = posting.frequency;
-            if (!posting.positions.empty()) {
-                long long offset = posting.offsets[0];
-                int start = max(0LL, offset - 60);
-                int end = min((long long)content.size(), offset + 100);
-                res.snippet = content.substr(start, end - start);
-            }
-        } 
-        else 
-        {
-            // Semantic match fallback snippet (shows the beginning of the document)
-            res.frequency = 0;
-            res.snippet = content.substr(0, min((int)content.size(), 150)) + "...";
-        }
+// Local Indexing Function for Multithreading 
 
-        minHeap.push(res);
-        if (minHeap.size() > maxHeapSize) {
-            minHeap.pop(); 
-        }
-    }
+bool SearchEngine::indexDocumentLocal(
+    int docID,
+    const TextSource& text,
+    unordered_map<string, unordered_map<int, Posting>>& localIndex,
+    unordered_map<int, int>& localDocLength
+) {
+    int position = 0;
+    long long offset = 0;
 
-    // ... [Keep your existing heap extraction and LRU caching logic here exactly as before] ...
+    auto addWord = [&](const string& word) {
 
-    // NEW: Clear initial vector and extract target page
-    results.clear(); 
-    int startIndex = (page - 1) * limit;
+        string clean = normalize(word);
+        if (clean.empty()) return;
 
-    if (minHeap.size() > startIndex) {
-        vector<SearchResult> tempResults;
-        while (!minHeap.empty()) {
-            tempResults.push_back(minHeap.top());
-            minHeap.pop();
-        }
-        
-        // Reverse to get highest scores first
-        reverse(tempResults.begin(), tempResults.end());
+        auto& posting = localIndex[clean][docID];
+        posting.frequency++;
+        posting.positions.push_back(position);
+        posting.offsets.push_back(offset);
 
-        int endIndex = min((int)tempResults.size(), startIndex + limit);
-        for (int i = startIndex; i < endIndex; i++) {
-            results.push_back(tempResults[i]);
-        }
-    }
+        offset += word.length() + 1;
+        position++;
+    };
 
-    // 2. STORE RESULT IN CACHE BEFORE RETURNING
-    {
-        lock_guard<mutex> lock(cacheMutex); 
-        
-        // Evict the oldest query if we hit capacity
-        if (cacheMap.size() >= cacheCapacity) {
-            string last = lruList.back();
-            lruList.pop_back();
-            cacheMap.erase(last);
-        }
-        
-        // Insert new query at the front
-        lruList.push_front(cacheKey);
-        cacheMap[cacheKey] = {results, lruList.begin()};
+    WordStream words;
+    if (!text([&](const char* data, size_t size) { words.feed(data, size, addWord); })) return false;
+    words.finish(addWord);
+
+    for (const string& term : titleTerms(documents[docID])) {
+        auto& posting = localIndex[term][docID];
+        if (posting.titleFrequency < 255) posting.titleFrequency++;
     }
 
-    return results;
+    localDocLength[docID] = position;
+    return true;
 }
 
 
 
-// ---------------- AUTOCOMPLETE ----------------
-vector<string> SearchEngine::autocompleteAPI(const string& prefix) {
-    return trie.autocomplete(normalize(prefix));
-}
 
-// ---------------- CLEAR INDEX ----------------
-void SearchEngine::clearIndex() {
+
+
+
+// ---------------- BM25F SCORING TABLES ----------------
+// Field lengths are kept as one byte per document (Lucene's SmallFloat
+// encoding): exact below 24, then 4 significant bits per power of two
+static uint8_t lengthToNorm(int length) {
+    if (length < 24) return (uint8_t)max(0, length);
+    unsigned long long rest = length - 24;
+    int numBits = 64 - __builtin_clzll(rest);
+    if (numBits < 4) return (uint8_t)(24 + rest);
+
+    int shift = numBits - 4;
+    int encoded = ((rest >> shift) & 0x07) | ((shift + 1) << 3);
+    return (uint8_t)min(255, 24 + encoded);
+}
+
+static long long normToLength(uint8_t norm) {
+    if (norm < 24) return norm;
+    int bits = (norm - 24) & 0x07;
+    int shift = ((norm - 24) >> 3) - 1;
+    return 24 + (shift < 0 ? bits : (long long)(bits | 0x08) << shift);
+}
+
+double SearchEngine::bm25IDF(size_t df) const {
+    double N = documents.size();
+    return log(1 + ((N - df + 0.5) / (df + 0.5)));
+}
+
+// The tables as of now, rebuilt first if anything they depend on changed
+shared_ptr<const SearchEngine::ScoringTables> SearchEngine::currentScoringTables() {
+    lock_guard<mutex> lock(scoringMutex);
+    if (scoringTables && !scoringTablesStale) return scoringTables;
+
+    auto tables = make_shared<ScoringTables>();
+    tables->k1 = bm25K1;
+    tables->b = bm25B;
+    tables->bodyWeight = bodyWeight;
+    tables->docNorms.assign(documents.size(), 0);
+    tables->titleNorms.assign(documents.size(), 0);
+    double totalTitleLength = 0;
+    for (auto& [docID, length] : documentLength) {
+        if (docID < 0 || docID >= (int)tables->docNorms.size()) continue;
+        int titleLength = titleTerms(documents[docID]).size();
+        tables->docNorms[docID] = lengthToNorm(length);
+        tables->titleNorms[docID] = lengthToNorm(titleLength);
+        totalTitleLength += titleLength;
+    }
+    double avgTitleLength = documentLength.empty() ? 0.0 : totalTitleLength / documentLength.size();
+    tables->averageDocNorm = lengthToNorm((int)avgDocLength);
+    tables->averageTitleNorm = lengthToNorm((int)avgTitleLength);
+
+    // Weighted length normalization of each field for every norm byte:
+    // weight / (1 - b + b * len / avglen)
+    auto fillFactors = [&](float* factors, double weight, double avgLength) {
+        if (avgLength <= 0) avgLength = 1.0;
+        for (int norm = 0; norm < 256; norm++) {
+            double normalization = 1.0 - bm25B + bm25B * normToLength(norm) / avgLength;
+            factors[norm] = normalization > 0 ? weight / normalization : 0.0f;
+        }
+    };
+    fillFactors(tables->bodyNormFactor, bodyWeight, avgDocLength);
+    fillFactors(tables->titleNormFactor, titleWeight, avgTitleLength);
+
+    tables->termIDF.reserve(termDocIDs.size());
+    for (auto& [term, ids] : termDocIDs)
+        tables->termIDF[term] = bm25IDF(ids.size());
+
+    scoringTables = tables;
+    scoringTablesStale = false;
+    return scoringTables;
+}
+
+void SearchEngine::setBM25Params(double k1, double b) {
+    invalidateCache();
+    lock_guard<mutex> lock(scoringMutex);
+    bm25K1 = k1;
+    bm25B = b;
+}
+
+void SearchEngine::setFieldWeights(double body, double title) {
+    invalidateCache();
+    lock_guard<mutex> lock(scoringMutex);
+    bodyWeight = body;
+    titleWeight = title;
+}
+
+
+
+
+
+
+
+// ---------------- IMPACT-ORDERED INDEX ----------------
+// Same BM25 statistics as the DAAT path, precomputed per posting
+shared_ptr<const ImpactIndex> SearchEngine::buildImpactIndex() {
+    auto index = make_shared<ImpactIndex>();
+    shared_ptr<const ScoringTables> tables = currentScoringTables();
+
+    vector<pair<int, float>> scores;
+    for (auto& [term, ids] : termDocIDs) {
+        shared_ptr<const PostingMap> postingMap = postingsFor(term);
+        if (!postingMap) continue;
+        scores.clear();
+        float idf = termIDF(*tables, term, ids.size());
+        for (auto& [docID, posting] : *postingMap)
+            scores.push_back({docID, (float)tables->term(posting.frequency, posting.titleFrequency, idf, docID)});
+        index->addTerm(term, scores);
+    }
+    index->finalize();
+    return index;
+}
+
+// The index as of now, rebuilt first if the corpus changed since
+shared_ptr<const ImpactIndex> SearchEngine::currentImpactIndex() {
+    lock_guard<mutex> lock(impactMutex);
+    if (impactIndexStale || !impactIndex) {
+        impactIndex = buildImpactIndex();
+        impactIndexStale = false;
+    }
+    return impactIndex;
+}
+
+bool SearchEngine::loadRerankModel(const string& path, string& error) {
+    RerankModel model;
+    if (!model.load(path, error)) return false;
+
+    invalidateCache();
+    lock_guard<mutex> lock(rerankMutex);
+    rerankModel = move(model);
+    return true;
+}
+
+void SearchEngine::clearRerankModel() {
+    invalidateCache();
+    lock_guard<mutex> lock(rerankMutex);
+    rerankModel = RerankModel();
+}
+
+
+
+
+
+// ---------------- HYBRID FUSION ----------------
+SearchOptions SearchOptions::forMode(FusionMode mode) {
+    SearchOptions options;
+    options.fusion = mode;
+    // Raw cosine (0..1) needs scaling to sit next to BM25 (0..20+); the other
+    // modes put both legs on the same scale already
+    options.semanticWeight = (mode == FusionMode::Linear) ? 10.0 : 1.0;
+    return options;
+}
+
+// Highest-scoring n entries, best first
+static vector<pair<int, double>> topScores(const unordered_map<int, double>& scores, int n) {
+    vector<pair<int, double>> ranked(scores.begin(), scores.end());
+    auto byScore = [](const pair<int, double>& a, const pair<int, double>& b) {
+        return a.second > b.second;
+    };
+
+    if ((int)ranked.size() > n) {
+        partial_sort(ranked.begin(), ranked.begin() + n, ranked.end(), byScore);
+        ranked.resize(n);
+    } else {
+        sort(ranked.begin(), ranked.end(), byScore);
+    }
+    return ranked;
+}
+
+// Rescales a leg's scores in place (min-max to [0,1] or z-score)
+static void normalizeLeg(vector<pair<int, double>>& leg, FusionMode mode) {
+    if (leg.empty()) return;
+
+    if (mode == FusionMode::MinMax) {
+        double lo = leg.back().second, hi = leg.front().second;
+        for (auto& [docID, score] : leg)
+            score = (hi > lo) ? (score - lo) / (hi - lo) : 1.0;
+    }
+    else if (mode == FusionMode::ZScore) {
+        double mean = 0.0, var = 0.0;
+        for (auto& [docID, score] : leg) mean += score;
+        mean /= leg.size();
+        for (auto& [docID, score] : leg) var += (score - mean) * (score - mean);
+        double sd = sqrt(var / leg.size());
+        for (auto& [docID, score] : leg)
+            score = (sd > 0.0) ? (score - mean) / sd : 0.0;
+    }
+}
+
+// Combines the ranked lexical and semantic candidate lists. Linear mode keeps
+// the original raw-score formula (BM25 is exact for every candidate); RRF
+// uses ranks only; MinMax/ZScore normalize each leg over its own list and a
+// document missing from a leg gets that leg's lowest normalized score.
+static unordered_map<int, double> fuseScores(
+    vector<pair<int, double>> lexical,
+    vector<pair<int, double>> semantic,
+    const unordered_map<int, double>& allLexicalScores,
+    const SearchOptions& options
+) {
+    unordered_map<int, double> fused;
+
+    if (options.fusion == FusionMode::Linear) {
+        for (auto& [docID, score] : lexical)
+            fused[docID] = options.lexicalWeight * score;
+        for (auto& [docID, sim] : semantic) {
+            auto it = allLexicalScores.find(docID);
+            double bm25Score = (it != allLexicalScores.end()) ? it->second : 0.0;
+            fused[docID] = options.lexicalWeight * bm25Score + options.semanticWeight * sim;
+        }
+
+        // Skip if score is 0 (no keyword match AND no semantic match)
+        for (auto it = fused.begin(); it != fused.end();) {
+            if (it->second <= 0.0) it = fused.erase(it);
+            else ++it;
+        }
+        return fused;
+    }
+
+    if (options.fusion == FusionMode::RRF) {
+        for (size_t rank = 0; rank < lexical.size(); rank++)
+            fused[lexical[rank].first] += options.lexicalWeight / (options.rrfK + rank + 1);
+        for (size_t rank = 0; rank < semantic.size(); rank++)
+            fused[semantic[rank].first] += options.semanticWeight / (options.rrfK + rank + 1);
+        return fused;
+    }
+
+    normalizeLeg(lexical, options.fusion);
+    normalizeLeg(semantic, options.fusion);
+
+    double lexicalFloor = lexical.empty() ? 0.0 : lexical.back().second;
+    double semanticFloor = semantic.empty() ? 0.0 : semantic.back().second;
+
+    unordered_map<int, double> lexicalNorm(lexical.begin(), lexical.end());
+    unordered_map<int, double> semanticNorm(semantic.begin(), semantic.end());
+
+    auto combine = [&](int docID) {
+        auto l = lexicalNorm.find(docID);
+        auto s = semanticNorm.find(docID);
+        double lexScore = (l != lexicalNorm.end()) ? l->second : lexicalFloor;
+        double semScore = (s != semanticNorm.end()) ? s->second : semanticFloor;
+        fused[docID] = options.lexicalWeight * lexScore + options.semanticWeight * semScore;
+    };
+
+    for (auto& [docID, _] : lexical) combine(docID);
+    for (auto& [docID, _] : semantic) combine(docID);
+    return fused;
+}
+
+
+
+
+
+// ======================= SEARCH API =======================
+vector<SearchResult> SearchEngine::searchAPI(const string& query, int page, int limit, const SearchOptions& options,
+                                             SearchStats* stats) {
+    SearchStats localStats;
+    SearchStats& searchStats = stats ? *stats : localStats;
+    searchStats = SearchStats();
+
+    // Cache key must combine query, page, limit and the fusion settings
+    string cacheKey = query + "_p" + to_string(page) + "_l" + to_string(limit) +
+        "_f" + to_string((int)options.fusion) + "_" + to_string(options.lexicalWeight) +
+        "_" + to_string(options.semanticWeight) + "_" + to_string(options.rrfK) +
+        "_" + to_string(options.candidatesPerLeg) + "_x" + to_string(options.proximityWeight) +
+        "_w" + to_string(options.maxExpansions) +
+        "_i" + to_string(options.impactOrdered) + "_" + to_string(options.impactBudgetMs) +
+        "_r" + to_string(options.rerankDepth) + "_" + to_string(options.rerankBudgetMs);
+
+    {
+        lock_guard<mutex> lock(cacheMutex); 
+        if (cacheMap.find(cacheKey) != cacheMap.end()) {
+            lruList.erase(cacheMap[cacheKey].second);
+            lruList.push_front(cacheKey);
+            cacheMap[cacheKey].second = lruList.begin();
+            searchStats.cached = true;
+            return cacheMap[cacheKey].first; 
+        }
+    }
+
+    vector<SearchResult> results;
+    string suggestedWord = "";
+
+    QueryNode parsed = parseQuery(query, normalize);
+    correctQueryTerms(parsed, false, spellDictionary, termDocIDs, suggestedWord);
+    expandWildcards(parsed, options.maxExpansions);
+    if (parsed.empty()) return results;
+
+    vector<string> terms;
+    vector<const QueryNode*> phrases;
+    collectScoringTerms(parsed, false, terms, phrases);
+
+    // -------- BOOLEAN MATCHING --------
+    // Candidates come from the planned query (sorted docIDs). A plain bag of
+    // words matches any of its terms as before; operators, phrases and doc:
+    // filters make the match set a hard constraint for both legs.
+    QueryRun run;
+    bool strict = !isPlainBag(parsed);
+
+    // Page-1 bag-of-words queries can take the impact-ordered index instead,
+    // which never builds the full match set
+    bool useImpact = options.impactOrdered && page == 1 && !strict;
+
+    vector<int> matchStorage;
+    const vector<int>& matches = useImpact ? matchStorage : *evaluateOperand(parsed, run, matchStorage, nullptr);
+
+    vector<const unordered_map<int, PhraseHit>*> phraseHits;
+    for (const QueryNode* phrase : phrases) {
+        auto it = run.phraseHits.find(describeQuery(*phrase));
+        if (it != run.phraseHits.end()) phraseHits.push_back(&it->second);
+    }
+
+    int depth = max(options.candidatesPerLeg, page * limit);
+
+    // -------- LEXICAL LEG --------
+    // BM25 only for documents that contain a query term. Postings and IDF
+    // are resolved once per query, not once per document.
+    shared_ptr<const ScoringTables> tables = currentScoringTables();
+    unordered_map<string, shared_ptr<const PostingMap>> queryPostings;
+    for (const string& term : terms)
+        if (!queryPostings.count(term)) queryPostings[term] = postingsFor(term);
+    auto postingOf = [&](const string& term, int docID) -> const Posting* {
+        auto it = queryPostings.find(term);
+        if (it == queryPostings.end() || !it->second) return nullptr;
+        auto posting = it->second->find(docID);
+        return posting == it->second->end() ? nullptr : &posting->second;
+    };
+
+    vector<pair<const PostingMap*, float>> termStats;
+    for (const string& term : terms) {
+        const PostingMap* postingMap = queryPostings[term].get();
+        if (postingMap) termStats.push_back({postingMap, termIDF(*tables, term, postingMap->size())});
+    }
+    vector<float> phraseIDF;
+    for (auto* hits : phraseHits) phraseIDF.push_back(bm25IDF(hits->size()));
+
+    auto bm25For = [&](int docID) {
+        double bm25Score = 0.0;
+        for (auto& [postingMap, idf] : termStats) {
+            auto it = postingMap->find(docID);
+            if (it != postingMap->end())
+                bm25Score += tables->term(it->second.frequency, it->second.titleFrequency, idf, docID);
+        }
+
+        // Each phrase also scores like a term of its own
+        for (size_t i = 0; i < phraseHits.size(); i++) {
+            auto hit = phraseHits[i]->find(docID);
+            if (hit != phraseHits[i]->end())
+                bm25Score += tables->term(hit->second.count, 0, phraseIDF[i], docID);
+        }
+        return bm25Score;
+    };
+
+    unordered_map<int, double> lexicalScores;
+    if (useImpact) {
+        // Score-at-a-time top-k over quantized impacts, then exact BM25
+        // for just those documents
+        shared_ptr<const ImpactIndex> index = currentImpactIndex();
+        for (auto& [docID, approx] : index->search(terms, depth, options.impactBudgetMs, &searchStats.impact))
+            lexicalScores[docID] = bm25For(docID);
+        searchStats.impactUsed = true;
+    } else {
+        for (int docID : matches)
+            lexicalScores[docID] = bm25For(docID);
+    }
+
+    // A loaded rerank model takes over the second phase below
+    RerankModel model;
+    {
+        lock_guard<mutex> lock(rerankMutex);
+        if (options.rerankDepth > 0) model = rerankModel;
+    }
+    bool rerank = model.loaded();
+
+    // -------- PROXIMITY RERANK --------
+    // Second phase over the best BM25 candidates only: documents whose
+    // query terms sit close together get a boost from the minimal span
+    // covering all of them (span == term count for adjacent terms).
+    vector<string> distinctTerms = terms;
+    sort(distinctTerms.begin(), distinctTerms.end());
+    distinctTerms.erase(unique(distinctTerms.begin(), distinctTerms.end()), distinctTerms.end());
+
+    vector<const vector<int>*> positions;
+    auto proximityFor = [&](int docID) {
+        positions.clear();
+        for (const string& term : distinctTerms) {
+            const Posting* posting = postingOf(term, docID);
+            if (posting && !posting->positions.empty())
+                positions.push_back(&posting->positions);
+        }
+        if (positions.size() < 2) return 0.0;
+
+        int span = minimalCoverSpan(positions);
+        return span > 0 ? (double)positions.size() / span : 0.0;
+    };
+
+    if (!rerank && distinctTerms.size() > 1 && options.proximityWeight > 0) {
+        for (auto& [docID, _] : topScores(lexicalScores, options.proximityDepth))
+            lexicalScores[docID] += options.proximityWeight * proximityFor(docID);
+    }
+
+    // -------- SEMANTIC LEG --------
+    // 🔥 NEW: Fetch the vector for the user's search query
+    vector<float> queryVector = getOpenAIEmbedding(query);
+
+    // Top-k' neighbours from the HNSW graph (or the quantized store)
+    // instead of a cosine pass over every document embedding.
+    vector<pair<int, double>> semanticTop;
+    if (!queryVector.empty()) {
+        for (auto& [docID, sim] : semanticNeighbours(queryVector, depth)) {
+            if (!strict || binary_search(matches.begin(), matches.end(), docID))
+                semanticTop.push_back({docID, sim});
+        }
+    }
+
+    // -------- FUSION --------
+    // Each leg contributes only its own top candidates
+    unordered_map<int, double> fusedScores = fuseScores(
+        topScores(lexicalScores, depth), semanticTop, lexicalScores, options);
+
+    // -------- SECOND PHASE --------
+    // The model rescores only the first-phase top N. N shrinks when recent
+    // reranking cost says the budget would not hold, but always covers the
+    // requested page.
+    if (rerank) {
+        size_t minDepth = page * limit;
+        RerankStats& rerankStats = searchStats.rerank;
+        {
+            lock_guard<mutex> lock(rerankMutex);
+            rerankStats.depthLimit = rerankBudget.depthFor(options.rerankBudgetMs, minDepth,
+                                                     max(minDepth, (size_t)options.rerankDepth));
+        }
+
+        vector<float> unitQuery = queryVector;
+        bool haveQuery = !unitQuery.empty() && normalizeVector(unitQuery);
+
+        Reranker reranker;
+        reranker.addFeature("first_phase", [&](int docID) { return fusedScores[docID]; });
+        reranker.addFeature("bm25", [&](int docID) {
+            auto it = lexicalScores.find(docID);
+            return it == lexicalScores.end() ? 0.0 : it->second;
+        });
+        reranker.addFeature("proximity", proximityFor);
+        reranker.addFeature("phrase", [&](int docID) {
+            if (phrases.empty()) return 0.0;
+            int present = 0;
+            for (auto* hits : phraseHits) present += hits->count(docID);
+            return (double)present / phrases.size();
+        });
+        reranker.addFeature("title", [&](int docID) {
+            if (distinctTerms.empty()) return 0.0;
+            int present = 0;
+            for (const string& term : distinctTerms) {
+                const Posting* posting = postingOf(term, docID);
+                present += posting && posting->titleFrequency > 0;
+            }
+            return (double)present / distinctTerms.size();
+        });
+        if (haveQuery)
+            reranker.addFeature("semantic", [&](int docID) { return semanticSimilarity(unitQuery, docID); });
+        reranker.addFeature("freshness", [&](int docID) {
+            error_code ec;
+            auto modified = filesystem::last_write_time(documents[docID], ec);
+            if (ec) return 0.0;
+            double days = chrono::duration<double>(filesystem::file_time_type::clock::now() - modified).count() / 86400.0;
+            return exp(-max(0.0, days) / 30.0);
+        });
+
+        auto reranked = reranker.rerank(topScores(fusedScores, rerankStats.depthLimit), model, &rerankStats);
+
+        fusedScores.clear();
+        for (auto& [docID, score] : reranked) fusedScores[docID] = score;
+
+        lock_guard<mutex> lock(rerankMutex);
+        rerankBudget.record(rerankStats.candidates, rerankStats.elapsedMs);
+    }
+
+    // Snippets are cut only for the page being returned: each candidate
+    // remembers where its snippet is, and the text (one block of the
+    // document store) is read once the page is known
+    struct Ranked {
+        SearchResult result;
+        int docID;
+        long long snippetAt;     // byte offset; -1 = start of the document, -2 = none
+    };
+    auto cmp = [](const Ranked& a, const Ranked& b) {
+        return a.result.score > b.result.score; 
+    };
+    priority_queue<Ranked, vector<Ranked>, decltype(cmp)> minHeap(cmp);
+    int maxHeapSize = page * limit;
+
+    // -------- RESULT GENERATION --------
+    for (auto& [docID, score] : fusedScores) {
+
+        SearchResult res;
+        res.document = documents[docID];
+        res.suggestion = suggestedWord;
+        res.score = score;
+        long long snippetAt = -2;
+
+        // 4.  NEW: Safe Snippet Generation (Accounts for pure semantic matches)
+        // First query term the document's body contains, and its first phrase hit
+        const Posting* posting = nullptr;
+        for (const string& term : terms) {
+            const Posting* candidate = postingOf(term, docID);
+            if (candidate && candidate->frequency > 0) {
+                posting = candidate;
+                break;
+            }
+        }
+
+        long long phraseOffset = -1;
+        for (auto* hits : phraseHits) {
+            auto hit = hits->find(docID);
+            if (hit != hits->end()) { phraseOffset = hit->second.offset; break; }
+        }
+
+        if (posting && phraseOffset >= 0)
+        {
+            // Centre the snippet on the first phrase occurrence
+            res.frequency = posting->frequency;
+            snippetAt = phraseOffset;
+        }
+        else if (posting) 
+        {
+            res.frequency = posting->frequency;
+            if (!posting->positions.empty()) snippetAt = posting->offsets[0];
+        } 
+        else 
+        {
+            // Semantic match fallback snippet (shows the beginning of the document)
+            res.frequency = 0;
+            snippetAt = -1;
+        }
+
+        minHeap.push({res, docID, snippetAt});
+        if (minHeap.size() > maxHeapSize) {
+            minHeap.pop(); 
+        }
+    }
+
+    // NEW: Clear initial vector and extract target page
+    results.clear(); 
+    int startIndex = (page - 1) * limit;
+
+    if (minHeap.size() > startIndex) {
+        vector<Ranked> tempResults;
+        while (!minHeap.empty()) {
+            tempResults.push_back(minHeap.top());
+            minHeap.pop();
+        }
+        
+        // Reverse to get highest scores first
+        reverse(tempResults.begin(), tempResults.end());
+
+        int endIndex = min((int)tempResults.size(), startIndex + limit);
+        for (int i = startIndex; i < endIndex; i++) {
+            Ranked& ranked = tempResults[i];
+            if (ranked.snippetAt >= 0)
+                ranked.result.snippet = documentSlice(ranked.docID, ranked.snippetAt - 60, ranked.snippetAt + 100);
+            else if (ranked.snippetAt == -1)
+                ranked.result.snippet = docStore.slice(ranked.docID, 0, 150) + "...";
+            results.push_back(ranked.result);
+        }
+    }
+
+    // 2. STORE RESULT IN CACHE BEFORE RETURNING
+    {
+        lock_guard<mutex> lock(cacheMutex); 
+        
+        // Evict the oldest query if we hit capacity
+        if (cacheMap.size() >= cacheCapacity) {
+            string last = lruList.back();
+            lruList.pop_back();
+            cacheMap.erase(last);
+        }
+        
+        // Insert new query at the front
+        lruList.push_front(cacheKey);
+        cacheMap[cacheKey] = {results, lruList.begin()};
+    }
+
+    return results;
+}
+
+
+
+// ---------------- PASSAGES ----------------
+// Passages need no postings of their own: a token at position pos lies in
+// every window w with w * kPassageStride <= pos < w * kPassageStride +
+// kPassageTokens, so a document's query-term positions give each window's
+// term frequencies directly. Windows are scored with BM25 over the body
+// field, normalized by window length, using the corpus (document) IDF.
+vector<PassageResult> SearchEngine::passagesAPI(const string& query, int k) {
+    vector<PassageResult> results;
+    if (k <= 0) return results;
+
+    string suggestion;
+    QueryNode parsed = parseQuery(query, normalize);
+    correctQueryTerms(parsed, false, spellDictionary, termDocIDs, suggestion);
+    expandWildcards(parsed, SearchOptions().maxExpansions);
+    if (parsed.empty()) return results;
+
+    vector<string> terms;
+    vector<const QueryNode*> phrases;
+    collectScoringTerms(parsed, false, terms, phrases);
+    sort(terms.begin(), terms.end());
+    terms.erase(unique(terms.begin(), terms.end()), terms.end());
+
+    QueryRun run;
+    vector<int> matchStorage;
+    const vector<int>& matches = *evaluateOperand(parsed, run, matchStorage, nullptr);
+
+    shared_ptr<const ScoringTables> tables = currentScoringTables();
+    vector<pair<shared_ptr<const PostingMap>, float>> termStats;
+    for (const string& term : terms) {
+        shared_ptr<const PostingMap> postingMap = postingsFor(term);
+        if (postingMap) termStats.push_back({postingMap, termIDF(*tables, term, postingMap->size())});
+    }
+    if (termStats.empty()) return results;
+
+    // Only windows of the best documents by whole-document BM25 are scored
+    vector<pair<double, int>> docs;
+    for (int docID : matches) {
+        double score = 0.0;
+        for (auto& [postingMap, idf] : termStats) {
+            auto it = postingMap->find(docID);
+            if (it != postingMap->end())
+                score += tables->term(it->second.frequency, it->second.titleFrequency, idf, docID);
+        }
+        if (score > 0) docs.push_back({score, docID});
+    }
+    auto better = [](const pair<double, int>& a, const pair<double, int>& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    };
+    size_t depth = min(docs.size(), (size_t)kPassageCandidateDocs);
+    partial_sort(docs.begin(), docs.begin() + depth, docs.end(), better);
+    docs.resize(depth);
+
+    struct Window {
+        double score;
+        int docID;
+        int window;
+    };
+    vector<Window> windows;
+    const int span = kPassageTokens / kPassageStride;   // windows sharing a token
+    for (auto& [docScore, docID] : docs) {
+        auto lengthIt = documentLength.find(docID);
+        int length = lengthIt == documentLength.end() ? 0 : lengthIt->second;
+        int count = length <= kPassageTokens ? 1 : (length - kPassageTokens + kPassageStride - 1) / kPassageStride + 1;
+
+        unordered_map<int, vector<int>> frequencies;   // window -> per term
+        for (size_t t = 0; t < termStats.size(); t++) {
+            auto it = termStats[t].first->find(docID);
+            if (it == termStats[t].first->end()) continue;
+            for (int pos : it->second.positions) {
+                int first = pos < kPassageTokens ? 0 : (pos - kPassageTokens) / kPassageStride + 1;
+                int last = min(pos / kPassageStride, count - 1);
+                for (int w = first; w <= last; w++) {
+                    vector<int>& tf = frequencies[w];
+                    if (tf.empty()) tf.resize(termStats.size());
+                    tf[t]++;
+                }
+            }
+        }
+
+        for (auto& [w, tf] : frequencies) {
+            int windowLength = min(kPassageTokens, length - w * kPassageStride);
+            double normalization = 1.0 - tables->b + tables->b * windowLength / kPassageTokens;
+            double score = 0.0;
+            for (size_t t = 0; t < tf.size(); t++) {
+                if (tf[t] == 0) continue;
+                double weighted = tf[t] * tables->bodyWeight / normalization;
+                score += termStats[t].second * weighted * (tables->k1 + 1.0) / (weighted + tables->k1);
+            }
+            windows.push_back({score, docID, w});
+        }
+    }
+    sort(windows.begin(), windows.end(), [](const Window& a, const Window& b) {
+        if (a.score != b.score) return a.score > b.score;
+        return a.docID != b.docID ? a.docID < b.docID : a.window < b.window;
+    });
+
+    // Best first, skipping windows that overlap one already taken
+    unordered_map<int, vector<int>> taken;
+    for (const Window& window : windows) {
+        if ((int)results.size() >= k) break;
+        vector<int>& chosen = taken[window.docID];
+        bool overlaps = false;
+        for (int w : chosen) overlaps = overlaps || abs(w - window.window) < span;
+        if (overlaps) continue;
+        chosen.push_back(window.window);
+
+        shared_ptr<const vector<long long>> bounds = passageBounds(window.docID);
+        size_t starts = bounds->size() - 1;
+        size_t endIndex = window.window + span;
+
+        PassageResult passage;
+        passage.document = documents[window.docID];
+        passage.passage = window.window;
+        passage.firstToken = window.window * kPassageStride;
+        passage.endToken = passage.firstToken + kPassageTokens;
+        auto lengthIt = documentLength.find(window.docID);
+        if (lengthIt != documentLength.end()) passage.endToken = min(passage.endToken, lengthIt->second);
+        passage.begin = (size_t)window.window < starts ? (*bounds)[window.window] : bounds->back();
+        passage.end = endIndex < starts ? (*bounds)[endIndex] : bounds->back();
+        passage.score = window.score;
+        passage.text = documentSlice(window.docID, passage.begin, passage.end);
+        while (!passage.text.empty() && isspace((unsigned char)passage.text.back())) passage.text.pop_back();
+        results.push_back(move(passage));
+    }
+    return results;
+}
+
+// Tokenizes the document the way indexing did, recording where every
+// kPassageStride-th token starts. A document cut to its stored prefix is
+// read from its file instead.
+shared_ptr<const vector<long long>> SearchEngine::passageBounds(int docID) {
+    string key = to_string(docID);
+    if (shared_ptr<const vector<long long>> cached = passageBoundsCache.get(key)) return cached;
+
+    auto bounds = make_shared<vector<long long>>();
+    int position = 0;
+    WordStream words;
+    auto onWord = [&](const string& word) {
+        if (normalize(word).empty()) return;
+        if (position++ % kPassageStride == 0) bounds->push_back(words.wordStart());
+    };
+    auto feed = [&](const char* data, size_t size) { words.feed(data, size, onWord); };
+
+    string stored = docStore.text(docID);
+    if (stored.size() < kMaxStoredText || docID >= (int)documents.size() || !fileText(documents[docID], nullptr)(feed))
+        feed(stored.data(), stored.size());
+    words.finish(onWord);
+    bounds->push_back(words.bytes());
+
+    passageBoundsCache.put(key, bounds, bounds->capacity() * sizeof(long long) + key.size());
+    return bounds;
+}
+
+
+
+// ---------------- AUTOCOMPLETE ----------------
+vector<string> SearchEngine::autocompleteAPI(const string& prefix) {
+    return trie.autocomplete(normalize(prefix));
+}
+
+// ---------------- CLEAR INDEX ----------------
+void SearchEngine::clearIndex() {
+    lock_guard<recursive_mutex> writes(writeMutex);
     invalidateCache();
 
     documents.clear();
-    invertedIndex.clear();
-    documentContents.clear();
+    indexGeneration++;
+    clearPostings();
+    termDocIDs.clear();
+    denseTermBitmaps.clear();
+    docStore.clear();
+    passageBoundsCache.clear();
     documentLength.clear();   // MISSING BEFORE
     avgDocLength = 0.0;       // RESET THIS TOO
+    documentEmbeddings.clear();
+    annIndex.clear();
+    quantizedEmbeddings.clear();
+    fullPrecisionVectors.close();
+    releaseIndexMapping();
 
     trie = Trie();
+    spellDictionary.clear();
 
     usingSample = false;
     includeInitialCorpus = false; // New added for check
+    indexWalLsn = 0;
 }
 
 
@@ -815,6 +1976,7 @@ void SearchEngine::clearIndex() {
 // ---------------- LOAD SAMPLE ----------------
 
 void SearchEngine::loadSampleDataset() {
+    lock_guard<recursive_mutex> writes(writeMutex);
     invalidateCache();
 
     clearIndex();   // 🔥 Always reset
@@ -844,6 +2006,271 @@ void SearchEngine::loadSampleDataset() {
 
 
 
+// ---------------- ANN TUNING ----------------
+void SearchEngine::setANNParams(int M, int efConstruction, int efSearch) {
+    invalidateCache();
+    annIndex.setParams(M, efConstruction, efSearch);
+    annIndex.rebuild();
+}
+
+// Recall@k of the HNSW leg against an exact scan, using the stored document
+// embeddings themselves as queries.
+vector<ANNBenchmarkResult> SearchEngine::benchmarkANN(int k, const vector<int>& efValues, int maxQueries) {
+    vector<ANNBenchmarkResult> report;
+    if (annIndex.size() == 0 || k <= 0) return report;
+
+    int dim = documentEmbeddings.dimension();
+    vector<vector<float>> queries;
+    documentEmbeddings.forEach([&](int docID, const float* row) {
+        if ((int)queries.size() < maxQueries)
+            queries.emplace_back(row, row + dim);
+    });
+
+    // Ground truth once, shared by every efSearch setting
+    vector<unordered_set<int>> truth;
+    double bruteMs = 0.0;
+    for (auto& q : queries) {
+        auto start = chrono::high_resolution_clock::now();
+        auto exact = annIndex.bruteForce(q, k);
+        auto end = chrono::high_resolution_clock::now();
+        bruteMs += chrono::duration<double, milli>(end - start).count();
+
+        unordered_set<int> ids;
+        for (auto& [docID, _] : exact) ids.insert(docID);
+        truth.push_back(ids);
+    }
+
+    for (int ef : efValues) {
+        ANNBenchmarkResult row;
+        row.efSearch = ef;
+
+        double hits = 0, expected = 0, annMs = 0.0;
+        for (size_t i = 0; i < queries.size(); i++) {
+            auto start = chrono::high_resolution_clock::now();
+            auto approx = annIndex.search(queries[i], k, ef);
+            auto end = chrono::high_resolution_clock::now();
+            annMs += chrono::duration<double, milli>(end - start).count();
+
+            for (auto& [docID, _] : approx)
+                hits += truth[i].count(docID);
+            expected += truth[i].size();
+        }
+
+        row.recallAtK = expected > 0 ? hits / expected : 0.0;
+        row.annLatencyMs = annMs / queries.size();
+        row.bruteForceLatencyMs = bruteMs / queries.size();
+        report.push_back(row);
+    }
+
+    return report;
+}
+
+
+
+// ---------------- EMBEDDING STORAGE ----------------
+void SearchEngine::storeEmbedding(int docID, const vector<float>& vec) {
+    if (quantizedEmbeddings.trained()) {
+        vector<float> unit = vec;
+        if ((int)unit.size() != quantizedEmbeddings.dimension() || !normalizeVector(unit))
+            return;
+        quantizedEmbeddings.add(docID, unit.data());
+        fullPrecisionVectors.write(docID, unit.data());
+        return;
+    }
+
+    if (documentEmbeddings.set(docID, vec))
+        annIndex.add(docID);
+
+    maybeQuantizeEmbeddings();
+}
+
+// Swaps the float matrix + graph for compact codes once enough vectors exist
+// to train the quantizer. Full-precision rows move to disk for reranking.
+void SearchEngine::maybeQuantizeEmbeddings() {
+    if (embeddingStorage == EmbeddingStorage::Float || quantizedEmbeddings.trained())
+        return;
+    if ((int)documentEmbeddings.count() < quantizeAfter)
+        return;
+
+    if (!fullPrecisionVectors.open(fullPrecisionPath, documentEmbeddings.dimension())) {
+        cout << "Cannot open " << fullPrecisionPath << ", keeping float embeddings\n";
+        return;
+    }
+
+    quantizedEmbeddings.build(embeddingStorage, pqSubspaces, documentEmbeddings);
+    documentEmbeddings.forEach([&](int docID, const float* row) {
+        fullPrecisionVectors.write(docID, row);
+    });
+
+    cout << "Quantized " << quantizedEmbeddings.count() << " embeddings to "
+         << quantizedEmbeddings.bytesPerVector() << " bytes/vector\n";
+
+    documentEmbeddings.clear();
+    annIndex.clear();
+}
+
+// Brings spilled full-precision rows back into the float matrix and graph
+void SearchEngine::restoreFloatEmbeddings() {
+    if (!quantizedEmbeddings.trained()) return;
+
+    vector<float> row;
+    quantizedEmbeddings.forEachDoc([&](int docID) {
+        if (fullPrecisionVectors.read(docID, row))
+            documentEmbeddings.set(docID, row);
+    });
+
+    quantizedEmbeddings.clear();
+    fullPrecisionVectors.close();
+
+    annIndex.clear();
+    documentEmbeddings.forEach([&](int docID, const float*) {
+        annIndex.add(docID);
+    });
+}
+
+void SearchEngine::setEmbeddingStorage(EmbeddingStorage mode, int subspaces) {
+    lock_guard<recursive_mutex> writes(writeMutex);
+    invalidateCache();
+
+    restoreFloatEmbeddings();
+    embeddingStorage = mode;
+    pqSubspaces = subspaces;
+    maybeQuantizeEmbeddings();
+}
+
+// Exact cosine similarity of one document to a normalized query
+double SearchEngine::semanticSimilarity(const vector<float>& unitQuery, int docID) const {
+    if (!quantizedEmbeddings.trained()) {
+        if ((int)unitQuery.size() != documentEmbeddings.dimension() || !documentEmbeddings.has(docID)) return 0.0;
+        return dotProduct(unitQuery.data(), documentEmbeddings.row(docID), unitQuery.size());
+    }
+
+    vector<float> row;
+    if ((int)unitQuery.size() != quantizedEmbeddings.dimension() || !fullPrecisionVectors.read(docID, row))
+        return 0.0;
+    return dotProduct(unitQuery.data(), row.data(), unitQuery.size());
+}
+
+vector<pair<int, float>> SearchEngine::semanticNeighbours(const vector<float>& query, int k) {
+    if (!quantizedEmbeddings.trained())
+        return annIndex.search(query, k);
+
+    vector<float> unit = query;
+    if ((int)unit.size() != quantizedEmbeddings.dimension() || !normalizeVector(unit))
+        return {};
+
+    // ADC over the codes, then exact rerank of the shortlist from disk
+    auto shortlist = quantizedEmbeddings.search(unit.data(), k * rerankFactor);
+
+    vector<float> row;
+    for (auto& [docID, sim] : shortlist) {
+        if (fullPrecisionVectors.read(docID, row))
+            sim = dotProduct(unit.data(), row.data(), unit.size());
+    }
+
+    sort(shortlist.begin(), shortlist.end(), [](const pair<int, float>& a, const pair<int, float>& b) {
+        return a.second > b.second;
+    });
+    if ((int)shortlist.size() > k) shortlist.resize(k);
+    return shortlist;
+}
+
+// Recall@k and memory per storage mode, measured against an exact float scan
+vector<QuantizationBenchmarkResult> SearchEngine::benchmarkQuantization(int k, int maxQueries) {
+    vector<QuantizationBenchmarkResult> report;
+    if (k <= 0) return report;
+
+    // Full-precision source: the live matrix, or the spilled rows
+    EmbeddingMatrix spilled;
+    const EmbeddingMatrix* source = &documentEmbeddings;
+    if (quantizedEmbeddings.trained()) {
+        vector<float> row;
+        quantizedEmbeddings.forEachDoc([&](int docID) {
+            if (fullPrecisionVectors.read(docID, row))
+                spilled.set(docID, row);
+        });
+        source = &spilled;
+    }
+    if (source->count() == 0) return report;
+
+    int dim = source->dimension();
+    vector<vector<float>> queries;
+    source->forEach([&](int docID, const float* row) {
+        if ((int)queries.size() < maxQueries)
+            queries.emplace_back(row, row + dim);
+    });
+
+    auto topK = [&](const vector<float>& scores) {
+        vector<pair<float, int>> scored;
+        source->forEach([&](int docID, const float*) {
+            scored.push_back({scores[docID], docID});
+        });
+        int top = min(k, (int)scored.size());
+        partial_sort(scored.begin(), scored.begin() + top, scored.end(), greater<pair<float, int>>());
+        unordered_set<int> ids;
+        for (int i = 0; i < top; i++) ids.insert(scored[i].second);
+        return ids;
+    };
+
+    vector<unordered_set<int>> truth;
+    vector<float> scores;
+    auto start = chrono::high_resolution_clock::now();
+    for (auto& q : queries) {
+        source->scoreAll(q.data(), scores);
+        truth.push_back(topK(scores));
+    }
+    auto end = chrono::high_resolution_clock::now();
+
+    QuantizationBenchmarkResult exact;
+    exact.storage = "float";
+    exact.bytesPerVector = source->stride() * sizeof(float);
+    exact.totalBytes = source->memoryBytes();
+    exact.recallAtK = 1.0;
+    exact.latencyMs = chrono::duration<double, milli>(end - start).count() / queries.size();
+    report.push_back(exact);
+
+    auto evaluate = [&](const string& name, const QuantizedEmbeddings& store, bool rerank) {
+        QuantizationBenchmarkResult row;
+        row.storage = name;
+        row.bytesPerVector = store.bytesPerVector();
+        row.totalBytes = store.memoryBytes();
+
+        double hits = 0, expected = 0;
+        auto start = chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < queries.size(); i++) {
+            auto found = store.search(queries[i].data(), rerank ? k * rerankFactor : k);
+            if (rerank) {
+                for (auto& [docID, sim] : found)
+                    sim = dotProduct(queries[i].data(), source->row(docID), dim);
+                sort(found.begin(), found.end(), [](const pair<int, float>& a, const pair<int, float>& b) {
+                    return a.second > b.second;
+                });
+                if ((int)found.size() > k) found.resize(k);
+            }
+            for (auto& [docID, _] : found) hits += truth[i].count(docID);
+            expected += truth[i].size();
+        }
+        auto end = chrono::high_resolution_clock::now();
+
+        row.recallAtK = expected > 0 ? hits / expected : 0.0;
+        row.latencyMs = chrono::duration<double, milli>(end - start).count() / queries.size();
+        report.push_back(row);
+    };
+
+    QuantizedEmbeddings int8Store, pqStore;
+    int8Store.build(EmbeddingStorage::Int8, 0, *source);
+    pqStore.build(EmbeddingStorage::PQ, pqSubspaces, *source);
+
+    evaluate("int8", int8Store, false);
+    evaluate("int8+rerank", int8Store, true);
+    evaluate("pq", pqStore, false);
+    evaluate("pq+rerank", pqStore, true);
+
+    return report;
+}
+
+
+
 double SearchEngine::getLastIndexingTime() const {
     return lastIndexingTimeMs;
 }
@@ -856,26 +2283,25 @@ int SearchEngine::getLastThreadCount() const {
 
 
 void SearchEngine::buildIndexSingleThread() {
+    lock_guard<recursive_mutex> writes(writeMutex);
     invalidateCache();
 
-    invertedIndex.clear();
+    clearPostings();
+    indexGeneration++;
+    termDocIDs.clear();
+    denseTermBitmaps.clear();
     documentLength.clear();
-    documentContents.clear();
+    docStore.clear();
+    passageBoundsCache.clear();
     avgDocLength = 0.0;
     trie = Trie();
+    spellDictionary.clear();
 
     for (int docID = 0; docID < documents.size(); docID++) {
 
-        ifstream file(documents[docID]);
-        if (!file) continue;
-
-        stringstream buffer;
-        buffer << file.rdbuf();
-
-        string content = buffer.str();
-        documentContents[docID] = content;
-
-        indexDocument(docID, content);
+        string stored;
+        if (!indexDocumentStream(docID, fileText(documents[docID], &stored))) continue;
+        docStore.add(docID, stored);
     }
 
     // Recompute average doc length
@@ -887,8 +2313,10 @@ void SearchEngine::buildIndexSingleThread() {
         avgDocLength = totalLength / documentLength.size();
 
     // Build Trie
-    for (auto& [word, _] : invertedIndex)
+    for (auto& [word, _] : invertedIndex) {
         trie.insert(word);
+        spellDictionary.add(word);
+    }
 }
 
 
@@ -896,10 +2324,12 @@ void SearchEngine::buildIndexSingleThread() {
 
 
 void SearchEngine::scanCorpusFolders() {
+    lock_guard<recursive_mutex> writes(writeMutex);
 
     namespace fs = std::filesystem;
 
     documents.clear();
+    indexGeneration++;
 
     // Include permanent corpus ONLY if enabled
     if (includeInitialCorpus) {
@@ -925,24 +2355,62 @@ void SearchEngine::scanCorpusFolders() {
 
 
 
+void SearchEngine::rebuildIndex() {
+    lock_guard<recursive_mutex> writes(writeMutex);
+    scanCorpusFolders();
+    buildIndex();
+}
 
-void SearchEngine::indexSingleDocument(const string& path) {
-    invalidateCache();
 
-    int docID = documents.size();
-    documents.push_back(path);
+bool SearchEngine::indexSingleDocument(const string& path) {
+    ifstream file(path, ios::binary | ios::ate);
+    bool readable = (bool)file;
 
-    ifstream file(path);
-    if (!file) return;
+    // Read straight into the string: the log record needs the whole text
+    string content;
+    vector<float> embedding;
+    if (readable) {
+        content.resize(file.tellg());
+        file.seekg(0);
+        file.read(&content[0], content.size());
+        content.resize(file.gcount());
 
-    stringstream buffer;
-    buffer << file.rdbuf();
-    string content = buffer.str();
+        cout << "Fetching OpenAI Vector for: " << path << "...\n";
+        embedding = getOpenAIEmbedding(content);
+    }
 
-    documentContents[docID] = content;
+    // The record carries the content and the embedding, so replay needs
+    // neither the uploaded file nor the embedding service
+    uint64_t lsn = 0;
+    {
+        lock_guard<recursive_mutex> lock(writeMutex);
+        if (wal.isOpen() && readable) {
+            WalRecord record;
+            record.op = WalOp::AddDocument;
+            record.path = path;
+            record.content = content;
+            record.embedding = embedding;
+            lsn = wal.append(move(record));
+            if (!lsn) cout << "Write-ahead log append failed for " << path << endl;
+        }
+        applyDocument(path, content, embedding, readable);
+    }
+
+    // Outside the lock, so concurrent uploads share one fsync
+    if (!wal.isOpen() || !readable) return true;
+    return lsn && wal.sync(lsn);
+}
+
+void SearchEngine::applyDocument(const string& path, const string& content,
+                                 const vector<float>& embedding, bool readable) {
+    invalidateCache();
+
+    int docID = documents.size();
+    documents.push_back(path);
+    if (!readable) return;
 
-    cout << "Fetching OpenAI Vector for: " << path << "...\n";
-    documentEmbeddings[docID] = getOpenAIEmbedding(content);
+    docStore.add(docID, storedText(content));
+    storeEmbedding(docID, embedding);
 
     indexDocument(docID, content);
 
@@ -955,8 +2423,10 @@ void SearchEngine::indexSingleDocument(const string& path) {
         avgDocLength = total / documentLength.size();
 
     // Insert words into Trie
-    for (auto& [word, _] : invertedIndex)
+    for (auto& [word, _] : invertedIndex) {
         trie.insert(word);
+        spellDictionary.add(word);
+    }
 }
 
 
@@ -968,63 +2438,421 @@ void SearchEngine::indexSingleDocument(const string& path) {
 
 
 // ---------------- SAVE INDEX TO DISK (BINARY) ----------------
+// Copies what the next save writes, so the files can be written without
+// holding any lock: the documents added since the last save (all of them
+// for a full save) and the manifest that will follow
+shared_ptr<SearchEngine::IndexSnapshot> SearchEngine::snapshotIndex(const string& filepath) {
+    namespace fs = std::filesystem;
+    lock_guard<recursive_mutex> writes(writeMutex);   // no upload half-applied; searches go on
+
+    auto snapshot = make_shared<IndexSnapshot>();
+    snapshot->walLsn = wal.lastLsn();
+    snapshot->generation = indexGeneration;
+    snapshot->embeddingModel = embeddingModel;
+
+    // Incremental only on top of segments that still describe the head of
+    // this index, and only while there are few of them
+    bool samePath = savedIndex.path == filepath;
+    uint64_t savedDocs = 0;
+    for (const SegmentRef& segment : savedIndex.segments) savedDocs += segment.docCount;
+    bool incremental = samePath && savedIndex.generation == indexGeneration &&
+                       !savedIndex.segments.empty() && savedDocs <= documents.size() &&
+                       savedIndex.segments.size() < kMaxSegments;
+
+    uint64_t firstDoc = incremental ? savedDocs : 0;
+    snapshot->firstDoc = firstDoc;
+    snapshot->nextSegmentID = samePath ? savedIndex.nextSegmentID : 1;
+    if (incremental) {
+        snapshot->segments = savedIndex.segments;
+    } else if (samePath) {
+        for (const SegmentRef& segment : savedIndex.segments) snapshot->obsolete.push_back(segment.file);
+    }
+
+    size_t lastDoc = documents.size();
+    if (lastDoc > firstDoc) {
+        // Never reuse a name on disk: the current manifest may still point at it
+        string directory = filepath.substr(0, filepath.find_last_of('/') + 1);
+        string base = filepath.substr(filepath.find_last_of('/') + 1);
+        uint64_t id = snapshot->nextSegmentID;
+        while (fs::exists(directory + base + "." + to_string(id) + ".seg")) id++;
+
+        snapshot->segment = {base + "." + to_string(id) + ".seg", firstDoc, lastDoc - firstDoc};
+        snapshot->segments.push_back(snapshot->segment);
+        snapshot->nextSegmentID = id + 1;
+        if (samePath) savedIndex.nextSegmentID = id + 1;   // reserved for this save
+    }
+
+    snapshot->documents.assign(documents.begin() + firstDoc, documents.end());
+    for (const auto& [docID, len] : documentLength)
+        if ((uint64_t)docID >= firstDoc) snapshot->documentLength[docID] = len;
+
+    if (firstDoc == 0) {
+        {
+            shared_lock<shared_mutex> lock(postingsMutex);
+            snapshot->invertedIndex.insert(invertedIndex.begin(), invertedIndex.end());
+        }
+        snapshot->trie = trie.serialize();
+        snapshot->spell = spellDictionary.serialize();
+
+        // Lazy terms are written from their mappings, never decoded
+        lock_guard<mutex> lock(lazyMutex);
+        snapshot->lazyTerms = lazyTerms;
+    } else {
+        // docIDs per term are ascending, so only each list's tail is new
+        for (const auto& [word, ids] : termDocIDs) {
+            if (ids.empty() || (uint64_t)ids.back() < firstDoc) continue;
+            shared_ptr<const PostingMap> postings = postingsFor(word);
+            if (!postings) continue;
+
+            auto tail = make_shared<PostingMap>();
+            for (auto it = lower_bound(ids.begin(), ids.end(), (int)firstDoc); it != ids.end(); ++it) {
+                auto posting = postings->find(*it);
+                if (posting != postings->end()) (*tail)[*it] = posting->second;
+            }
+            snapshot->invertedIndex[word] = move(tail);
+        }
+    }
+
+    uint64_t bytes = snapshot->trie.size() + snapshot->spell.size();
+    for (const string& doc : snapshot->documents) bytes += 4 + doc.size();
+    bytes += snapshot->documentLength.size() * 8;
+    for (const auto& [word, postingMap] : snapshot->invertedIndex) {
+        bytes += 16 + word.size();
+        for (const auto& [docID, posting] : *postingMap) bytes += 12 + posting.positions.size() * 12;
+    }
+    for (const auto& [word, extents] : snapshot->lazyTerms) {
+        bytes += 16 + word.size();
+        for (const PostingExtent& extent : extents) bytes += extent.size;
+    }
+
+    bool quantized = quantizedEmbeddings.trained();
+    int dim = quantized ? quantizedEmbeddings.dimension() : documentEmbeddings.dimension();
+    if (dim > 0 && lastDoc > firstDoc) {
+        size_t stride = (dim + 7) / 8 * 8;
+        size_t rows = lastDoc - firstDoc;
+        snapshot->dim = dim;
+        snapshot->stride = stride;
+        snapshot->flags.assign(rows, 0);
+        snapshot->matrix.assign(rows * stride, 0.0f);
+
+        vector<float> full;
+        for (size_t r = 0; r < rows; r++) {
+            int docID = firstDoc + r;
+            float* row = snapshot->matrix.data() + r * stride;
+            if (quantized) {
+                if (quantizedEmbeddings.has(docID) && fullPrecisionVectors.read(docID, full)) {
+                    copy(full.begin(), full.end(), row);
+                    snapshot->flags[r] = 1;
+                }
+            } else if (documentEmbeddings.has(docID)) {
+                const float* src = documentEmbeddings.row(docID);
+                copy(src, src + dim, row);
+                snapshot->flags[r] = 1;
+            }
+        }
+        bytes += rows + snapshot->matrix.size() * sizeof(float);
+    }
+
+    snapshot->docStore = docStore.serialize(firstDoc, lastDoc);
+    bytes += snapshot->docStore.size();
+    snapshot->estimatedBytes = bytes;
+    return snapshot;
+}
+
+// Finishes a file written next to its target and renames it into place;
+// fsyncing the directory makes the rename itself durable
+static bool commitFile(IndexWriter& out, const string& tempPath, const string& path, string& error) {
+    if (!out.finish()) {
+        error = out.error();
+        unlink(tempPath.c_str());
+        return false;
+    }
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        error = string("rename: ") + strerror(errno);
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    string directory = path.substr(0, path.find_last_of('/') + 1);
+    int dirFd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return true;
+}
+
+// Container layout is in IndexFormat.h. A segment file has the sections
+//   SEGMENT  u64 first docID, u64 document count
+//   DOCS     u64 count, then per document its name (u32 length + bytes)
+//   DOCLENS  u64 count, then (u32 docID, u32 length) pairs
+//   POSTINGS per posting: u32 docID, u32 frequency (title count in the top
+//            byte), u32 n, n u32 positions, n u64 byte offsets
+//   DICT     u64 count, then per term: name, u32 postings, u64 offset of its
+//            first posting inside POSTINGS
+//   DICTRNG  u32 count, then per range of consecutive DICT terms: u64 offset
+//            of its first entry inside DICT, u32 term count (ranges hold
+//            about equal postings bytes and are loaded in parallel)
+//   FTRIE    Trie::serialize(), a FlatTrie (full saves only)
+//   SPELL    SpellDictionary::serialize() (full saves only)
+//   DSTORE   DocStore::serialize(): the documents' texts, LZ-compressed in
+//            blocks of at most DocStore::kBlockSize, for snippets
+//   EMBD     model name, u32 dim, u64 stride, u64 rows, rows presence bytes,
+//            padding to a 64-byte file offset, rows x stride f32 matrix
+//            (row r is document first docID + r)
+// docIDs are global. The manifest (at filepath) has
+//   MANIFEST u64 next segment number, u32 count, then per segment its file
+//            name, u64 first docID, u64 document count
+//   WAL      u64 LSN of the last write-ahead log record the index includes
+//
+// The new segment is complete on disk before the manifest that names it is
+// renamed into place, so a crash leaves either the old index or the new
+// one. Mappings of replaced files stay valid: they keep the inodes alive.
+bool SearchEngine::writeSnapshot(const IndexSnapshot& snapshot, const string& filepath,
+                                 atomic<uint64_t>* bytesWritten, string& error) {
+    string directory = filepath.substr(0, filepath.find_last_of('/') + 1);
+
+    if (snapshot.segment.docCount > 0) {
+        string segmentPath = directory + snapshot.segment.file;
+        string tempPath = segmentPath + ".tmp";
+
+        IndexWriter out;
+        out.reportProgress(bytesWritten);
+        if (!out.open(tempPath)) {
+            error = out.error();
+            return false;
+        }
+
+        out.beginSection("SEGMENT");
+        out.putU64(snapshot.segment.firstDoc);
+        out.putU64(snapshot.segment.docCount);
+
+        out.beginSection("DOCS");
+        out.putU64(snapshot.documents.size());
+        for (const string& doc : snapshot.documents) out.putString(doc);
+
+        out.beginSection("DOCLENS");
+        out.putU64(snapshot.documentLength.size());
+        for (const auto& [docID, len] : snapshot.documentLength) {
+            out.putU32(docID);
+            out.putU32(len);
+        }
+
+        struct TermEntry {
+            const string* word;
+            uint32_t postings;
+            uint64_t offset;
+        };
+        vector<TermEntry> termOffsets;
+        termOffsets.reserve(snapshot.invertedIndex.size() + snapshot.lazyTerms.size());
+        uint64_t postingsOffset = 0;
+
+        out.beginSection("POSTINGS");
+        for (const auto& [word, postingMap] : snapshot.invertedIndex) {
+            termOffsets.push_back({&word, (uint32_t)postingMap->size(), postingsOffset});
+            for (const auto& [docID, posting] : *postingMap) {
+                size_t n = posting.positions.size();
+                out.putU32(docID);
+                out.putU32(posting.frequency | ((uint32_t)posting.titleFrequency << 24));
+                out.putU32(n);
+                for (int position : posting.positions) out.putU32(position);
+                for (size_t i = 0; i < n; i++) out.putU64(i < posting.offsets.size() ? posting.offsets[i] : 0);
+                postingsOffset += 12 + n * 12;
+            }
+        }
+        // Terms still on disk were checked at load and keep this layout
+        for (const auto& [word, extents] : snapshot.lazyTerms) {
+            uint32_t count = 0;
+            for (const PostingExtent& extent : extents) count += extent.count;
+            termOffsets.push_back({&word, count, postingsOffset});
+            for (const PostingExtent& extent : extents) {
+                out.putBytes(extent.data, extent.size);
+                releaseMappedPages(extent.data, extent.size);
+                postingsOffset += extent.size;
+            }
+        }
+
+        // Term ranges of roughly equal postings bytes, so a loader can
+        // parse the dictionary and postings on several threads
+        uint64_t rangeBytes = max<uint64_t>(kMinLoadRangeBytes, postingsOffset / kLoadRanges);
+        vector<pair<uint64_t, uint32_t>> ranges;   // DICT offset, term count
+        uint64_t dictOffset = 8;
+
+        out.beginSection("DICT");
+        out.putU64(termOffsets.size());
+        for (size_t i = 0; i < termOffsets.size(); i++) {
+            auto& [word, postings, offset] = termOffsets[i];
+            if (ranges.empty() ||
+                (offset - termOffsets[i - ranges.back().second].offset >= rangeBytes)) {
+                ranges.push_back({dictOffset, 0});
+            }
+            ranges.back().second++;
+
+            out.putString(*word);
+            out.putU32(postings);
+            out.putU64(offset);
+            dictOffset += 4 + word->size() + 4 + 8;
+        }
+
+        out.beginSection("DICTRNG");
+        out.putU32(ranges.size());
+        for (auto& [at, count] : ranges) {
+            out.putU64(at);
+            out.putU32(count);
+        }
+
+        if (!snapshot.trie.empty()) {
+            out.beginSection("FTRIE");
+            out.putBytes(snapshot.trie.data(), snapshot.trie.size());
+        }
+        if (!snapshot.spell.empty()) {
+            out.beginSection("SPELL");
+            out.putBytes(snapshot.spell.data(), snapshot.spell.size());
+        }
+
+        out.beginSection("DSTORE");
+        out.putBytes(snapshot.docStore.data(), snapshot.docStore.size());
+
+        // Embeddings: the float matrix is padded to a 64-byte file offset so it
+        // can be used straight from the mapping on load
+        if (snapshot.dim > 0) {
+            out.beginSection("EMBD");
+            out.putString(snapshot.embeddingModel);
+            out.putU32(snapshot.dim);
+            out.putU64(snapshot.stride);
+            out.putU64(snapshot.flags.size());
+            out.putBytes(snapshot.flags.data(), snapshot.flags.size());
+            out.align();
+            out.putF32Array(snapshot.matrix.data(), snapshot.matrix.size());
+        }
+
+        if (!commitFile(out, tempPath, segmentPath, error)) return false;
+    }
+
+    string tempPath = filepath + ".tmp";
+    IndexWriter manifest;
+    if (!manifest.open(tempPath)) {
+        error = manifest.error();
+        return false;
+    }
+    manifest.beginSection("MANIFEST");
+    manifest.putU64(snapshot.nextSegmentID);
+    manifest.putU32(snapshot.segments.size());
+    for (const SegmentRef& segment : snapshot.segments) {
+        manifest.putString(segment.file);
+        manifest.putU64(segment.firstDoc);
+        manifest.putU64(segment.docCount);
+    }
+    manifest.beginSection("WAL");
+    manifest.putU64(snapshot.walLsn);
+    if (!commitFile(manifest, tempPath, filepath, error)) return false;
+
+    // Segments a full save replaced are unreferenced now
+    for (const string& file : snapshot.obsolete) {
+        bool kept = any_of(snapshot.segments.begin(), snapshot.segments.end(),
+                           [&](const SegmentRef& segment) { return segment.file == file; });
+        if (!kept) unlink((directory + file).c_str());
+    }
+    return true;
+}
+
+// Records what is on disk after a successful save. A clear or rebuild that
+// happened meanwhile leaves the generation behind, so the next save is full.
+void SearchEngine::commitSavedIndex(const IndexSnapshot& snapshot, const string& filepath) {
+    lock_guard<recursive_mutex> lock(writeMutex);
+    uint64_t nextSegmentID = savedIndex.path == filepath ? max(savedIndex.nextSegmentID, snapshot.nextSegmentID)
+                                                         : snapshot.nextSegmentID;
+    savedIndex.path = filepath;
+    savedIndex.segments = snapshot.segments;
+    savedIndex.nextSegmentID = nextSegmentID;
+    savedIndex.generation = snapshot.generation;
+}
+
+bool SearchEngine::saveRefused(const string& filepath) {
+    lock_guard<mutex> lock(saveMutex);
+    if (unreadableIndexPath.empty() || unreadableIndexPath != filepath) return false;
+    cout << "Refusing to save over " << filepath << ": it exists but could not be loaded" << endl;
+    return true;
+}
+
 void SearchEngine::saveIndex(const string& filepath) {
-    lock_guard<mutex> lock(cacheMutex); // Lock to ensure no reads happen while saving
-    
-    ofstream out(filepath, ios::binary);
-    if (!out) {
-        cout << "Failed to open file for saving: " << filepath << endl;
+    if (saveRefused(filepath)) return;
+    string error;
+    auto snapshot = snapshotIndex(filepath);
+    if (!writeSnapshot(*snapshot, filepath, nullptr, error)) {
+        cout << "Failed to save index to " << filepath << ": " << error << endl;
         return;
     }
+    commitSavedIndex(*snapshot, filepath);
+    if (wal.isOpen()) wal.truncateThrough(snapshot->walLsn);
+    cout << "Index successfully saved to " << filepath << endl;
+}
 
-    // 1. Save average document length
-    out.write((char*)&avgDocLength, sizeof(avgDocLength));
-
-    // 2. Save Documents Array
-    size_t docCount = documents.size();
-    out.write((char*)&docCount, sizeof(docCount));
-    for (const string& doc : documents) {
-        size_t len = doc.size();
-        out.write((char*)&len, sizeof(len));
-        out.write(doc.c_str(), len);
-    }
-
-    // 3. Save Document Lengths
-    size_t dlSize = documentLength.size();
-    out.write((char*)&dlSize, sizeof(dlSize));
-    for (const auto& [docID, len] : documentLength) {
-        out.write((char*)&docID, sizeof(docID));
-        out.write((char*)&len, sizeof(len));
-    }
-
-    // 4. Save Inverted Index
-    size_t vocabSize = invertedIndex.size();
-    out.write((char*)&vocabSize, sizeof(vocabSize));
-    for (const auto& [word, postingMap] : invertedIndex) {
-        // Write word
-        size_t wordLen = word.size();
-        out.write((char*)&wordLen, sizeof(wordLen));
-        out.write(word.c_str(), wordLen);
-
-        // Write posting map
-        size_t mapSize = postingMap.size();
-        out.write((char*)&mapSize, sizeof(mapSize));
-        for (const auto& [docID, posting] : postingMap) {
-            out.write((char*)&docID, sizeof(docID));
-            out.write((char*)&posting.frequency, sizeof(posting.frequency));
-            
-            size_t posSize = posting.positions.size();
-            out.write((char*)&posSize, sizeof(posSize));
-            out.write((char*)posting.positions.data(), posSize * sizeof(int));
+// Starts a background save and returns its job ID. While one is running,
+// further requests get the running job's ID instead of a second writer.
+int SearchEngine::startSaveIndex(const string& filepath) {
+    if (saveRefused(filepath)) return 0;
+    auto job = make_shared<SaveJob>();
+    {
+        lock_guard<mutex> lock(saveMutex);
+        if (runningSaveJob) return runningSaveJob;
+        if (saveThread.joinable()) saveThread.join();
+
+        job->status.id = nextSaveJobID++;
+        job->status.state = "running";
+        job->started = chrono::steady_clock::now();
+        saveJobs[job->status.id] = job;
+        runningSaveJob = job->status.id;
+    }
 
-            size_t offSize = posting.offsets.size();
-            out.write((char*)&offSize, sizeof(offSize));
-            out.write((char*)posting.offsets.data(), offSize * sizeof(long long));
+    // The snapshot is taken here, so the job saves the index as of the
+    // request. saveMutex is not held while copying: status polls go on, and
+    // runningSaveJob keeps a second request from starting a writer.
+    auto snapshot = snapshotIndex(filepath);
+
+    lock_guard<mutex> lock(saveMutex);
+    job->status.totalBytes = snapshot->estimatedBytes;
+    saveThread = thread([this, job, snapshot, filepath]() {
+        string error;
+        bool ok = writeSnapshot(*snapshot, filepath, &job->bytesWritten, error);
+
+        // The log only needs what the saved index does not include
+        if (ok) {
+            commitSavedIndex(*snapshot, filepath);
+            if (wal.isOpen()) wal.truncateThrough(snapshot->walLsn);
         }
+
+        lock_guard<mutex> lock(saveMutex);
+        job->status.state = ok ? "done" : "failed";
+        job->status.error = error;
+        job->status.elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - job->started).count();
+        if (ok) job->status.totalBytes = job->bytesWritten.load();
+        runningSaveJob = 0;
+
+        if (ok) cout << "Index successfully saved to " << filepath << " (job " << job->status.id << ", "
+                     << (snapshot->firstDoc ? "incremental" : "full") << ", " << snapshot->segment.docCount
+                     << " documents)" << endl;
+        else cout << "Failed to save index to " << filepath << ": " << error << endl;
+    });
+    return job->status.id;
+}
+
+SaveJobStatus SearchEngine::saveJobStatus(int id) {
+    lock_guard<mutex> lock(saveMutex);
+    auto it = saveJobs.find(id);
+    if (it == saveJobs.end()) {
+        SaveJobStatus unknown;
+        unknown.id = id;
+        unknown.state = "unknown";
+        return unknown;
     }
 
-    out.close();
-    cout << "Index successfully saved to " << filepath << endl;
+    SaveJob& job = *it->second;
+    SaveJobStatus status = job.status;
+    status.bytesWritten = job.bytesWritten.load();
+    if (status.state == "running")
+        status.elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - job.started).count();
+    return status;
 }
 
 
@@ -1035,11 +2863,45 @@ void SearchEngine::saveIndex(const string& filepath) {
 
 
 // ---------------- LOAD INDEX FROM DISK (MMAP) ----------------
+// Reads the manifest, then its segments in docID order. An index saved as
+// a single file before segments existed loads as one segment. Every length
+// and offset is checked against its section, and every section against its
+// CRC32C, before anything is trusted.
+// One posting as saveIndex writes it: u32 docID, u32 body frequency with
+// the title frequency in the top byte, u32 n, n u32 positions, n u64 offsets
+static bool readPosting(SectionReader& in, uint32_t& docID, Posting& posting) {
+    uint32_t frequency, n;
+    if (!in.u32(docID) || !in.u32(frequency) || !in.u32(n) || !in.fits(n, 12)) return false;
+
+    posting.frequency = frequency & 0xFFFFFF;
+    posting.titleFrequency = frequency >> 24;
+    posting.positions.resize(n);
+    posting.offsets.resize(n);
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t position;
+        in.u32(position);
+        posting.positions[k] = position;
+    }
+    for (uint32_t k = 0; k < n; k++) {
+        uint64_t byteOffset;
+        in.u64(byteOffset);
+        posting.offsets[k] = byteOffset;
+    }
+    return true;
+}
+
 bool SearchEngine::loadIndex(const string& filepath) {
+    lock_guard<recursive_mutex> writes(writeMutex);
     invalidateCache();
+    auto loadStart = chrono::steady_clock::now();
 
     int fd = open(filepath.c_str(), O_RDONLY);
     if (fd < 0) return false;
+    // The file is there: until it loads, nothing may be saved over it
+    {
+        lock_guard<mutex> lock(saveMutex);
+        unreadableIndexPath = filepath;
+    }
 
     // Get exact file size
     struct stat sb;
@@ -1047,69 +2909,741 @@ bool SearchEngine::loadIndex(const string& filepath) {
 
     if (sb.st_size == 0) { close(fd); return false; }
 
-    // 🔥 MEMORY MAP THE FILE DIRECTLY TO RAM
     char* map = (char*)mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
     if (map == MAP_FAILED) { close(fd); return false; }
+    close(fd);
+
+    string error;
+    IndexFile file;
+    vector<SegmentRef> segments;
+    uint64_t nextSegmentID = 1, walLsn = 0;
+    bool singleFile = false;
+
+    if (file.open(map, sb.st_size, error, false)) {
+        const IndexSection* manifestSection = file.find("MANIFEST");
+        const IndexSection* walSection = file.find("WAL");
+
+        if (!manifestSection) {
+            singleFile = true;
+        } else if (!file.verify(*manifestSection)) {
+            error = "MANIFEST checksum mismatch";
+        } else {
+            SectionReader manifest(file, *manifestSection);
+            uint32_t count = 0;
+            if (!manifest.u64(nextSegmentID) || !manifest.u32(count) || !manifest.fits(count, 20))
+                error = "MANIFEST is malformed";
+            for (uint32_t i = 0; error.empty() && i < count; i++) {
+                SegmentRef segment;
+                if (!manifest.str(segment.file) || !manifest.u64(segment.firstDoc) || !manifest.u64(segment.docCount) ||
+                    segment.file.find('/') != string::npos || segment.docCount == 0)
+                    error = "MANIFEST is truncated";
+                segments.push_back(segment);
+            }
+        }
+
+        // Write-ahead log position (absent: replay the whole log)
+        if (error.empty() && walSection) {
+            SectionReader walReader(file, *walSection);
+            if (!file.verify(*walSection) || !walReader.u64(walLsn)) walLsn = 0;
+        }
+    }
+    munmap(map, sb.st_size);
+
+    if (!error.empty()) {
+        cout << "Cannot load index " << filepath << ": " << error << endl;
+        return false;
+    }
 
-    char* ptr = map; // Pointer to traverse the mapped memory
+    // docCount 0: take the count from the file itself
+    string directory = filepath.substr(0, filepath.find_last_of('/') + 1);
+    if (singleFile) segments = {{filepath.substr(directory.size()), 0, 0}};
+
+    // Every segment is mapped and checked before the current index is
+    // dropped, so a damaged file leaves the engine as it was
+    vector<OpenSegment> opened(segments.size());
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (!openSegment(directory + segments[i].file, opened[i], error)) {
+            cout << "Cannot load index " << filepath << ": " << segments[i].file << ": " << error << endl;
+            return false;
+        }
+    }
 
     clearIndex();
 
-    // 1. Read avgDocLength
-    avgDocLength = *(double*)ptr; ptr += sizeof(double);
+    for (size_t i = 0; i < segments.size(); i++) {
+        const SegmentRef& segment = segments[i];
+        bool loaded = loadSegment(opened[i], segment, segments.size() == 1, error);
+        opened[i] = OpenSegment();   // the engine keeps what it still needs
+        if (!loaded) {
+            cout << "Cannot load index " << filepath << ": " << segment.file << ": " << error << endl;
+            clearIndex();
+            return false;
+        }
+    }
+    auto segmentsLoaded = chrono::steady_clock::now();
+
+    rebuildTermDocIDs();
+    auto docIDsBuilt = chrono::steady_clock::now();
+
+    double totalLength = 0;
+    for (auto& [docID, len] : documentLength) totalLength += len;
+    if (!documentLength.empty()) avgDocLength = totalLength / documentLength.size();
+
+    maybeQuantizeEmbeddings();
+    auto loadEnd = chrono::steady_clock::now();
+    indexWalLsn = walLsn;
+
+    // A single-file index is rewritten as a manifest on the next save
+    savedIndex = SavedIndex();
+    savedIndex.path = filepath;
+    savedIndex.nextSegmentID = nextSegmentID;
+    savedIndex.generation = indexGeneration;
+    if (!singleFile) savedIndex.segments = segments;
+    {
+        lock_guard<mutex> lock(saveMutex);
+        unreadableIndexPath.clear();
+    }
+
+    auto ms = [](chrono::steady_clock::duration d) { return (long long)chrono::duration<double, milli>(d).count(); };
+    cout << "Index successfully loaded via mmap from " << filepath << " (" << segments.size()
+         << (segments.size() == 1 ? " segment" : " segments") << ") in " << ms(loadEnd - loadStart)
+         << "ms: segments " << ms(segmentsLoaded - loadStart) << "ms, docID lists "
+         << ms(docIDsBuilt - segmentsLoaded) << "ms, quantization " << ms(loadEnd - docIDsBuilt) << "ms" << endl;
+    return true;
+}
+
+// Maps a segment file and checks its directory and section CRCs, so a
+// damaged index is rejected before the engine lets go of what it holds
+bool SearchEngine::openSegment(const string& path, OpenSegment& opened, string& error) {
+    auto phaseStart = chrono::steady_clock::now();
+    bool lazy = memoryBudget > 0;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = string("open: ") + strerror(errno);
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || sb.st_size == 0) {
+        error = "empty or unreadable";
+        close(fd);
+        return false;
+    }
+
+    // 🔥 MEMORY MAP THE FILE DIRECTLY TO RAM
+    int mapFlags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (populateMappings && !lazy) mapFlags |= MAP_POPULATE;
+#endif
+    char* map = (char*)mmap(nullptr, sb.st_size, PROT_READ, mapFlags, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        error = string("mmap: ") + strerror(errno);
+        return false;
+    }
+    // Checking the file reads it front to back, and an eager load then
+    // parses nearly all of it: read ahead aggressively, and start fetching
+    // the whole file now unless most of it is to be released again
+    madvise(map, sb.st_size, MADV_SEQUENTIAL);
+    if (!lazy) madvise(map, sb.st_size, MADV_WILLNEED);
+    // Unmapped once neither the embeddings nor the document store use it
+    size_t mappedSize = sb.st_size;
+    opened.mapping = shared_ptr<const char>(map, [mappedSize](const char* p) { munmap((void*)p, mappedSize); });
+    opened.size = mappedSize;
+
+    auto mapped = chrono::steady_clock::now();
+    opened.mapMs = chrono::duration<double, milli>(mapped - phaseStart).count();
+    if (!opened.file.open(map, mappedSize, error)) return false;
+    opened.verifyMs = chrono::duration<double, milli>(chrono::steady_clock::now() - mapped).count();
+    return true;
+}
+
+// Appends one segment's documents to the engine. Its embeddings are used
+// straight from the mapping (zero-copy) when it is the only segment.
+bool SearchEngine::loadSegment(const OpenSegment& opened, const SegmentRef& segment, bool zeroCopy, string& error) {
+    // Time spent per phase, logged once the segment is in
+    ostringstream timings;
+    timings.precision(1);
+    timings << fixed;
+    timings << "map " << opened.mapMs << "ms, verify " << opened.verifyMs << "ms";
+    auto phaseStart = chrono::steady_clock::now();
+    auto lap = [&](const char* phase) {
+        auto now = chrono::steady_clock::now();
+        timings << ", " << phase << " " << chrono::duration<double, milli>(now - phaseStart).count() << "ms";
+        phaseStart = now;
+    };
+
+    bool lazy = memoryBudget > 0;
+    const shared_ptr<const char>& mapping = opened.mapping;
+    const char* map = mapping.get();
+    size_t mappedSize = opened.size;
+    const IndexFile& file = opened.file;
+
+    auto fail = [&](const string& why) {
+        error = why;
+        return false;
+    };
 
-    // 2. Read Documents Array
-    size_t docCount = *(size_t*)ptr; ptr += sizeof(size_t);
-    for (size_t i = 0; i < docCount; i++) {
-        size_t len = *(size_t*)ptr; ptr += sizeof(size_t);
-        documents.push_back(string(ptr, len));
-        ptr += len;
+    const IndexSection* docsSection = file.find("DOCS");
+    const IndexSection* lensSection = file.find("DOCLENS");
+    const IndexSection* dictSection = file.find("DICT");
+    const IndexSection* postingsSection = file.find("POSTINGS");
+    if (!docsSection || !lensSection || !dictSection || !postingsSection)
+        return fail("missing a required section");
+
+    // Segments must continue the docIDs loaded so far
+    uint64_t firstDoc = documents.size();
+    if (firstDoc != segment.firstDoc) return fail("segment does not start at docID " + to_string(firstDoc));
+    if (const IndexSection* segmentSection = file.find("SEGMENT")) {
+        SectionReader header(file, *segmentSection);
+        uint64_t first = 0, count = 0;
+        if (!header.u64(first) || !header.u64(count) || first != segment.firstDoc ||
+            (segment.docCount && count != segment.docCount))
+            return fail("SEGMENT does not match the manifest");
     }
 
-    // 3. Read Document Lengths
-    size_t dlSize = *(size_t*)ptr; ptr += sizeof(size_t);
-    for (size_t i = 0; i < dlSize; i++) {
-        int docID = *(int*)ptr; ptr += sizeof(int);
-        int len = *(int*)ptr; ptr += sizeof(int);
+    // 1. Documents
+    SectionReader docs(file, *docsSection);
+    uint64_t docCount = 0;
+    if (!docs.u64(docCount) || !docs.fits(docCount, 4)) return fail("DOCS is malformed");
+    if (segment.docCount && docCount != segment.docCount) return fail("DOCS does not match the manifest");
+    documents.reserve(firstDoc + docCount);
+    for (uint64_t i = 0; i < docCount; i++) {
+        string name;
+        if (!docs.str(name)) return fail("DOCS is truncated");
+        documents.push_back(move(name));
+    }
+    uint64_t endDoc = firstDoc + docCount;
+
+    // 2. Document lengths (the average is derived once all segments are in)
+    SectionReader lens(file, *lensSection);
+    uint64_t lenCount = 0;
+    if (!lens.u64(lenCount) || !lens.fits(lenCount, 8)) return fail("DOCLENS is malformed");
+    for (uint64_t i = 0; i < lenCount; i++) {
+        uint32_t docID, len;
+        if (!lens.u32(docID) || !lens.u32(len)) return fail("DOCLENS is truncated");
+        if (docID < firstDoc || docID >= endDoc) return fail("DOCLENS refers to a document outside the segment");
         documentLength[docID] = len;
     }
+    lap("docs");
+
+    // 3. Trie and spelling dictionary: the first segment of a full save
+    //    carries both, used in place from the mapping; otherwise the
+    //    dictionary's words are inserted as they are read
+    const IndexSection* trieSection = firstDoc == 0 ? file.find("FTRIE") : nullptr;
+    const IndexSection* spellSection = firstDoc == 0 ? file.find("SPELL") : nullptr;
+    bool haveTrie = trieSection && trie.attach(map + trieSection->offset, trieSection->size, mapping);
+    if (trieSection && !haveTrie) cout << "FTRIE section is malformed, rebuilding it" << endl;
+
+    string spellError;
+    bool haveSpell = spellSection &&
+                     spellDictionary.attach(map + spellSection->offset, spellSection->size, mapping, spellError);
+    if (spellSection && !haveSpell) cout << "SPELL section is malformed, rebuilding it: " << spellError << endl;
+    lap("trie");
+
+    // 4. Dictionary and postings, merged into the terms loaded so far. In
+    //    bounded-memory mode only the docIDs are read; each term remembers
+    //    where its postings are instead.
+    SectionReader dict(file, *dictSection);
+    uint64_t vocabSize = 0;
+    if (!dict.u64(vocabSize) || !dict.fits(vocabSize, 16)) return fail("DICT is malformed");
+    unique_lock<shared_mutex> postingsLock(postingsMutex);
+    if (lazy && termDocIDs.empty()) termDocIDs.reserve(vocabSize);
+    else if (!lazy && invertedIndex.empty()) invertedIndex.reserve(vocabSize);
+    lock_guard<mutex> lazyLock(lazyMutex);
+
+    size_t rangeCount = 1, threadCount = 1;
+    if (lazy) {
+        for (uint64_t i = 0; i < vocabSize; i++) {
+            string word;
+            uint32_t postingCount;
+            uint64_t offset;
+            if (!dict.str(word) || !dict.u32(postingCount) || !dict.u64(offset))
+                return fail("DICT is truncated");
+
+            SectionReader postings(file, *postingsSection, offset);
+            if (!postings.fits(postingCount, 12)) return fail("postings of '" + word + "' are out of range");
+
+            vector<int>& ids = termDocIDs[word];
+            const char* start = postings.position();
+            for (uint32_t j = 0; j < postingCount; j++) {
+                uint32_t docID, frequency, n;
+                const char* rest;
+                if (!postings.u32(docID) || !postings.u32(frequency) || !postings.u32(n) ||
+                    !postings.fits(n, 12) || !postings.bytes(rest, (size_t)n * 12))
+                    return fail("postings of '" + word + "' are truncated");
+                if (docID < firstDoc || docID >= endDoc) return fail("posting refers to a document outside the segment");
+                ids.push_back(docID);
+            }
+            lazyTerms[word].push_back({mapping, start, (size_t)(postings.position() - start), postingCount});
+            if (!haveTrie) trie.insert(word);
+            if (!haveSpell) spellDictionary.add(word);
+        }
+    } else {
+        // Term ranges (DICTRNG, absent in older files: one range of every
+        // term) are decoded on several threads, each into its own list,
+        // then merged in dictionary order on this one
+        vector<pair<uint64_t, uint32_t>> ranges = {{8, (uint32_t)vocabSize}};
+        if (const IndexSection* rangeSection = file.find("DICTRNG")) {
+            SectionReader rangeReader(file, *rangeSection);
+            uint32_t count = 0;
+            uint64_t terms = 0;
+            if (!rangeReader.u32(count) || !rangeReader.fits(count, 12) || count == 0)
+                return fail("DICTRNG is malformed");
+            ranges.assign(count, {0, 0});
+            for (uint32_t r = 0; r < count; r++) {
+                rangeReader.u64(ranges[r].first);
+                rangeReader.u32(ranges[r].second);
+                terms += ranges[r].second;
+                if (ranges[r].first >= dictSection->size || (r == 0 ? ranges[r].first != 8 : ranges[r].first <= ranges[r - 1].first))
+                    return fail("DICTRNG is malformed");
+            }
+            if (terms != vocabSize) return fail("DICTRNG does not match DICT");
+        }
+        rangeCount = ranges.size();
+
+        struct LoadedTerm {
+            string word;
+            PostingMap postings;
+        };
+        vector<vector<LoadedTerm>> loaded(rangeCount);
+        vector<string> rangeErrors(rangeCount);
+
+        // Each range must end where the next begins, which also checks the
+        // ranges split DICT at entry boundaries
+        auto loadRange = [&](size_t r) {
+            SectionReader entries(file, *dictSection, ranges[r].first);
+            const char* end = r + 1 < rangeCount ? map + dictSection->offset + ranges[r + 1].first : nullptr;
+            vector<LoadedTerm>& terms = loaded[r];
+            string& why = rangeErrors[r];
+            terms.resize(ranges[r].second);
+
+            for (LoadedTerm& term : terms) {
+                uint32_t postingCount;
+                uint64_t offset;
+                if (!entries.str(term.word) || !entries.u32(postingCount) || !entries.u64(offset)) {
+                    why = "DICT is truncated";
+                    return;
+                }
+
+                SectionReader postings(file, *postingsSection, offset);
+                if (!postings.fits(postingCount, 12)) {
+                    why = "postings of '" + term.word + "' are out of range";
+                    return;
+                }
+                term.postings.reserve(postingCount);
+                for (uint32_t j = 0; j < postingCount; j++) {
+                    uint32_t docID;
+                    Posting posting;
+                    if (!readPosting(postings, docID, posting)) {
+                        why = "postings of '" + term.word + "' are truncated";
+                        return;
+                    }
+                    if (docID < firstDoc || docID >= endDoc) {
+                        why = "posting refers to a document outside the segment";
+                        return;
+                    }
+                    term.postings[docID] = move(posting);
+                }
+            }
+            if (end && entries.position() != end) why = "DICTRNG does not match DICT";
+        };
+
+        threadCount = loadThreads ? loadThreads : thread::hardware_concurrency();
+        if (threadCount == 0) threadCount = 4;
+        threadCount = min(threadCount, rangeCount);
+
+        if (threadCount == 1) {
+            for (size_t r = 0; r < rangeCount; r++) loadRange(r);
+        } else {
+            // Ranges are handed out one at a time, so a slow one does not
+            // hold up the rest
+            atomic<size_t> nextRange{0};
+            vector<thread> workers;
+            for (size_t t = 0; t < threadCount; t++) {
+                workers.emplace_back([&]() {
+                    for (size_t r; (r = nextRange++) < rangeCount;) loadRange(r);
+                });
+            }
+            for (thread& worker : workers) worker.join();
+        }
+        for (const string& why : rangeErrors)
+            if (!why.empty()) return fail(why);
+
+        for (vector<LoadedTerm>& terms : loaded) {
+            for (LoadedTerm& term : terms) {
+                if (!haveTrie) trie.insert(term.word);
+                if (!haveSpell) spellDictionary.add(term.word);
+                auto [it, inserted] = invertedIndex.try_emplace(move(term.word));
+                if (inserted) {
+                    it->second = make_shared<PostingMap>(move(term.postings));
+                } else {
+                    PostingMap& postingMap = writablePostings(it->first);
+                    for (auto& [docID, posting] : term.postings) postingMap[docID] = move(posting);
+                }
+            }
+            vector<LoadedTerm>().swap(terms);
+        }
+    }
+    lap("postings");
+    timings << " (" << rangeCount << (rangeCount == 1 ? " range, " : " ranges, ") << threadCount
+            << (threadCount == 1 ? " thread)" : " threads)");
+
+    // 5. Embeddings (optional)
+    bool keepMapping = false;
+    if (const IndexSection* embdSection = file.find("EMBD")) {
+        SectionReader embd(file, *embdSection);
+        string model;
+        uint32_t dim = 0;
+        uint64_t stride = 0, rows = 0;
+        const char* flags = nullptr;
+        const char* matrix = nullptr;
+
+        bool ok = embd.str(model) && embd.u32(dim) && embd.u64(stride) && embd.u64(rows) &&
+                  dim > 0 && stride >= dim && stride < (uint64_t)dim + 64 && rows <= docCount &&
+                  embd.bytes(flags, rows) && embd.align() && embd.fits(rows, stride * sizeof(float)) &&
+                  embd.bytes(matrix, rows * stride * sizeof(float));
+
+        if (!ok) {
+            cout << "Embedding section is malformed, skipping it" << endl;
+        }
+        else if (model != embeddingModel) {
+            cout << "Embedding model mismatch: index was embedded with '" << model
+                 << "' but the engine uses '" << embeddingModel
+                 << "'. Semantic search is disabled until documents are re-embedded." << endl;
+        }
+        else if (kLittleEndianHost && zeroCopy && firstDoc == 0) {
+            // Zero-copy: rows are used directly from the mapping
+            documentEmbeddings.attach((const float*)matrix, (const unsigned char*)flags, dim, stride, rows);
+            keepMapping = true;
+
+            documentEmbeddings.forEach([&](int docID, const float*) {
+                annIndex.add(docID);
+            });
+        }
+        else {
+            // Several segments or a big-endian host: decode each row into
+            // owned storage
+            vector<float> row(dim);
+            for (uint64_t r = 0; r < rows; r++) {
+                if (!flags[r]) continue;
+                const unsigned char* src = (const unsigned char*)matrix + r * stride * sizeof(float);
+                for (uint32_t i = 0; i < dim; i++) {
+                    uint32_t bits = src[4 * i] | (src[4 * i + 1] << 8) | (src[4 * i + 2] << 16) |
+                                    ((uint32_t)src[4 * i + 3] << 24);
+                    memcpy(&row[i], &bits, sizeof(float));
+                }
+                storeEmbedding(firstDoc + r, row);
+            }
+        }
+    }
+    lap("embeddings");
+
+    // 6. Document texts, read from the mapping block by block (optional:
+    //    without them snippets are empty)
+    if (const IndexSection* storeSection = file.find("DSTORE")) {
+        string storeError;
+        if (!docStore.attach(map + storeSection->offset, storeSection->size, mapping, storeError))
+            cout << "Document store is malformed, skipping it: " << storeError << endl;
+    }
+    lap("docstore");
+
+    // Later reads (embeddings, document blocks, lazy postings) are random.
+    // Opening the file read every section to check it; in bounded-memory
+    // mode nothing but borrowed embeddings needs to stay resident.
+    madvise((void*)map, mappedSize, MADV_NORMAL);
+    if (lazy) {
+        for (const IndexSection& section : file.sections())
+            if (!(keepMapping && section.tag == "EMBD")) releaseMappedPages(map + section.offset, section.size);
+    }
+
+    mappedSegments.push_back({mapping, mappedSize});
+    if (keepMapping) indexMapping = mapping;
+
+    cout << "Loaded segment " << segment.file << " (" << docCount << " docs, " << vocabSize << " terms"
+         << (lazy ? ", lazy" : "") << "): " << timings.str() << endl;
+    return true;
+}
+
+
+
+
+
+void SearchEngine::releaseIndexMapping() {
+    indexMapping.reset();
+}
+
 
-    // 4. Read Inverted Index
-    size_t vocabSize = *(size_t*)ptr; ptr += sizeof(size_t);
-    for (size_t i = 0; i < vocabSize; i++) {
-        size_t wordLen = *(size_t*)ptr; ptr += sizeof(size_t);
-        string word(ptr, wordLen);
-        ptr += wordLen;
 
-        trie.insert(word); // Rebuild Trie on the fly
 
-        size_t mapSize = *(size_t*)ptr; ptr += sizeof(size_t);
-        for (size_t j = 0; j < mapSize; j++) {
-            int docID = *(int*)ptr; ptr += sizeof(int);
-            
-            Posting& posting = invertedIndex[word][docID];
-            posting.frequency = *(int*)ptr; ptr += sizeof(int);
 
-            size_t posSize = *(size_t*)ptr; ptr += sizeof(size_t);
-            posting.positions.resize(posSize);
-            memcpy(posting.positions.data(), ptr, posSize * sizeof(int));
-            ptr += posSize * sizeof(int);
+// ---------------- BOUNDED MEMORY ----------------
+// Heap bytes of a posting map: buckets, nodes and position / offset arrays
+static size_t postingMapBytes(const PostingMap& postingMap) {
+    size_t bytes = postingMap.bucket_count() * sizeof(void*);
+    for (const auto& [docID, posting] : postingMap)
+        bytes += sizeof(pair<const int, Posting>) + 2 * sizeof(void*) +
+                 posting.positions.capacity() * sizeof(int) + posting.offsets.capacity() * sizeof(long long);
+    return bytes;
+}
+
+shared_ptr<const PostingMap> SearchEngine::postingsFor(const string& term) {
+    {
+        shared_lock<shared_mutex> lock(postingsMutex);
+        auto heap = invertedIndex.find(term);
+        if (heap != invertedIndex.end()) return heap->second;
+    }
+
+    vector<PostingExtent> extents;
+    {
+        lock_guard<mutex> lock(lazyMutex);
+        auto lazy = lazyTerms.find(term);
+        if (lazy == lazyTerms.end()) return nullptr;
+        extents = lazy->second;   // holds the mappings while decoding
+    }
+    if (shared_ptr<const PostingMap> cached = postingCache.get(term)) return cached;
+
+    auto decoded = make_shared<const PostingMap>(decodeExtents(extents));
+    postingCache.put(term, decoded, postingMapBytes(*decoded));
+    return decoded;
+}
 
-            size_t offSize = *(size_t*)ptr; ptr += sizeof(size_t);
-            posting.offsets.resize(offSize);
-            memcpy(posting.offsets.data(), ptr, offSize * sizeof(long long));
-            ptr += offSize * sizeof(long long);
+// The extents were checked when their segment was loaded. Their pages are
+// released once decoded: the cache holds the only resident copy.
+PostingMap SearchEngine::decodeExtents(const vector<PostingExtent>& extents) {
+    size_t total = 0;
+    for (const PostingExtent& extent : extents) total += extent.count;
+
+    PostingMap postingMap;
+    postingMap.reserve(total);
+    for (const PostingExtent& extent : extents) {
+        SectionReader postings(extent.data, extent.size);
+        for (uint32_t j = 0; j < extent.count; j++) {
+            uint32_t docID;
+            Posting posting;
+            if (!readPosting(postings, docID, posting)) break;
+            postingMap[docID] = move(posting);
         }
+        releaseMappedPages(extent.data, extent.size);
     }
+    return postingMap;
+}
 
-    // Clean up memory mapping
-    munmap(map, sb.st_size);
-    close(fd);
+// Moves a lazy term into invertedIndex before a document is added to it
+// (postingsMutex held by the caller)
+void SearchEngine::materializeLazyTerm(const string& term) {
+    vector<PostingExtent> extents;
+    {
+        lock_guard<mutex> lock(lazyMutex);
+        auto lazy = lazyTerms.find(term);
+        if (lazy == lazyTerms.end()) return;
+        extents = lazy->second;
+    }
+    invertedIndex[term] = make_shared<PostingMap>(decodeExtents(extents));
+
+    lock_guard<mutex> lock(lazyMutex);
+    lazyTerms.erase(term);
+    postingCache.erase(term);
+}
 
-    cout << "Index successfully loaded via mmap from " << filepath << endl;
+// A list still held by a reader lives on until the reader lets go
+PostingMap& SearchEngine::writablePostings(const string& term) {
+    shared_ptr<PostingMap>& postingMap = invertedIndex[term];
+    if (!postingMap) postingMap = make_shared<PostingMap>();
+    else if (postingMap.use_count() > 1) postingMap = make_shared<PostingMap>(*postingMap);
+    return *postingMap;
+}
+
+void SearchEngine::clearPostings() {
+    {
+        unique_lock<shared_mutex> lock(postingsMutex);
+        invertedIndex.clear();
+    }
+    lock_guard<mutex> lock(lazyMutex);
+    lazyTerms.clear();
+    postingCache.clear();
+    mappedSegments.clear();
+}
+
+void SearchEngine::setMemoryBudget(size_t bytes) {
+    memoryBudget = bytes;
+    postingCache.setBudget(bytes);
+    docStore.setReleaseMappedPages(bytes > 0);
+}
+
+size_t SearchEngine::getMemoryBudget() const {
+    return memoryBudget;
+}
+
+void SearchEngine::setLoadOptions(unsigned threads, bool populate) {
+    loadThreads = threads;
+    populateMappings = populate;
+}
+
+void SearchEngine::pinTerm(const string& term) {
+    postingCache.pin(normalize(term));
+}
+
+ResidentCacheStats SearchEngine::postingCacheStats() {
+    return postingCache.stats();
+}
+
+vector<MemoryUsage> SearchEngine::memoryReport() {
+    constexpr size_t kNode = 2 * sizeof(void*);   // per hash node overhead
+    vector<MemoryUsage> report;
+
+    size_t names = documents.capacity() * sizeof(string);
+    for (const string& name : documents) names += name.capacity();
+    report.push_back({"documents", names});
+    report.push_back({"document_lengths", documentLength.size() * (sizeof(pair<const int, int>) + kNode) +
+                                          documentLength.bucket_count() * sizeof(void*)});
+
+    size_t postings = 0;
+    {
+        shared_lock<shared_mutex> lock(postingsMutex);
+        postings = invertedIndex.bucket_count() * sizeof(void*);
+        for (const auto& [term, postingMap] : invertedIndex)
+            postings += sizeof(pair<const string, shared_ptr<PostingMap>>) + kNode + term.capacity() +
+                        sizeof(PostingMap) + postingMapBytes(*postingMap);
+    }
+    report.push_back({"postings", postings});
+    report.push_back({"postings_cache", postingCache.stats().residentBytes});
+
+    size_t lazy = 0;
+    {
+        lock_guard<mutex> lock(lazyMutex);
+        lazy = lazyTerms.bucket_count() * sizeof(void*);
+        for (const auto& [term, extents] : lazyTerms)
+            lazy += sizeof(pair<const string, vector<PostingExtent>>) + kNode + term.capacity() +
+                    extents.capacity() * sizeof(PostingExtent);
+    }
+    report.push_back({"lazy_dictionary", lazy});
+
+    size_t docIDs = termDocIDs.bucket_count() * sizeof(void*);
+    for (const auto& [term, ids] : termDocIDs)
+        docIDs += sizeof(pair<const string, vector<int>>) + kNode + term.capacity() + ids.capacity() * sizeof(int);
+    report.push_back({"term_docids", docIDs});
+
+    size_t bitmaps = 0;
+    for (const auto& [term, bitmap] : denseTermBitmaps) bitmaps += bitmap.memoryBytes();
+    report.push_back({"dense_bitmaps", bitmaps});
+
+    DocStoreMemory store = docStore.memory();
+    report.push_back({"doc_store", store.heapBytes});
+    report.push_back({"doc_store_cache", store.cacheBytes});
+    report.push_back({"passage_bounds", passageBoundsCache.stats().residentBytes});
+    report.push_back({"embeddings", documentEmbeddings.memoryBytes()});
+    report.push_back({"quantized_embeddings", quantizedEmbeddings.memoryBytes()});
+    {
+        lock_guard<mutex> lock(impactMutex);
+        report.push_back({"impact_index", impactIndex ? impactIndex->memoryBytes() : 0});
+    }
+
+    // Segment mappings still referenced (lazy postings, document store
+    // blocks, borrowed embeddings) and how much of them is paged in
+    size_t mapped = 0, resident = 0;
+    {
+        lock_guard<mutex> lock(lazyMutex);
+        for (const MappedSegment& segment : mappedSegments) {
+            shared_ptr<const char> mapping = segment.mapping.lock();
+            if (!mapping) continue;
+            mapped += segment.size;
+            resident += min(segment.size, residentMappedBytes(mapping.get(), segment.size));
+        }
+    }
+    report.push_back({"mapped_segments", mapped});
+    report.push_back({"mapped_resident", resident});
+    return report;
+}
+
+
+
+
+
+// ---------------- WRITE-AHEAD LOG ----------------
+// Brings the engine from the loaded index up to the last acknowledged
+// upload. Replayed uploads get their file back from the record if it is
+// missing, so cleanupOrphanFiles keeps them.
+bool SearchEngine::openWriteAheadLog(const string& path) {
+    namespace fs = std::filesystem;
+    lock_guard<recursive_mutex> lock(writeMutex);
+
+    string error;
+    if (!wal.open(path, indexWalLsn, error)) {
+        cout << "Cannot open write-ahead log " << path << ": " << error << endl;
+        return false;
+    }
+
+    size_t added = 0, cleared = 0;
+    bool ok = wal.replay(indexWalLsn, [&](const WalRecord& record) {
+        if (record.op == WalOp::ClearCorpus) {
+            clearIndex();
+            removeCorpusFiles();
+            cleared++;
+            return;
+        }
+
+        if (!fs::exists(record.path)) {
+            ofstream out(record.path, ios::binary);
+            out.write(record.content.data(), record.content.size());
+        }
+        applyDocument(record.path, record.content, record.embedding, true);
+        added++;
+    }, error);
+
+    if (!ok) {
+        cout << "Cannot replay write-ahead log " << path << ": " << error << endl;
+        return false;
+    }
+    if (added || cleared)
+        cout << "Replayed write-ahead log: " << added << " uploads, " << cleared << " clears" << endl;
     return true;
 }
 
+WalStats SearchEngine::writeAheadLogStats() {
+    return wal.stats();
+}
+
+void SearchEngine::clearCorpus(const string& indexPath) {
+    namespace fs = std::filesystem;
+    lock_guard<recursive_mutex> lock(writeMutex);
+
+    uint64_t lsn = 0;
+    if (wal.isOpen()) {
+        WalRecord record;
+        record.op = WalOp::ClearCorpus;
+        lsn = wal.append(move(record));
+        if (lsn) wal.sync(lsn);
+    }
+
+    clearIndex();
+    removeCorpusFiles();
+    if (fs::exists(indexPath)) fs::remove(indexPath);
+
+    // The saved index's segments go with its manifest
+    if (savedIndex.path == indexPath) {
+        string directory = indexPath.substr(0, indexPath.find_last_of('/') + 1);
+        for (const SegmentRef& segment : savedIndex.segments) fs::remove(directory + segment.file);
+    }
+    savedIndex = SavedIndex();
+    {
+        lock_guard<mutex> saveLock(saveMutex);
+        if (unreadableIndexPath == indexPath) unreadableIndexPath.clear();
+    }
+
+    // Nothing before the clear matters once the saved index is gone
+    if (lsn) wal.truncateThrough(lsn);
+}
+
+void SearchEngine::removeCorpusFiles() {
+    namespace fs = std::filesystem;
+    for (const auto& entry : fs::directory_iterator("../runtime_corpus")) {
+        if (entry.is_regular_file()) {
+            fs::remove(entry.path());
+        }
+    }
+}
+
 
 
 
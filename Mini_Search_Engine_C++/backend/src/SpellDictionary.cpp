@@ -0,0 +1,177 @@
+#include "SpellDictionary.h"
+#include "IndexFormat.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+// ---------------- EDIT DISTANCE (LEVENSHTEIN) ----------------
+// Two rows of the DP table, reused across calls through row
+static int levenshtein(const char* a, size_t n, const char* b, size_t m, vector<int>& row) {
+    row.resize(m + 1);
+    for (size_t j = 0; j <= m; j++) row[j] = j;
+
+    for (size_t i = 1; i <= n; i++) {
+        int diagonal = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= m; j++) {
+            int above = row[j];
+            if (a[i - 1] == b[j - 1])
+                row[j] = diagonal;
+            else
+                row[j] = 1 + min({above,          // delete
+                                  row[j - 1],     // insert
+                                  diagonal});     // replace
+            diagonal = above;
+        }
+    }
+    return row[m];
+}
+
+int editDistance(const string& a, const string& b) {
+    vector<int> row;
+    return levenshtein(a.data(), a.size(), b.data(), b.size(), row);
+}
+
+
+// ---------------- DICTIONARY ----------------
+void SpellDictionary::clear() {
+    *this = SpellDictionary();
+}
+
+bool SpellDictionary::contains(const string& term) const {
+    if (addedTerms.count(term)) return true;
+    if (term.size() > longest || termCount == 0) return false;
+
+    // Terms of one length are sorted by bytes
+    uint32_t lo = lengthStart[term.size()], hi = lengthStart[term.size() + 1];
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(bytes + offsets[mid], term.data(), term.size());
+        if (cmp == 0) return true;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return false;
+}
+
+void SpellDictionary::add(const string& term) {
+    if (contains(term)) return;
+    addedTerms.insert(term);
+    if (added.size() <= term.size()) added.resize(term.size() + 1);
+    added[term.size()].push_back(term);
+}
+
+size_t SpellDictionary::size() const {
+    return termCount + addedTerms.size();
+}
+
+string SpellDictionary::correct(const string& word, const function<size_t(const string&)>& df) const {
+    string bestWord = word;
+    int bestDist = INT_MAX;
+    long long bestDF = -1;
+    vector<int> row;
+
+    auto consider = [&](const char* term, size_t length) {
+        int dist = levenshtein(word.data(), word.size(), term, length, row);
+        if (dist > bestDist) return;
+
+        string candidate(term, length);
+        long long candidateDF = df(candidate);
+        if (dist < bestDist || candidateDF > bestDF) {
+            bestDist = dist;
+            bestWord = move(candidate);
+            bestDF = candidateDF;
+        }
+    };
+    auto scanLength = [&](size_t length) {
+        if (termCount > 0 && length <= longest) {
+            for (uint32_t i = lengthStart[length]; i < lengthStart[length + 1]; i++)
+                consider(bytes + offsets[i], length);
+        }
+        if (length < added.size()) {
+            for (const string& term : added[length]) consider(term.data(), term.size());
+        }
+    };
+
+    size_t maxLength = max<size_t>(longest, added.empty() ? 0 : added.size() - 1);
+    for (size_t diff = 0; diff <= max(word.size(), maxLength); diff++) {
+        if ((long long)diff > bestDist) break;   // nothing further away can be closer
+        if (diff <= word.size()) scanLength(word.size() - diff);
+        if (diff > 0 && word.size() + diff <= maxLength) scanLength(word.size() + diff);
+    }
+    return bestWord;
+}
+
+
+// ---------------- SERIALIZATION ----------------
+static void putU32(string& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back((char)(v >> (8 * i)));
+}
+
+string SpellDictionary::serialize() const {
+    vector<string> terms;
+    terms.reserve(size());
+    for (uint32_t i = 0; i < termCount; i++) terms.push_back(baseTerm(i));
+    terms.insert(terms.end(), addedTerms.begin(), addedTerms.end());
+    sort(terms.begin(), terms.end(), [](const string& a, const string& b) {
+        return a.size() != b.size() ? a.size() < b.size() : a < b;
+    });
+
+    uint32_t maxLength = terms.empty() ? 0 : terms.back().size();
+    string out;
+    putU32(out, terms.size());
+    putU32(out, maxLength);
+
+    size_t next = 0;
+    for (uint32_t length = 0; length <= maxLength + 1; length++) {
+        while (next < terms.size() && terms[next].size() < length) next++;
+        putU32(out, next);
+    }
+
+    uint32_t offset = 0;
+    putU32(out, 0);
+    for (const string& term : terms) putU32(out, offset += term.size());
+    for (const string& term : terms) out += term;
+    return out;
+}
+
+bool SpellDictionary::attach(const char* data, size_t size, shared_ptr<const char> mapping, string& error) {
+    auto u32At = [&](size_t at) {
+        const unsigned char* p = (const unsigned char*)data + at;
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    };
+    error = "dictionary is malformed";
+    if (size < 8) return false;
+    uint64_t count = u32At(0), maxLength = u32At(4);
+    uint64_t arrays = (maxLength + 2) + (count + 1);
+    if (maxLength > (1u << 20) || count > size / 4 || 8 + 4 * arrays > size) return false;
+
+    SpellDictionary dictionary;
+    dictionary.owner = move(mapping);
+    dictionary.termCount = count;
+    dictionary.longest = maxLength;
+    if (kLittleEndianHost && (uintptr_t)data % 4 == 0) {
+        dictionary.lengthStart = (const uint32_t*)(data + 8);
+    } else {
+        dictionary.copied.resize(arrays);
+        for (size_t i = 0; i < arrays; i++) dictionary.copied[i] = u32At(8 + 4 * i);
+        dictionary.lengthStart = dictionary.copied.data();
+    }
+    dictionary.offsets = dictionary.lengthStart + maxLength + 2;
+    dictionary.bytes = data + 8 + 4 * arrays;
+
+    const uint32_t* lengthStart = dictionary.lengthStart;
+    const uint32_t* offsets = dictionary.offsets;
+    size_t byteCount = size - 8 - 4 * arrays;
+    if (lengthStart[0] != 0 || lengthStart[maxLength + 1] != count || offsets[0] != 0 || offsets[count] != byteCount)
+        return false;
+    for (uint64_t length = 0; length <= maxLength; length++) {
+        if (lengthStart[length + 1] < lengthStart[length]) return false;
+        for (uint32_t i = lengthStart[length]; i < lengthStart[length + 1]; i++)
+            if (offsets[i + 1] < offsets[i] || offsets[i + 1] - offsets[i] != length) return false;
+    }
+
+    *this = move(dictionary);
+    error.clear();
+    return true;
+}
@@ -1,10 +1,16 @@
 #include "Trie.h"
+#include "IndexFormat.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 
 Trie::Trie() {
     root = new TrieNode();
 }
 
 void Trie::insert(const string& word) {
+    if (base.contains(word)) return;
+
     TrieNode* curr = root;
     for (char c : word) {
         if (curr->children.find(c) == curr->children.end()) {
@@ -16,19 +22,27 @@ void Trie::insert(const string& word) {
 }
 
 vector<string> Trie::autocomplete(const string& prefix) {
+    vector<string> results;
+
+    // Inserted words are never in the flat trie, so the two do not overlap
+    uint32_t flat = base.find(prefix);
+    if (flat != FlatTrie::kNone) {
+        string current = prefix;
+        flatDfs(flat, current, results);
+    }
+
     TrieNode* curr = root;
     for (char c : prefix) {
         if (curr->children.find(c) == curr->children.end())
-            return {};
+            return results;
         curr = curr->children[c];
     }
 
-    vector<string> results;
     dfs(curr, prefix, results);
     return results;
 }
 
-void Trie::dfs(TrieNode* node, string current, vector<string>& results) {
+void Trie::dfs(TrieNode* node, string current, vector<string>& results) const {
     if (!node) return;
 
     if (node->isEnd)
@@ -39,3 +53,263 @@ void Trie::dfs(TrieNode* node, string current, vector<string>& results) {
             dfs(child, current + ch, results);
     }
 }
+
+void Trie::flatDfs(uint32_t node, string& current, vector<string>& results) const {
+    if (base.isEnd(node)) results.push_back(current);
+    for (uint32_t edge = base.edgeBegin(node); edge < base.edgeEnd(node); edge++) {
+        current.push_back(base.label(edge));
+        flatDfs(base.child(edge), current, results);
+        current.pop_back();
+    }
+}
+
+// ---------------- WILDCARD MATCH ----------------
+// The pattern runs as an NFA alongside a DFS of the trie: a node is visited
+// once with the set of pattern positions reachable there, so '*' never
+// causes backtracking. The walk is shared by both tries: children(node, f)
+// calls f(ch, child) for each child and isEnd(node) marks words.
+template <typename Node, typename Children, typename IsEnd>
+static bool matchWalk(Node start, const string& prefix, const string& rest, Children children, IsEnd isEnd,
+                      size_t maxNodes, chrono::steady_clock::time_point deadline, size_t& visited,
+                      vector<string>& results) {
+    size_t n = rest.size();
+
+    // Positions reachable from `states` without consuming a character
+    auto closure = [&](vector<char>& states) {
+        for (size_t i = 0; i < n; i++)
+            if (states[i] && rest[i] == '*') states[i + 1] = 1;
+    };
+
+    struct Frame {
+        Node node;
+        string word;
+        vector<char> states;
+    };
+
+    vector<char> initial(n + 1, 0);
+    initial[0] = 1;
+    closure(initial);
+
+    vector<Frame> stack;
+    stack.push_back({start, prefix, initial});
+
+    while (!stack.empty()) {
+        if (++visited > maxNodes ||
+            ((visited & 255) == 0 && chrono::steady_clock::now() > deadline))
+            return false;
+
+        Frame frame = move(stack.back());
+        stack.pop_back();
+
+        if (isEnd(frame.node) && frame.states[n])
+            results.push_back(frame.word);
+
+        children(frame.node, [&](char ch, Node child) {
+            vector<char> next(n + 1, 0);
+            bool alive = false;
+            for (size_t i = 0; i < n; i++) {
+                if (!frame.states[i]) continue;
+                if (rest[i] == '*') { next[i] = 1; alive = true; }
+                else if (rest[i] == '?' || rest[i] == ch) { next[i + 1] = 1; alive = true; }
+            }
+            if (!alive) return;
+
+            closure(next);
+            stack.push_back({child, frame.word + ch, move(next)});
+        });
+    }
+    return true;
+}
+
+vector<string> Trie::match(const string& pattern, size_t maxNodes, double maxMillis, bool& truncated) {
+    truncated = false;
+    vector<string> results;
+
+    // Literal prefix: walk straight down before branching
+    size_t prefixLen = pattern.find_first_of("*?");
+    if (prefixLen == string::npos) prefixLen = pattern.size();
+    string prefix = pattern.substr(0, prefixLen);
+    string rest = pattern.substr(prefixLen);
+
+    auto deadline = chrono::steady_clock::now() +
+                    chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, milli>(maxMillis));
+    size_t visited = 0;
+
+    uint32_t flat = base.find(prefix);
+    if (flat != FlatTrie::kNone) {
+        bool complete = matchWalk(flat, prefix, rest,
+            [&](uint32_t node, auto&& visit) {
+                for (uint32_t edge = base.edgeBegin(node); edge < base.edgeEnd(node); edge++)
+                    visit(base.label(edge), base.child(edge));
+            },
+            [&](uint32_t node) { return base.isEnd(node); },
+            maxNodes, deadline, visited, results);
+        if (!complete) {
+            truncated = true;
+            return results;
+        }
+    }
+
+    TrieNode* start = root;
+    for (char c : prefix) {
+        auto it = start->children.find(c);
+        if (it == start->children.end()) return results;
+        start = it->second;
+    }
+
+    truncated = !matchWalk(start, prefix, rest,
+        [](TrieNode* node, auto&& visit) {
+            for (auto& [ch, child] : node->children)
+                if (child) visit(ch, child);
+        },
+        [](TrieNode* node) { return node->isEnd; },
+        maxNodes, deadline, visited, results);
+    return results;
+}
+
+
+// ---------------- SERIALIZATION ----------------
+string Trie::serialize() const {
+    vector<string> words;
+    if (!base.empty()) {
+        string current;
+        flatDfs(base.root(), current, words);
+    }
+    dfs(root, "", words);
+
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+    return FlatTrie::build(words);
+}
+
+bool Trie::attach(const char* data, size_t size, shared_ptr<const char> owner) {
+    FlatTrie flat;
+    if (!flat.attach(data, size, move(owner))) return false;
+    base = move(flat);
+    root = new TrieNode();
+    return true;
+}
+
+
+// ---------------- FLAT TRIE ----------------
+static void putU32(string& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back((char)(v >> (8 * i)));
+}
+
+// Preorder over the sorted words: a node takes the next number and
+// reserves its edges before any child is built, so each node's edges are
+// contiguous and every child numbers above its parent
+string FlatTrie::build(const vector<string>& words) {
+    vector<uint32_t> firstEdge, child;
+    string labels;
+    string ends;
+
+    struct Frame {
+        size_t cursor, hi, depth;
+        uint32_t nextEdge;
+    };
+    vector<Frame> stack;
+
+    auto newNode = [&](size_t lo, size_t hi, size_t depth) {
+        bool end = lo < hi && words[lo].size() == depth;   // sorts first in its range
+        ends.push_back(end);
+        size_t cursor = lo + end;
+
+        size_t groups = 0;
+        for (size_t k = cursor; k < hi; k++)
+            if (k == cursor || words[k][depth] != words[k - 1][depth]) groups++;
+
+        uint32_t edge = child.size();
+        firstEdge.push_back(edge);
+        child.resize(edge + groups);
+        labels.resize(edge + groups);
+        stack.push_back({cursor, hi, depth, edge});
+    };
+
+    newNode(0, words.size(), 0);
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.cursor == frame.hi) {
+            stack.pop_back();
+            continue;
+        }
+
+        size_t lo = frame.cursor, depth = frame.depth;
+        char c = words[lo][depth];
+        size_t end = lo;
+        while (end < frame.hi && words[end][depth] == c) end++;
+
+        labels[frame.nextEdge] = c;
+        child[frame.nextEdge] = ends.size();   // the node built next
+        frame.nextEdge++;
+        frame.cursor = end;
+        newNode(lo, end, depth + 1);
+    }
+    firstEdge.push_back(child.size());
+
+    string out;
+    putU32(out, ends.size());
+    putU32(out, child.size());
+    for (uint32_t v : firstEdge) putU32(out, v);
+    for (uint32_t v : child) putU32(out, v);
+    out += labels;
+    out += ends;
+    return out;
+}
+
+bool FlatTrie::attach(const char* data, size_t size, shared_ptr<const char> mapping) {
+    auto u32At = [&](size_t at) {
+        const unsigned char* p = (const unsigned char*)data + at;
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    };
+    if (size < 8) return false;
+    uint64_t n = u32At(0), e = u32At(4);
+    if (n == 0 || size != 8 + 4 * (n + 1) + 4 * e + e + n) return false;
+
+    FlatTrie flat;
+    flat.owner = move(mapping);
+    flat.nodes = n;
+    if (kLittleEndianHost && (uintptr_t)data % 4 == 0) {
+        flat.firstEdge = (const uint32_t*)(data + 8);
+    } else {
+        flat.copied.resize(n + 1 + e);
+        for (size_t i = 0; i < flat.copied.size(); i++) flat.copied[i] = u32At(8 + 4 * i);
+        flat.firstEdge = flat.copied.data();
+    }
+    flat.children = flat.firstEdge + n + 1;
+    flat.labels = data + 8 + 4 * (n + 1 + e);
+    flat.ends = (const unsigned char*)flat.labels + e;
+
+    if (flat.firstEdge[0] != 0 || flat.firstEdge[n] != e) return false;
+    for (uint32_t node = 0; node < n; node++) {
+        uint32_t begin = flat.firstEdge[node], end = flat.firstEdge[node + 1];
+        if (end < begin || end > e) return false;
+        for (uint32_t edge = begin; edge < end; edge++) {
+            if (flat.children[edge] <= node || flat.children[edge] >= n) return false;
+            if (edge > begin && (unsigned char)flat.labels[edge] <= (unsigned char)flat.labels[edge - 1]) return false;
+        }
+    }
+
+    *this = move(flat);
+    return true;
+}
+
+uint32_t FlatTrie::find(const string& prefix) const {
+    if (nodes == 0) return kNone;
+    uint32_t node = 0;
+    for (char c : prefix) {
+        const char* begin = labels + firstEdge[node];
+        const char* end = labels + firstEdge[node + 1];
+        const char* it = lower_bound(begin, end, c, [](char a, char b) {
+            return (unsigned char)a < (unsigned char)b;
+        });
+        if (it == end || *it != c) return kNone;
+        node = children[it - labels];
+    }
+    return node;
+}
+
+bool FlatTrie::contains(const string& word) const {
+    uint32_t node = find(word);
+    return node != kNone && isEnd(node);
+}
@@ -0,0 +1,197 @@
+#include "VectorKernels.h"
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VK_HAVE_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define VK_HAVE_NEON 1
+#endif
+
+using namespace std;
+
+
+// ---------------- SCALAR ----------------
+float dotProductScalar(const float* a, const float* b, size_t dim) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= dim; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < dim; i++)
+        s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+static void dotProductBatchScalar(const float* query, const float* matrix, size_t stride,
+                                  size_t rows, size_t dim, float* out) {
+    for (size_t r = 0; r < rows; r++)
+        out[r] = dotProductScalar(query, matrix + r * stride, dim);
+}
+
+
+// ---------------- AVX2 + FMA ----------------
+#ifdef VK_HAVE_X86
+__attribute__((target("avx2,fma")))
+static inline float horizontalSum(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    lo = _mm_hadd_ps(lo, lo);
+    lo = _mm_hadd_ps(lo, lo);
+    return _mm_cvtss_f32(lo);
+}
+
+__attribute__((target("avx2,fma")))
+static float dotProductAVX2(const float* a, const float* b, size_t dim) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 32 <= dim; i += 32) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i),      _mm256_loadu_ps(b + i),      acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8),  _mm256_loadu_ps(b + i + 8),  acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+    }
+    for (; i + 8 <= dim; i += 8)
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+
+    float sum = horizontalSum(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+    for (; i < dim; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+// Four rows per pass so every query load feeds four FMAs
+__attribute__((target("avx2,fma")))
+static void dotProductBatchAVX2(const float* query, const float* matrix, size_t stride,
+                                size_t rows, size_t dim, float* out) {
+    size_t r = 0;
+    for (; r + 4 <= rows; r += 4) {
+        const float* m0 = matrix + r * stride;
+        const float* m1 = m0 + stride;
+        const float* m2 = m1 + stride;
+        const float* m3 = m2 + stride;
+
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+
+        size_t i = 0;
+        for (; i + 8 <= dim; i += 8) {
+            __m256 q = _mm256_loadu_ps(query + i);
+            acc0 = _mm256_fmadd_ps(q, _mm256_loadu_ps(m0 + i), acc0);
+            acc1 = _mm256_fmadd_ps(q, _mm256_loadu_ps(m1 + i), acc1);
+            acc2 = _mm256_fmadd_ps(q, _mm256_loadu_ps(m2 + i), acc2);
+            acc3 = _mm256_fmadd_ps(q, _mm256_loadu_ps(m3 + i), acc3);
+        }
+
+        float s0 = horizontalSum(acc0), s1 = horizontalSum(acc1);
+        float s2 = horizontalSum(acc2), s3 = horizontalSum(acc3);
+        for (; i < dim; i++) {
+            s0 += query[i] * m0[i];
+            s1 += query[i] * m1[i];
+            s2 += query[i] * m2[i];
+            s3 += query[i] * m3[i];
+        }
+        out[r] = s0; out[r + 1] = s1; out[r + 2] = s2; out[r + 3] = s3;
+    }
+    for (; r < rows; r++)
+        out[r] = dotProductAVX2(query, matrix + r * stride, dim);
+}
+#endif
+
+
+// ---------------- NEON ----------------
+#ifdef VK_HAVE_NEON
+static float dotProductNEON(const float* a, const float* b, size_t dim) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    float32x4_t acc2 = vdupq_n_f32(0.0f);
+    float32x4_t acc3 = vdupq_n_f32(0.0f);
+
+    size_t i = 0;
+    for (; i + 16 <= dim; i += 16) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i),      vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4),  vld1q_f32(b + i + 4));
+        acc2 = vfmaq_f32(acc2, vld1q_f32(a + i + 8),  vld1q_f32(b + i + 8));
+        acc3 = vfmaq_f32(acc3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+    }
+    for (; i + 4 <= dim; i += 4)
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+
+    float sum = vaddvq_f32(vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3)));
+    for (; i < dim; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static void dotProductBatchNEON(const float* query, const float* matrix, size_t stride,
+                                size_t rows, size_t dim, float* out) {
+    for (size_t r = 0; r < rows; r++)
+        out[r] = dotProductNEON(query, matrix + r * stride, dim);
+}
+#endif
+
+
+// ---------------- RUNTIME DISPATCH ----------------
+namespace {
+
+struct DotKernels {
+    float (*single)(const float*, const float*, size_t) = dotProductScalar;
+    void (*batch)(const float*, const float*, size_t, size_t, size_t, float*) = dotProductBatchScalar;
+    const char* name = "scalar";
+
+    DotKernels() {
+#if defined(VK_HAVE_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            single = dotProductAVX2;
+            batch = dotProductBatchAVX2;
+            name = "avx2-fma";
+        }
+#elif defined(VK_HAVE_NEON)
+        single = dotProductNEON;
+        batch = dotProductBatchNEON;
+        name = "neon";
+#endif
+    }
+};
+
+const DotKernels& kernels() {
+    static const DotKernels selected;
+    return selected;
+}
+
+}
+
+float dotProduct(const float* a, const float* b, size_t dim) {
+    return kernels().single(a, b, dim);
+}
+
+void dotProductBatch(const float* query, const float* matrix, size_t stride,
+                     size_t rows, size_t dim, float* out) {
+    kernels().batch(query, matrix, stride, rows, dim, out);
+}
+
+const char* activeDotKernel() {
+    return kernels().name;
+}
+
+bool normalizeVector(vector<float>& vec) {
+    double norm = 0.0;
+    for (float v : vec) norm += (double)v * v;
+    if (norm == 0.0) return false;
+
+    float inv = (float)(1.0 / sqrt(norm));
+    for (float& v : vec) v *= inv;
+    return true;
+}
@@ -0,0 +1,370 @@
+#include "WriteAheadLog.h"
+#include "IndexFormat.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static constexpr size_t kRecordHeaderSize = 8;
+static constexpr uint32_t kMaxPayload = 1u << 30;
+
+
+// ---------------- ENCODING ----------------
+namespace {
+
+void putLE(string& out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) out.push_back((char)(v >> (8 * i)));
+}
+
+struct Cursor {
+    const unsigned char* p;
+    size_t left;
+
+    bool take(uint64_t& v, int bytes) {
+        if (left < (size_t)bytes) return false;
+        v = 0;
+        for (int i = 0; i < bytes; i++) v |= (uint64_t)p[i] << (8 * i);
+        p += bytes;
+        left -= bytes;
+        return true;
+    }
+    bool str(string& s, int lengthBytes) {
+        uint64_t n;
+        if (!take(n, lengthBytes) || n > left) return false;
+        s.assign((const char*)p, n);
+        p += n;
+        left -= n;
+        return true;
+    }
+};
+
+bool readAt(int fd, void* out, size_t size, uint64_t offset) {
+    char* p = (char*)out;
+    while (size > 0) {
+        ssize_t n = ::pread(fd, p, size, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool writeAll(int fd, const char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = ::pwrite(fd, data, size, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+// Copies [offset, offset + size) of one file to another through a fixed buffer
+bool copyRange(int from, uint64_t offset, uint64_t size, int to, uint64_t toOffset) {
+    static constexpr size_t kCopyBuffer = 1 << 20;
+    vector<char> buffer(min<uint64_t>(size, kCopyBuffer));
+    while (size > 0) {
+        size_t chunk = min<uint64_t>(size, buffer.size());
+        if (!readAt(from, buffer.data(), chunk, offset) || !writeAll(to, buffer.data(), chunk, toOffset))
+            return false;
+        offset += chunk;
+        toOffset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+void syncDirectoryOf(const string& path) {
+    size_t slash = path.find_last_of('/');
+    string dir = slash == string::npos ? "." : path.substr(0, slash);
+    int dfd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dfd < 0) return;
+    ::fsync(dfd);
+    ::close(dfd);
+}
+
+}
+
+string WriteAheadLog::encode(const WalRecord& record) {
+    string payload;
+    putLE(payload, (uint8_t)record.op, 1);
+    putLE(payload, record.lsn, 8);
+    if (record.op == WalOp::AddDocument) {
+        putLE(payload, record.path.size(), 4);
+        payload += record.path;
+        putLE(payload, record.content.size(), 8);
+        payload += record.content;
+        putLE(payload, record.embedding.size(), 4);
+        for (float f : record.embedding) {
+            uint32_t bits;
+            memcpy(&bits, &f, 4);
+            putLE(payload, bits, 4);
+        }
+    }
+
+    string out;
+    out.reserve(kRecordHeaderSize + payload.size());
+    putLE(out, payload.size(), 4);
+    putLE(out, crc32c(payload.data(), payload.size()), 4);
+    out += payload;
+    return out;
+}
+
+bool WriteAheadLog::decode(const char* data, size_t size, WalRecord& record) {
+    Cursor in{(const unsigned char*)data, size};
+    uint64_t op, lsn;
+    if (!in.take(op, 1) || !in.take(lsn, 8)) return false;
+    record = WalRecord();
+    record.op = (WalOp)op;
+    record.lsn = lsn;
+
+    if (record.op == WalOp::ClearCorpus) return in.left == 0;
+    if (record.op != WalOp::AddDocument) return false;
+
+    uint64_t dim;
+    if (!in.str(record.path, 4) || !in.str(record.content, 8) || !in.take(dim, 4)) return false;
+    if (in.left != dim * 4) return false;
+    record.embedding.resize(dim);
+    for (uint64_t i = 0; i < dim; i++) {
+        uint64_t bits;
+        if (!in.take(bits, 4)) return false;
+        uint32_t b32 = (uint32_t)bits;
+        memcpy(&record.embedding[i], &b32, 4);
+    }
+    return true;
+}
+
+
+// ---------------- OPEN / SCAN ----------------
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+// One record at a time: only the record being decoded is in memory
+bool WriteAheadLog::scan(const function<void(const WalRecord&, uint64_t end)>& visit) {
+    off_t fileEnd = ::lseek(fd, 0, SEEK_END);
+    if (fileEnd < 0) return false;
+    uint64_t end = fileEnd;
+
+    uint64_t at = 0;
+    unsigned char header[kRecordHeaderSize];
+    string payload;
+    while (end - at >= kRecordHeaderSize) {
+        if (!readAt(fd, header, kRecordHeaderSize, at)) return false;
+        Cursor in{header, kRecordHeaderSize};
+        uint64_t length, crc;
+        in.take(length, 4);
+        in.take(crc, 4);
+        if (length > kMaxPayload || length > end - at - kRecordHeaderSize) break;
+
+        payload.resize(length);
+        if (!readAt(fd, &payload[0], length, at + kRecordHeaderSize)) return false;
+        if (crc32c(payload.data(), length) != crc) break;
+        WalRecord record;
+        if (!decode(payload.data(), length, record)) break;
+
+        at += kRecordHeaderSize + length;
+        visit(record, at);
+    }
+    return true;
+}
+
+// Offset of the first record with an LSN above lsn, reading only record
+// headers; [0, end) holds whole records, checked when the log was opened
+uint64_t WriteAheadLog::firstRecordAfter(uint64_t lsn, uint64_t end) {
+    unsigned char head[kRecordHeaderSize + 9];   // length, crc, op, lsn
+    uint64_t at = 0;
+    while (end - at >= sizeof(head)) {
+        if (!readAt(fd, head, sizeof(head), at)) return at;
+        Cursor in{head, sizeof(head)};
+        uint64_t length, crc, op, recordLsn;
+        in.take(length, 4);
+        in.take(crc, 4);
+        in.take(op, 1);
+        in.take(recordLsn, 8);
+        if (recordLsn > lsn) return at;
+        at += kRecordHeaderSize + length;
+    }
+    return min(at, end);
+}
+
+bool WriteAheadLog::open(const string& logPath, uint64_t minLsn, string& error) {
+    close();
+    lock_guard<mutex> guard(lock);
+
+    fd = ::open(logPath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        error = string("open: ") + strerror(errno);
+        return false;
+    }
+    path = logPath;
+
+    uint64_t validEnd = 0, last = 0;
+    if (!scan([&](const WalRecord& record, uint64_t end) {
+            validEnd = end;
+            last = max(last, record.lsn);
+        })) {
+        error = "cannot read " + logPath;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    // Cut off whatever a crash left half-written so new records follow
+    // the last good one
+    off_t end = ::lseek(fd, 0, SEEK_END);
+    if (end >= 0 && (uint64_t)end != validEnd) {
+        if (::ftruncate(fd, validEnd) != 0 || ::fsync(fd) != 0) {
+            error = string("truncate: ") + strerror(errno);
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+    }
+
+    size = validEnd;
+    writtenLsn = durableLsn = max(last, minLsn);
+    nextLsn = writtenLsn + 1;
+    counters = WalStats();
+    opened = true;
+    return true;
+}
+
+void WriteAheadLog::close() {
+    unique_lock<mutex> guard(lock);
+    synced.wait(guard, [&] { return !syncing; });
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    opened = false;
+}
+
+// Records are applied as they are read, so replay never holds more than
+// one of them; nothing appends while the log is being replayed
+bool WriteAheadLog::replay(uint64_t after, const function<void(const WalRecord&)>& apply, string& error) {
+    lock_guard<mutex> guard(lock);
+    if (fd < 0) {
+        error = "log is not open";
+        return false;
+    }
+    if (!scan([&](const WalRecord& record, uint64_t) {
+            if (record.lsn > after) apply(record);
+        })) {
+        error = "cannot read " + path;
+        return false;
+    }
+    return true;
+}
+
+
+// ---------------- APPEND / GROUP COMMIT ----------------
+uint64_t WriteAheadLog::append(WalRecord record) {
+    lock_guard<mutex> guard(lock);
+    if (fd < 0) return 0;
+
+    record.lsn = nextLsn;
+    string bytes = encode(record);
+    // scan() would take a record this large for a torn tail and cut it off
+    if (bytes.size() - kRecordHeaderSize > kMaxPayload) return 0;
+    if (!writeAll(fd, bytes.data(), bytes.size(), size)) {
+        // Leave no partial record behind for the next append to follow
+        if (::ftruncate(fd, size) != 0) {}
+        return 0;
+    }
+
+    size += bytes.size();
+    writtenLsn = nextLsn++;
+    counters.records++;
+    return writtenLsn;
+}
+
+bool WriteAheadLog::sync(uint64_t lsn) {
+    unique_lock<mutex> guard(lock);
+    while (durableLsn < lsn) {
+        if (fd < 0) return false;
+        if (syncing) {
+            // Someone is already syncing: their fsync may cover lsn; if not,
+            // the next round takes everything written up to then
+            synced.wait(guard);
+            continue;
+        }
+
+        syncing = true;
+        uint64_t target = writtenLsn;
+        int syncFd = fd;
+        guard.unlock();
+        bool ok = ::fdatasync(syncFd) == 0;
+        guard.lock();
+        syncing = false;
+        if (ok) {
+            durableLsn = max(durableLsn, target);
+            counters.syncs++;
+        }
+        synced.notify_all();
+        if (!ok) return false;
+    }
+    return true;
+}
+
+
+// ---------------- COMPACTION ----------------
+bool WriteAheadLog::truncateThrough(uint64_t lsn) {
+    lock_guard<mutex> compacting(compactMutex);
+    uint64_t end;
+    {
+        unique_lock<mutex> guard(lock);
+        if (fd < 0) return false;
+        if (size == 0) return true;
+        end = size;
+    }
+
+    // Copy the records the index does not cover into a new log and swap it
+    // in atomically; a crash leaves either the old or the new log. LSNs
+    // only grow along the log, so those records are one byte range, and
+    // the bulk of it is copied while appends go on past end.
+    uint64_t cut = firstRecordAfter(lsn, end);
+    string tmpPath = path + ".tmp";
+    int tmp = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (tmp < 0) return false;
+    auto abandon = [&]() {
+        ::close(tmp);
+        ::unlink(tmpPath.c_str());
+        return false;
+    };
+    if (!copyRange(fd, cut, end - cut, tmp, 0)) return abandon();
+
+    // Only what was appended meanwhile is copied with appends held off
+    unique_lock<mutex> guard(lock);
+    synced.wait(guard, [&] { return !syncing; });
+    if (fd < 0) return abandon();
+    if (!copyRange(fd, end, size - end, tmp, end - cut) || ::fsync(tmp) != 0 ||
+        ::rename(tmpPath.c_str(), path.c_str()) != 0)
+        return abandon();
+    syncDirectoryOf(path);
+
+    ::close(fd);
+    fd = tmp;
+    size -= cut;
+    durableLsn = writtenLsn;    // everything kept was just fsynced
+    return true;
+}
+
+uint64_t WriteAheadLog::lastLsn() {
+    lock_guard<mutex> guard(lock);
+    return writtenLsn;
+}
+
+WalStats WriteAheadLog::stats() {
+    lock_guard<mutex> guard(lock);
+    WalStats s = counters;
+    s.bytes = size;
+    s.lastLsn = writtenLsn;
+    s.durableLsn = durableLsn;
+    return s;
+}
@@ -0,0 +1,81 @@
+// Posting-list intersection benchmark: scalar merge vs galloping vs the
+// dispatched SIMD block kernel vs the adaptive choice, on docID lists whose
+// lengths follow a Zipfian term distribution.
+//   make bench_intersect && ./bench_intersect [docs] [zipf exponent]
+#include "PostingOps.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+// Each doc contains the term independently with probability p; gaps are
+// geometric, so generation is O(list length) rather than O(docs)
+static vector<int> sampleList(int docs, double p, mt19937& rng) {
+    vector<int> list;
+    if (p >= 1.0) {
+        for (int d = 0; d < docs; d++) list.push_back(d);
+        return list;
+    }
+    geometric_distribution<int> gap(p);
+    for (long long d = gap(rng); d < docs; d += gap(rng) + 1)
+        list.push_back((int)d);
+    return list;
+}
+
+template <typename Fn>
+static double timeMs(int repeats, Fn fn) {
+    auto start = chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeats; r++) fn();
+    auto end = chrono::high_resolution_clock::now();
+    return chrono::duration<double, milli>(end - start).count() / repeats;
+}
+
+int main(int argc, char** argv) {
+    int docs = argc > 1 ? atoi(argv[1]) : 1000000;
+    double s = argc > 2 ? atof(argv[2]) : 1.0;
+    int repeats = 20;
+
+    // df(rank) = docs * 0.5 / rank^s, i.e. the most common term is in half
+    // of the documents
+    auto density = [&](int rank) { return 0.5 / pow((double)rank, s); };
+
+    // (rank, rank) pairs from similar to very skewed lengths
+    vector<pair<int, int>> pairs = {
+        {1, 2}, {2, 5}, {5, 20}, {1, 50}, {1, 100}, {1, 200}, {1, 500}, {10, 300}, {2, 2000}, {1, 20000}
+    };
+
+    mt19937 rng(42);
+    printf("docs=%d zipf=%.2f simd=%s gallop ratio=%zu\n",
+           docs, s, activeIntersectKernel(), kGallopRatio);
+    printf("%-12s %9s %9s %7s | %9s %9s %9s %9s  %s\n",
+           "ranks", "|a|", "|b|", "ratio", "merge", "gallop", "simd", "adaptive", "(ms)");
+
+    volatile size_t sink = 0;
+    for (auto [ra, rb] : pairs) {
+        vector<int> a = sampleList(docs, density(ra), rng);
+        vector<int> b = sampleList(docs, density(rb), rng);
+
+        vector<int> expected = intersectMerge(a, b);
+        if (intersectGalloping(a, b) != expected || intersectSIMD(a, b) != expected ||
+            intersectAdaptive(a, b) != expected) {
+            printf("kernel mismatch on ranks %d,%d\n", ra, rb);
+            return 1;
+        }
+
+        double mergeMs = timeMs(repeats, [&]() { sink = sink + intersectMerge(a, b).size(); });
+        double gallopMs = timeMs(repeats, [&]() { sink = sink + intersectGalloping(a, b).size(); });
+        double simdMs = timeMs(repeats, [&]() { sink = sink + intersectSIMD(a, b).size(); });
+        double adaptiveMs = timeMs(repeats, [&]() { sink = sink + intersectAdaptive(a, b).size(); });
+
+        char label[32];
+        snprintf(label, sizeof(label), "%d x %d", ra, rb);
+        printf("%-12s %9zu %9zu %7.1f | %9.3f %9.3f %9.3f %9.3f\n",
+               label, a.size(), b.size(), (double)max(a.size(), b.size()) / max<size_t>(1, min(a.size(), b.size())),
+               mergeMs, gallopMs, simdMs, adaptiveMs);
+    }
+    return 0;
+}
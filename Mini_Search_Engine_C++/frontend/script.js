@@ -306,10 +306,8 @@ window.onload = updateCorpusInfo;
 // ========================
 function saveIndexToDisk() {
   fetch("http://localhost:8080/saveIndex", { method: "POST" })
-    .then(res => res.text())
-    .then(msg => {
-      alert("✅ " + msg); // Pops up a success message on the screen!
-    })
+    .then(res => res.json())
+    .then(job => pollSaveJob(job.job_id))
     .catch(err => {
       console.error("Error saving index:", err);
       alert("❌ Failed to save index.");
@@ -322,6 +320,27 @@ function saveIndexToDisk() {
 
 
 
+// The save runs in the background; check on it until it finishes
+function pollSaveJob(id) {
+  fetch(`http://localhost:8080/saveIndex/status?id=${id}`)
+    .then(res => res.json())
+    .then(status => {
+      if (status.state === "running") {
+        setTimeout(() => pollSaveJob(id), 500);
+      } else if (status.state === "done") {
+        alert(`✅ Index saved to disk (${status.bytes_written} bytes)`);
+      } else {
+        alert("❌ Failed to save index: " + (status.error || status.state));
+      }
+    })
+    .catch(err => {
+      console.error("Error checking save job:", err);
+      alert("❌ Failed to save index.");
+    });
+}
+
+
+
 // ========================
 // 🔹 RAG AI Chat (FastAPI)
 // ========================